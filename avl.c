@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <jeffpc/avl.h>
+#include <jeffpc/error.h>
+
+#include "tree_impl.h"
+
+/*
+ * The extra field holds the balance of each node - either it is balanced
+ * or the subtree in one direction is taller by one.
+ */
+#define BALANCED	0
+#define HEAVY(dir)	(1 + (dir))
+
+static inline unsigned int get_balance(struct tree_node *node)
+{
+	return get_extra(node);
+}
+
+static inline void set_balance(struct tree_node *node, unsigned int balance)
+{
+	set_extra(node, balance);
+}
+
+void avl_create(struct avl_tree *tree,
+		int (*cmp)(const void *, const void *),
+		size_t size, size_t off)
+{
+	ASSERT3U(off + sizeof(struct avl_node), <=, size);
+
+	tree->tree.cmp = cmp;
+	tree->tree.root = NULL;
+	tree->tree.node_size = size;
+	tree->tree.node_off = off;
+	tree->tree.num_nodes = 0;
+	tree->tree.flavor = TREE_FLAVOR_AVL;
+}
+
+void avl_destroy(struct avl_tree *tree)
+{
+	memset(tree, 0, sizeof(struct avl_tree));
+}
+
+void avl_add(struct avl_tree *tree, void *item)
+{
+	struct avl_node *orig;
+
+	orig = avl_insert(tree, item);
+	if (orig)
+		panic("%s(%p, %p) failed: tree already contains desired key",
+		      __func__, tree, item);
+}
+
+/*
+ * Rebalance a node whose @heavy subtree is two taller than the other one.
+ * Returns the node that took its place.
+ *
+ *        P                C                  P                 G
+ *       / \              / \                / \               / \
+ *      C   .    ==>     .   P              C   .    ==>      C   P
+ *     / \                  / \            / \               /|   |\
+ *    .   .                .   .          .   G             . .   . .
+ *                                           / \
+ *                                          .   .
+ *
+ * The left case is a single rotation, and the right one is a double
+ * rotation (shown with @heavy being TREE_LEFT).
+ */
+static struct tree_node *rebalance(struct tree_tree *tree,
+				   struct tree_node *parent,
+				   enum tree_dir heavy)
+{
+	const enum tree_dir light = 1 - heavy;
+	struct tree_node *child = parent->children[heavy];
+	struct tree_node *gchild;
+	unsigned int balance;
+
+	if (get_balance(child) != HEAVY(light)) {
+		tree_rotate(tree, parent, light);
+
+		if (get_balance(child) == BALANCED) {
+			/* only possible during removal */
+			set_balance(child, HEAVY(light));
+			set_balance(parent, HEAVY(heavy));
+		} else {
+			set_balance(child, BALANCED);
+			set_balance(parent, BALANCED);
+		}
+
+		return child;
+	}
+
+	gchild = child->children[light];
+	balance = get_balance(gchild);
+
+	tree_rotate(tree, child, heavy);
+	tree_rotate(tree, parent, light);
+
+	set_balance(child, (balance == HEAVY(light)) ? HEAVY(heavy) : BALANCED);
+	set_balance(parent, (balance == HEAVY(heavy)) ? HEAVY(light) : BALANCED);
+	set_balance(gchild, BALANCED);
+
+	return gchild;
+}
+
+void *avl_insert_here(struct avl_tree *_tree, void *newitem,
+		      struct avl_cookie *cookie)
+{
+	struct tree_tree *tree = &_tree->tree;
+	struct tree_node *parent;
+	struct tree_node *node;
+	void *tmp;
+
+	node = obj2node(tree, newitem);
+
+	tmp = tree_insert_here(tree, newitem, &cookie->cookie);
+	if (tmp)
+		return tmp;
+
+	set_balance(node, BALANCED);
+
+	/* walk up the tree while the subtree containing node got taller */
+	for (parent = get_parent(node); parent;
+	     node = parent, parent = get_parent(node)) {
+		const enum tree_dir dir = which_dir(parent, node);
+		const unsigned int balance = get_balance(parent);
+
+		if (balance == BALANCED) {
+			set_balance(parent, HEAVY(dir));
+			continue;
+		}
+
+		/* the shorter side caught up */
+		if (balance == HEAVY(1 - dir))
+			set_balance(parent, BALANCED);
+		else
+			rebalance(tree, parent, dir);
+
+		/* either way, the height of this subtree did not change */
+		break;
+	}
+
+	return NULL; /* no previous node */
+}
+
+void avl_remove(struct avl_tree *_tree, void *item)
+{
+	struct tree_tree *tree = &_tree->tree;
+	struct tree_node *parent;
+	struct tree_node *child;
+	struct tree_node *node;
+	enum tree_dir dir;
+
+	node = obj2node(tree, item);
+
+	/*
+	 * Figure out which side of the parent loses a node before
+	 * tree_remove moves things around.  With two children, the node
+	 * first gets swapped with its successor.
+	 */
+	if (node->children[TREE_LEFT] && node->children[TREE_RIGHT]) {
+		struct tree_node *succ;
+
+		succ = firstlast(node->children[TREE_RIGHT], TREE_LEFT);
+
+		dir = (succ == node->children[TREE_RIGHT]) ? TREE_RIGHT :
+							     TREE_LEFT;
+	} else if (get_parent(node)) {
+		dir = which_dir(get_parent(node), node);
+	} else {
+		dir = TREE_LEFT; /* removing the root, nothing to fix up */
+	}
+
+	tree_remove(tree, item, &parent, &child);
+
+	/* walk up the tree while the subtree at parent got shorter */
+	while (parent) {
+		const unsigned int balance = get_balance(parent);
+
+		if (balance == BALANCED) {
+			set_balance(parent, HEAVY(1 - dir));
+			break;
+		}
+
+		if (balance == HEAVY(dir)) {
+			set_balance(parent, BALANCED);
+		} else {
+			parent = rebalance(tree, parent, 1 - dir);
+
+			/* a single rotation may keep the height the same */
+			if (get_balance(parent) != BALANCED)
+				break;
+		}
+
+		node = parent;
+		parent = get_parent(node);
+		if (parent)
+			dir = which_dir(parent, node);
+	}
+}
@@ -0,0 +1,846 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <jeffpc/btree.h>
+#include <jeffpc/error.h>
+#include <jeffpc/mem.h>
+
+/*
+ * Each node holds up to MAX_ITEMS items in ascending order along with
+ * their prefixes, and internal nodes hold one more child than items.  With
+ * 15 items, a leaf is exactly four 64-byte cache lines and an internal node
+ * is six.  A binary search within a node touches at most two cache lines
+ * worth of prefixes, and only the items with a matching prefix.
+ *
+ * Every node except the root has at least MIN_ITEMS items, and the root
+ * has at least one.  An empty tree has no root.
+ */
+
+#define MAX_ITEMS	15
+#define MIN_ITEMS	(MAX_ITEMS / 2)
+
+struct btree_node {
+	struct btree_node *parent;
+	uint16_t nitems;
+	bool leaf;
+	uint64_t prefixes[MAX_ITEMS];
+	void *items[MAX_ITEMS];
+	struct btree_node *children[MAX_ITEMS + 1]; /* unless leaf */
+};
+
+#define LEAF_SIZE	offsetof(struct btree_node, children)
+
+STATIC_ASSERT(LEAF_SIZE == 256);
+STATIC_ASSERT(sizeof(struct btree_node) == 384);
+
+static struct mem_cache *leaf_cache;
+static struct mem_cache *internal_cache;
+
+static void __attribute__((constructor)) init_btree_subsys(void)
+{
+	leaf_cache = mem_cache_create("btree-leaf-cache", LEAF_SIZE, 64);
+	ASSERT(!IS_ERR(leaf_cache));
+
+	internal_cache = mem_cache_create("btree-internal-cache",
+					  sizeof(struct btree_node), 64);
+	ASSERT(!IS_ERR(internal_cache));
+}
+
+static struct btree_node *alloc_node(bool leaf)
+{
+	struct btree_node *node;
+
+	node = mem_cache_alloc(leaf ? leaf_cache : internal_cache);
+	if (!node)
+		return NULL;
+
+	node->parent = NULL;
+	node->nitems = 0;
+	node->leaf = leaf;
+
+	return node;
+}
+
+static void free_node(struct btree_node *node)
+{
+	mem_cache_free(node->leaf ? leaf_cache : internal_cache, node);
+}
+
+void btree_create(struct btree *tree,
+		  int (*cmp)(const void *, const void *),
+		  uint64_t (*prefix)(const void *))
+{
+	tree->cmp = cmp;
+	tree->prefix = prefix;
+	tree->root = NULL;
+	tree->num_items = 0;
+}
+
+void btree_destroy(struct btree *tree)
+{
+	struct btree_cookie cookie;
+
+	memset(&cookie, 0, sizeof(cookie));
+
+	while (btree_destroy_nodes(tree, &cookie))
+		;
+
+	memset(tree, 0, sizeof(struct btree));
+}
+
+/*
+ * Search
+ */
+
+/* without a prefix function, all the prefixes are zero */
+static inline uint64_t get_prefix(struct btree *tree, const void *item)
+{
+	return tree->prefix ? tree->prefix(item) : 0;
+}
+
+static inline int cmp_item(struct btree *tree, const void *key,
+			   uint64_t prefix, struct btree_node *node,
+			   size_t idx)
+{
+	if (prefix != node->prefixes[idx])
+		return (prefix < node->prefixes[idx]) ? -1 : 1;
+
+	return tree->cmp(key, node->items[idx]);
+}
+
+/*
+ * Returns true if the key is in the node, with *idx_r set to its index.
+ * Otherwise, *idx_r is the index of the first item greater than the key.
+ */
+static bool search_node(struct btree *tree, struct btree_node *node,
+			const void *key, uint64_t prefix, size_t *idx_r)
+{
+	size_t lo = 0;
+	size_t hi = node->nitems;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp;
+
+		cmp = cmp_item(tree, key, prefix, node, mid);
+		if (cmp == 0) {
+			*idx_r = mid;
+			return true;
+		}
+
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	*idx_r = lo;
+
+	return false;
+}
+
+/*
+ * Returns true if the key is in the tree, with *node_r & *idx_r set to its
+ * location.  Otherwise, they are set to the leaf and index where the key
+ * would be inserted.
+ */
+static bool locate(struct btree *tree, const void *key,
+		   struct btree_node **node_r, size_t *idx_r)
+{
+	const uint64_t prefix = get_prefix(tree, key);
+	struct btree_node *node;
+	size_t idx;
+
+	node = tree->root;
+	idx = 0;
+
+	while (node) {
+		bool found;
+
+		found = search_node(tree, node, key, prefix, &idx);
+		if (found || node->leaf) {
+			*node_r = node;
+			*idx_r = idx;
+			return found;
+		}
+
+		node = node->children[idx];
+	}
+
+	*node_r = NULL;
+	*idx_r = 0;
+
+	return false;
+}
+
+void *btree_find(struct btree *tree, const void *key,
+		 struct btree_cookie *cookie)
+{
+	struct btree_node *node;
+	size_t idx;
+
+	if (locate(tree, key, &node, &idx))
+		return node->items[idx];
+
+	if (cookie) {
+		cookie->node = node;
+		cookie->idx = idx;
+	}
+
+	return NULL;
+}
+
+/*
+ * Iteration
+ */
+
+static size_t child_idx(struct btree_node *parent, struct btree_node *child)
+{
+	size_t i;
+
+	for (i = 0; i <= parent->nitems; i++)
+		if (parent->children[i] == child)
+			return i;
+
+	panic("%s: node %p is not a child of node %p", __func__, child,
+	      parent);
+}
+
+static struct btree_node *leftmost(struct btree_node *node)
+{
+	while (!node->leaf)
+		node = node->children[0];
+
+	return node;
+}
+
+static struct btree_node *rightmost(struct btree_node *node)
+{
+	while (!node->leaf)
+		node = node->children[node->nitems];
+
+	return node;
+}
+
+/*
+ * Find the nearest item on either side of a gap in a leaf.  Gap idx lies
+ * between items idx - 1 and idx, and the same applies to the child
+ * pointers in internal nodes, so running out of items in a node means
+ * continuing at the node's gap in its parent.
+ */
+static void *nearest(struct btree_node *node, size_t idx, bool gt)
+{
+	for (;;) {
+		if (gt && (idx < node->nitems))
+			return node->items[idx];
+		if (!gt && (idx > 0))
+			return node->items[idx - 1];
+
+		if (!node->parent)
+			return NULL;
+
+		idx = child_idx(node->parent, node);
+		node = node->parent;
+	}
+}
+
+void *btree_nearest_lt(struct btree *tree, struct btree_cookie *cookie)
+{
+	if (!cookie->node)
+		return NULL;
+
+	return nearest(cookie->node, cookie->idx, false);
+}
+
+void *btree_nearest_gt(struct btree *tree, struct btree_cookie *cookie)
+{
+	if (!cookie->node)
+		return NULL;
+
+	return nearest(cookie->node, cookie->idx, true);
+}
+
+/* position the cookie at an item and return it */
+static inline void *at(struct btree_cookie *cookie, struct btree_node *node,
+		       size_t idx)
+{
+	cookie->node = node;
+	cookie->idx = idx;
+
+	return node->items[idx];
+}
+
+void *btree_iter_first(struct btree *tree, struct btree_cookie *cookie)
+{
+	if (!tree->root) {
+		cookie->node = NULL;
+		return NULL;
+	}
+
+	return at(cookie, leftmost(tree->root), 0);
+}
+
+void *btree_iter_last(struct btree *tree, struct btree_cookie *cookie)
+{
+	struct btree_node *node;
+
+	if (!tree->root) {
+		cookie->node = NULL;
+		return NULL;
+	}
+
+	node = rightmost(tree->root);
+
+	return at(cookie, node, node->nitems - 1);
+}
+
+/*
+ * The cookie points at an item.  The next item is either the first item
+ * of the subtree to its right, or the next item in the leaf, or the item
+ * after the gap we came up through in one of the ancestors.
+ */
+void *btree_iter_next(struct btree *tree, struct btree_cookie *cookie)
+{
+	struct btree_node *node = cookie->node;
+	size_t idx = cookie->idx + 1;
+
+	if (!node)
+		return NULL;
+
+	if (!node->leaf)
+		return at(cookie, leftmost(node->children[idx]), 0);
+
+	while (idx >= node->nitems) {
+		if (!node->parent) {
+			cookie->node = NULL;
+			return NULL;
+		}
+
+		idx = child_idx(node->parent, node);
+		node = node->parent;
+	}
+
+	return at(cookie, node, idx);
+}
+
+void *btree_iter_prev(struct btree *tree, struct btree_cookie *cookie)
+{
+	struct btree_node *node = cookie->node;
+	size_t idx = cookie->idx;
+
+	if (!node)
+		return NULL;
+
+	if (!node->leaf) {
+		node = rightmost(node->children[idx]);
+
+		return at(cookie, node, node->nitems - 1);
+	}
+
+	while (!idx) {
+		if (!node->parent) {
+			cookie->node = NULL;
+			return NULL;
+		}
+
+		idx = child_idx(node->parent, node);
+		node = node->parent;
+	}
+
+	return at(cookie, node, idx - 1);
+}
+
+void *btree_first(struct btree *tree)
+{
+	struct btree_cookie cookie;
+
+	return btree_iter_first(tree, &cookie);
+}
+
+void *btree_last(struct btree *tree)
+{
+	struct btree_cookie cookie;
+
+	return btree_iter_last(tree, &cookie);
+}
+
+static void locate_item(struct btree *tree, void *item,
+			struct btree_cookie *cookie)
+{
+	if (!locate(tree, item, &cookie->node, &cookie->idx))
+		panic("%s: tree %p does not contain item %p", __func__, tree,
+		      item);
+}
+
+void *btree_next(struct btree *tree, void *item)
+{
+	struct btree_cookie cookie;
+
+	locate_item(tree, item, &cookie);
+
+	return btree_iter_next(tree, &cookie);
+}
+
+void *btree_prev(struct btree *tree, void *item)
+{
+	struct btree_cookie cookie;
+
+	locate_item(tree, item, &cookie);
+
+	return btree_iter_prev(tree, &cookie);
+}
+
+/*
+ * Insertion
+ */
+
+/* insert an item and (unless leaf) its right child, there must be room */
+static void node_insert(struct btree_node *node, size_t idx, void *item,
+			uint64_t prefix, struct btree_node *right)
+{
+	const size_t n = node->nitems - idx;
+
+	ASSERT3U(node->nitems, <, MAX_ITEMS);
+	ASSERT3U(idx, <=, node->nitems);
+
+	memmove(&node->prefixes[idx + 1], &node->prefixes[idx],
+		n * sizeof(uint64_t));
+	memmove(&node->items[idx + 1], &node->items[idx], n * sizeof(void *));
+
+	node->prefixes[idx] = prefix;
+	node->items[idx] = item;
+
+	if (!node->leaf) {
+		memmove(&node->children[idx + 2], &node->children[idx + 1],
+			n * sizeof(struct btree_node *));
+
+		node->children[idx + 1] = right;
+		right->parent = node;
+	}
+
+	node->nitems++;
+}
+
+/*
+ * Move the upper half of a full node into an empty sibling, and take out
+ * the median item for the caller to move up into the parent.
+ */
+static void split(struct btree_node *node, struct btree_node *sibling,
+		  void **median, uint64_t *median_prefix)
+{
+	const size_t n = MAX_ITEMS - MIN_ITEMS - 1;
+	size_t i;
+
+	ASSERT3U(node->nitems, ==, MAX_ITEMS);
+	ASSERT3U(sibling->nitems, ==, 0);
+	ASSERT3U(node->leaf, ==, sibling->leaf);
+
+	memcpy(sibling->prefixes, &node->prefixes[MIN_ITEMS + 1],
+	       n * sizeof(uint64_t));
+	memcpy(sibling->items, &node->items[MIN_ITEMS + 1],
+	       n * sizeof(void *));
+
+	if (!node->leaf) {
+		memcpy(sibling->children, &node->children[MIN_ITEMS + 1],
+		       (n + 1) * sizeof(struct btree_node *));
+
+		for (i = 0; i <= n; i++)
+			sibling->children[i]->parent = sibling;
+	}
+
+	sibling->nitems = n;
+
+	*median = node->items[MIN_ITEMS];
+	*median_prefix = node->prefixes[MIN_ITEMS];
+
+	node->nitems = MIN_ITEMS;
+}
+
+/* the spare nodes are chained via their parent pointers */
+static struct btree_node *pop_spare(struct btree_node **spares)
+{
+	struct btree_node *node = *spares;
+
+	ASSERT3P(node, !=, NULL);
+
+	*spares = node->parent;
+	node->parent = NULL;
+
+	return node;
+}
+
+static void free_spares(struct btree_node *spares)
+{
+	while (spares)
+		free_node(pop_spare(&spares));
+}
+
+void *btree_insert_here(struct btree *tree, void *item,
+			struct btree_cookie *cookie)
+{
+	struct btree_cookie local_cookie;
+	struct btree_node *spares;
+	struct btree_node **tail;
+	struct btree_node *right;
+	struct btree_node *node;
+	uint64_t prefix;
+	size_t idx;
+
+	if (!cookie) {
+		void *tmp;
+
+		tmp = btree_find(tree, item, &local_cookie);
+		if (tmp)
+			return tmp;
+
+		cookie = &local_cookie;
+	}
+
+	ASSERT(!cookie->node || cookie->node->leaf);
+
+	/*
+	 * Every full node on the way up splits, and if they are all full
+	 * (or the tree is empty) we need a new root.  Allocate all the
+	 * nodes up front so that we can back out.
+	 */
+	spares = NULL;
+	tail = &spares;
+
+	for (node = cookie->node; node; node = node->parent) {
+		if (node->nitems < MAX_ITEMS)
+			break;
+
+		*tail = alloc_node(node->leaf);
+		if (!*tail)
+			goto err;
+
+		tail = &(*tail)->parent;
+	}
+
+	if (!node) {
+		*tail = alloc_node(!cookie->node);
+		if (!*tail)
+			goto err;
+	}
+
+	tree->num_items++;
+
+	prefix = get_prefix(tree, item);
+	right = NULL;
+
+	if (!cookie->node) {
+		node = pop_spare(&spares);
+		node_insert(node, 0, item, prefix, NULL);
+		tree->root = node;
+		goto out;
+	}
+
+	node = cookie->node;
+	idx = cookie->idx;
+
+	while (node->nitems == MAX_ITEMS) {
+		struct btree_node *sibling;
+		uint64_t median_prefix;
+		void *median;
+
+		sibling = pop_spare(&spares);
+
+		split(node, sibling, &median, &median_prefix);
+
+		if (idx <= MIN_ITEMS)
+			node_insert(node, idx, item, prefix, right);
+		else
+			node_insert(sibling, idx - MIN_ITEMS - 1, item, prefix,
+				    right);
+
+		/* now, insert the median into the parent */
+		item = median;
+		prefix = median_prefix;
+		right = sibling;
+
+		if (!node->parent) {
+			struct btree_node *root;
+
+			root = pop_spare(&spares);
+			root->children[0] = node;
+			node->parent = root;
+			tree->root = root;
+		}
+
+		idx = child_idx(node->parent, node);
+		node = node->parent;
+	}
+
+	node_insert(node, idx, item, prefix, right);
+
+out:
+	ASSERT3P(spares, ==, NULL);
+
+	return NULL;
+
+err:
+	free_spares(spares);
+
+	return ERR_PTR(-ENOMEM);
+}
+
+int btree_add(struct btree *tree, void *item)
+{
+	void *orig;
+
+	orig = btree_insert(tree, item);
+	if (IS_ERR(orig))
+		return PTR_ERR(orig);
+	if (orig)
+		panic("%s(%p, %p) failed: tree already contains desired key",
+		      __func__, tree, item);
+
+	return 0;
+}
+
+/*
+ * Removal
+ */
+
+/* remove an item and (unless leaf) its right child */
+static void node_delete(struct btree_node *node, size_t idx)
+{
+	const size_t n = node->nitems - idx - 1;
+
+	ASSERT3U(idx, <, node->nitems);
+
+	memmove(&node->prefixes[idx], &node->prefixes[idx + 1],
+		n * sizeof(uint64_t));
+	memmove(&node->items[idx], &node->items[idx + 1], n * sizeof(void *));
+
+	if (!node->leaf)
+		memmove(&node->children[idx + 1], &node->children[idx + 2],
+			n * sizeof(struct btree_node *));
+
+	node->nitems--;
+}
+
+/* move the last item of the left child through the parent to the right */
+static void rotate_right(struct btree_node *parent, size_t sep)
+{
+	struct btree_node *left = parent->children[sep];
+	struct btree_node *right = parent->children[sep + 1];
+	const size_t last = left->nitems - 1;
+
+	memmove(&right->prefixes[1], &right->prefixes[0],
+		right->nitems * sizeof(uint64_t));
+	memmove(&right->items[1], &right->items[0],
+		right->nitems * sizeof(void *));
+
+	if (!right->leaf) {
+		memmove(&right->children[1], &right->children[0],
+			(right->nitems + 1) * sizeof(struct btree_node *));
+
+		right->children[0] = left->children[last + 1];
+		right->children[0]->parent = right;
+	}
+
+	right->prefixes[0] = parent->prefixes[sep];
+	right->items[0] = parent->items[sep];
+	right->nitems++;
+
+	parent->prefixes[sep] = left->prefixes[last];
+	parent->items[sep] = left->items[last];
+
+	left->nitems--;
+}
+
+/* move the first item of the right child through the parent to the left */
+static void rotate_left(struct btree_node *parent, size_t sep)
+{
+	struct btree_node *left = parent->children[sep];
+	struct btree_node *right = parent->children[sep + 1];
+	const size_t n = left->nitems;
+
+	left->prefixes[n] = parent->prefixes[sep];
+	left->items[n] = parent->items[sep];
+
+	if (!left->leaf) {
+		left->children[n + 1] = right->children[0];
+		left->children[n + 1]->parent = left;
+
+		memmove(&right->children[0], &right->children[1],
+			right->nitems * sizeof(struct btree_node *));
+	}
+
+	left->nitems++;
+
+	parent->prefixes[sep] = right->prefixes[0];
+	parent->items[sep] = right->items[0];
+
+	memmove(&right->prefixes[0], &right->prefixes[1],
+		(right->nitems - 1) * sizeof(uint64_t));
+	memmove(&right->items[0], &right->items[1],
+		(right->nitems - 1) * sizeof(void *));
+
+	right->nitems--;
+}
+
+/* merge the right child and the separator into the left child */
+static void merge(struct btree_node *parent, size_t sep)
+{
+	struct btree_node *left = parent->children[sep];
+	struct btree_node *right = parent->children[sep + 1];
+	const size_t n = left->nitems;
+	size_t i;
+
+	ASSERT3U(n + right->nitems + 1, <=, MAX_ITEMS);
+
+	left->prefixes[n] = parent->prefixes[sep];
+	left->items[n] = parent->items[sep];
+
+	memcpy(&left->prefixes[n + 1], right->prefixes,
+	       right->nitems * sizeof(uint64_t));
+	memcpy(&left->items[n + 1], right->items,
+	       right->nitems * sizeof(void *));
+
+	if (!left->leaf) {
+		memcpy(&left->children[n + 1], right->children,
+		       (right->nitems + 1) * sizeof(struct btree_node *));
+
+		for (i = 0; i <= right->nitems; i++)
+			right->children[i]->parent = left;
+	}
+
+	left->nitems += right->nitems + 1;
+
+	free_node(right);
+
+	node_delete(parent, sep);
+}
+
+static void rebalance(struct btree *tree, struct btree_node *node)
+{
+	while (node->parent && (node->nitems < MIN_ITEMS)) {
+		struct btree_node *parent = node->parent;
+		struct btree_node *left;
+		struct btree_node *right;
+		size_t idx;
+
+		idx = child_idx(parent, node);
+		left = (idx > 0) ? parent->children[idx - 1] : NULL;
+		right = (idx < parent->nitems) ? parent->children[idx + 1] : NULL;
+
+		/* borrow from a sibling if possible... */
+		if (left && (left->nitems > MIN_ITEMS)) {
+			rotate_right(parent, idx - 1);
+			return;
+		}
+
+		if (right && (right->nitems > MIN_ITEMS)) {
+			rotate_left(parent, idx);
+			return;
+		}
+
+		/* ...otherwise merge with one, taking an item from the parent */
+		merge(parent, left ? (idx - 1) : idx);
+
+		node = parent;
+	}
+
+	if (!node->parent && !node->nitems) {
+		/* the root became empty */
+		tree->root = node->leaf ? NULL : node->children[0];
+		if (tree->root)
+			tree->root->parent = NULL;
+
+		free_node(node);
+	}
+}
+
+void btree_remove(struct btree *tree, void *item)
+{
+	struct btree_node *node;
+	size_t idx;
+
+	if (!locate(tree, item, &node, &idx))
+		panic("%s: tree %p does not contain item %p", __func__, tree,
+		      item);
+
+	if (!node->leaf) {
+		/* replace the item with its predecessor, which is in a leaf */
+		struct btree_node *leaf = rightmost(node->children[idx]);
+
+		node->prefixes[idx] = leaf->prefixes[leaf->nitems - 1];
+		node->items[idx] = leaf->items[leaf->nitems - 1];
+
+		node = leaf;
+		idx = leaf->nitems - 1;
+	}
+
+	node_delete(node, idx);
+
+	tree->num_items--;
+
+	rebalance(tree, node);
+}
+
+/*
+ * Destruction
+ *
+ * We go through the tree in reverse order, returning the items from the
+ * ends of the nodes and freeing nodes once they are empty.  The cookie
+ * keeps track of the current node.  An internal node's last child pointer
+ * is cleared when that child is freed, which in turn exposes the node's
+ * last item.
+ */
+void *btree_destroy_nodes(struct btree *tree, struct btree_cookie *cookie)
+{
+	struct btree_node *node;
+
+	node = cookie->node ? cookie->node : tree->root;
+
+	while (node) {
+		struct btree_node *parent;
+
+		while (!node->leaf && node->children[node->nitems])
+			node = node->children[node->nitems];
+
+		if (node->nitems) {
+			cookie->node = node;
+			tree->num_items--;
+			return node->items[--node->nitems];
+		}
+
+		parent = node->parent;
+
+		free_node(node);
+
+		if (parent)
+			parent->children[parent->nitems] = NULL;
+		else
+			tree->root = NULL;
+
+		node = parent;
+	}
+
+	cookie->node = NULL;
+
+	return NULL;
+}
@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include <jeffpc/atomic.h>
+#include <jeffpc/chashtab.h>
+#include <jeffpc/error.h>
+#include <jeffpc/mem.h>
+#include <jeffpc/synch.h>
+#include <jeffpc/types.h>
+
+/*
+ * Readers follow the bucket and next pointers with acquire loads, and
+ * writers publish new entries with release stores.  An entry is never
+ * modified after it becomes visible, except for its next pointer when the
+ * entry after it gets unlinked.  Unlinked entries still point to the rest
+ * of the chain, so a reader standing on one can continue its walk.
+ *
+ * Each lock protects all the buckets whose index is congruent to the
+ * lock's index modulo NLOCKS.  Since there are always at least as many
+ * buckets as locks, that stays true when the table grows.
+ */
+
+#define MIN_BUCKETS	64
+#define NLOCKS		64
+
+STATIC_ASSERT(MIN_BUCKETS >= NLOCKS);
+
+struct entry {
+	struct entry *next;
+	uint32_t hash;
+	void *item;
+	void (*release)(void *);
+	struct epoch_entry epoch;
+};
+
+struct table {
+	size_t nbuckets;		/* always a power of 2 */
+	struct epoch_entry epoch;
+	struct entry *buckets[];
+};
+
+struct bucket_lock {
+	struct lock lock;
+} __attribute__((aligned(64)));
+
+struct chashtab {
+	/* used by readers, only ever changed by resize */
+	struct table *table;
+	uint32_t (*hash)(const void *);
+	int (*cmp)(const void *, const void *);
+	void (*release)(void *);
+
+	/* used by writers only */
+	struct rwlock resize_lock __attribute__((aligned(64)));
+	atomic64_t nitems;
+	struct bucket_lock locks[NLOCKS];
+};
+
+static LOCK_CLASS(chashtab_resize_lc);
+static LOCK_CLASS(chashtab_bucket_lc);
+
+static struct table *alloc_table(size_t nbuckets)
+{
+	struct table *table;
+	size_t i;
+
+	table = malloc(sizeof(struct table) +
+		       nbuckets * sizeof(struct entry *));
+	if (!table)
+		return NULL;
+
+	table->nbuckets = nbuckets;
+
+	for (i = 0; i < nbuckets; i++)
+		table->buckets[i] = NULL;
+
+	return table;
+}
+
+/* frees the entries, but does not release the items */
+static void free_table(struct table *table)
+{
+	size_t i;
+
+	for (i = 0; i < table->nbuckets; i++) {
+		struct entry *entry;
+		struct entry *next;
+
+		for (entry = table->buckets[i]; entry; entry = next) {
+			next = entry->next;
+
+			free(entry);
+		}
+	}
+
+	free(table);
+}
+
+static void free_table_epoch(struct epoch_entry *epoch)
+{
+	free_table(container_of(epoch, struct table, epoch));
+}
+
+static void free_entry_epoch(struct epoch_entry *epoch)
+{
+	struct entry *entry = container_of(epoch, struct entry, epoch);
+
+	if (entry->release)
+		entry->release(entry->item);
+
+	free(entry);
+}
+
+struct chashtab *chashtab_alloc(uint32_t (*hash)(const void *),
+				int (*cmp)(const void *, const void *),
+				void (*release)(void *))
+{
+	struct chashtab *tab;
+	size_t i;
+
+	if (posix_memalign((void **) &tab, 64, sizeof(struct chashtab)))
+		return ERR_PTR(-ENOMEM);
+
+	tab->table = alloc_table(MIN_BUCKETS);
+	if (!tab->table) {
+		free(tab);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	tab->hash = hash;
+	tab->cmp = cmp;
+	tab->release = release;
+
+	RWINIT(&tab->resize_lock, &chashtab_resize_lc);
+	atomic_set(&tab->nitems, 0);
+
+	for (i = 0; i < NLOCKS; i++)
+		MXINIT(&tab->locks[i].lock, &chashtab_bucket_lc);
+
+	return tab;
+}
+
+void chashtab_free(struct chashtab *tab)
+{
+	struct table *table;
+	size_t i;
+
+	if (!tab)
+		return;
+
+	/* run this thread's pending removals and resizes */
+	epoch_synchronize();
+
+	table = tab->table;
+
+	for (i = 0; i < table->nbuckets; i++) {
+		struct entry *entry;
+
+		for (entry = table->buckets[i]; entry; entry = entry->next)
+			if (entry->release)
+				entry->release(entry->item);
+	}
+
+	free_table(table);
+
+	for (i = 0; i < NLOCKS; i++)
+		MXDESTROY(&tab->locks[i].lock);
+
+	RWDESTROY(&tab->resize_lock);
+
+	free(tab);
+}
+
+size_t chashtab_numnodes(struct chashtab *tab)
+{
+	return atomic_read(&tab->nitems);
+}
+
+static inline struct lock *get_lock(struct chashtab *tab, uint32_t hash)
+{
+	return &tab->locks[hash & (NLOCKS - 1)].lock;
+}
+
+static inline struct entry **get_bucket(struct table *table, uint32_t hash)
+{
+	return &table->buckets[hash & (table->nbuckets - 1)];
+}
+
+static struct entry *lookup(struct chashtab *tab, struct entry **bucket,
+			    const void *key, uint32_t hash)
+{
+	struct entry *entry;
+
+	for (entry = __atomic_load_n(bucket, __ATOMIC_ACQUIRE);
+	     entry;
+	     entry = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE))
+		if ((entry->hash == hash) && !tab->cmp(key, entry->item))
+			return entry;
+
+	return NULL;
+}
+
+void *chashtab_find(struct chashtab *tab, const void *key)
+{
+	const uint32_t hash = tab->hash(key);
+	struct table *table;
+	struct entry *entry;
+
+	table = __atomic_load_n(&tab->table, __ATOMIC_ACQUIRE);
+
+	entry = lookup(tab, get_bucket(table, hash), key, hash);
+
+	return entry ? entry->item : NULL;
+}
+
+/*
+ * Build a copy of the table with twice as many buckets, and switch the
+ * readers over to it.  Readers still walking the old table see the same
+ * items, so it is freed only once they are done.
+ */
+static void grow(struct chashtab *tab)
+{
+	struct table *old;
+	struct table *new;
+	size_t i;
+
+	RWLOCK(&tab->resize_lock, true);
+
+	old = tab->table;
+
+	/* someone else may have beaten us to it */
+	if (atomic_read(&tab->nitems) <= old->nbuckets)
+		goto out;
+
+	new = alloc_table(old->nbuckets * 2);
+	if (!new)
+		goto out; /* try again next time */
+
+	for (i = 0; i < old->nbuckets; i++) {
+		struct entry *entry;
+
+		for (entry = old->buckets[i]; entry; entry = entry->next) {
+			struct entry **bucket;
+			struct entry *copy;
+
+			copy = malloc(sizeof(struct entry));
+			if (!copy) {
+				free_table(new);
+				goto out;
+			}
+
+			bucket = get_bucket(new, entry->hash);
+
+			*copy = *entry;
+			copy->next = *bucket;
+			*bucket = copy;
+		}
+	}
+
+	__atomic_store_n(&tab->table, new, __ATOMIC_RELEASE);
+
+	RWUNLOCK(&tab->resize_lock);
+
+	/*
+	 * Deferring may run other callbacks, which may in turn insert into
+	 * or remove from this table.  So, we must not hold any locks.
+	 */
+	epoch_defer(&old->epoch, free_table_epoch);
+
+	return;
+
+out:
+	RWUNLOCK(&tab->resize_lock);
+}
+
+void *chashtab_insert(struct chashtab *tab, void *item)
+{
+	const uint32_t hash = tab->hash(item);
+	struct lock *lock = get_lock(tab, hash);
+	struct entry **bucket;
+	struct entry *entry;
+	struct entry *old;
+	void *dup = NULL;
+	bool need_grow;
+
+	/* allocate before taking any locks */
+	entry = malloc(sizeof(struct entry));
+	if (!entry)
+		return ERR_PTR(-ENOMEM);
+
+	RWLOCK(&tab->resize_lock, false);
+	MXLOCK(lock);
+
+	bucket = get_bucket(tab->table, hash);
+
+	old = lookup(tab, bucket, item, hash);
+	if (!old) {
+		entry->next = *bucket;
+		entry->hash = hash;
+		entry->item = item;
+		entry->release = tab->release;
+
+		__atomic_store_n(bucket, entry, __ATOMIC_RELEASE);
+
+		need_grow = atomic_inc(&tab->nitems) > tab->table->nbuckets;
+	} else {
+		/* the entry may be removed & freed once we unlock */
+		dup = old->item;
+	}
+
+	MXUNLOCK(lock);
+	RWUNLOCK(&tab->resize_lock);
+
+	if (old) {
+		free(entry);
+		return dup;
+	}
+
+	if (need_grow)
+		grow(tab);
+
+	return NULL;
+}
+
+int chashtab_remove(struct chashtab *tab, const void *key)
+{
+	const uint32_t hash = tab->hash(key);
+	struct lock *lock = get_lock(tab, hash);
+	struct entry **pentry;
+	struct entry *entry;
+
+	RWLOCK(&tab->resize_lock, false);
+	MXLOCK(lock);
+
+	for (pentry = get_bucket(tab->table, hash);
+	     (entry = *pentry);
+	     pentry = &entry->next)
+		if ((entry->hash == hash) && !tab->cmp(key, entry->item))
+			break;
+
+	if (entry) {
+		/* the entry keeps pointing to the rest of the chain */
+		__atomic_store_n(pentry, entry->next, __ATOMIC_RELEASE);
+
+		atomic_dec(&tab->nitems);
+	}
+
+	MXUNLOCK(lock);
+	RWUNLOCK(&tab->resize_lock);
+
+	if (!entry)
+		return -ENOENT;
+
+	epoch_defer(&entry->epoch, free_entry_epoch);
+
+	return 0;
+}
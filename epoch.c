@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <sched.h>
+#include <pthread.h>
+
+#include <jeffpc/epoch.h>
+#include <jeffpc/error.h>
+#include <jeffpc/list.h>
+
+/*
+ * There is a global epoch counter, and every thread that ever entered a
+ * read section has a record on the global list of threads.  While in a
+ * read section, the record holds the global epoch observed on entry.  The
+ * global epoch advances only once every thread in a read section observed
+ * the current epoch.  Therefore, once the epoch advanced twice since an
+ * object was deferred, no reader can still have a reference to it.
+ *
+ * The records are cache line aligned so that readers only ever write to
+ * cache lines that no other thread writes to.
+ *
+ * Deferred entries go on the deferring thread's own limbo list without
+ * any locking.  Only every BATCH deferrals does the thread take the global
+ * lock to try to advance the epoch, and then it runs whichever of its
+ * entries became safe.  When a thread exits, its remaining entries move
+ * to the global orphan list.
+ */
+
+#define ACTIVE		1ull
+#define BATCH		64
+
+struct epoch_thread {
+	uint64_t state;		/* (epoch << 1) | ACTIVE, or 0 */
+	unsigned int depth;
+	bool registered;
+	struct list_node node;
+
+	/* deferred entries, oldest first */
+	struct epoch_entry *limbo;
+	struct epoch_entry **limbo_tail;
+	unsigned int ndeferred;	/* since the last poll */
+} __attribute__((aligned(64)));
+
+static __thread struct epoch_thread self;
+
+/* the lock protects everything below, and global epoch updates */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t global_epoch;
+static struct list_node threads = { &threads, &threads };
+
+/* entries left behind by exited threads, in no particular order */
+static struct epoch_entry *orphans;
+static struct epoch_entry **orphans_tail = &orphans;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+
+static void reclaim(struct epoch_thread *thread);
+
+static void thread_fini(void *arg)
+{
+	struct epoch_thread *thread = arg;
+
+	ASSERT0(thread->depth);
+
+	/* run what we can, the callbacks may defer more */
+	reclaim(thread);
+
+	VERIFY0(pthread_mutex_lock(&lock));
+	if (thread->limbo) {
+		*orphans_tail = thread->limbo;
+		orphans_tail = thread->limbo_tail;
+	}
+	slist_remove(&thread->node);
+	VERIFY0(pthread_mutex_unlock(&lock));
+
+	thread->limbo = NULL;
+	thread->limbo_tail = &thread->limbo;
+	thread->registered = false;
+}
+
+static void key_init(void)
+{
+	VERIFY0(pthread_key_create(&key, thread_fini));
+}
+
+static void register_thread(void)
+{
+	VERIFY0(pthread_once(&key_once, key_init));
+	VERIFY0(pthread_setspecific(key, &self));
+
+	self.limbo = NULL;
+	self.limbo_tail = &self.limbo;
+	self.ndeferred = 0;
+
+	VERIFY0(pthread_mutex_lock(&lock));
+	slist_insert_tail(&threads, &self.node);
+	VERIFY0(pthread_mutex_unlock(&lock));
+
+	self.registered = true;
+}
+
+void epoch_enter(void)
+{
+	uint64_t epoch;
+
+	if (self.depth++)
+		return;
+
+	if (!self.registered)
+		register_thread();
+
+	/*
+	 * If the epoch advanced before our record became visible, the
+	 * thread advancing it did not wait for us and objects deferred in
+	 * the epoch we observed may be freed at any time.  So, try again.
+	 */
+	do {
+		epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+
+		__atomic_store_n(&self.state, (epoch << 1) | ACTIVE,
+				 __ATOMIC_SEQ_CST);
+	} while (__atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST) != epoch);
+}
+
+void epoch_exit(void)
+{
+	ASSERT3U(self.depth, >, 0);
+
+	if (--self.depth)
+		return;
+
+	__atomic_store_n(&self.state, 0, __ATOMIC_RELEASE);
+}
+
+/* must be called with the lock held */
+static bool try_advance(void)
+{
+	const uint64_t cur = (global_epoch << 1) | ACTIVE;
+	struct epoch_thread *thread;
+
+	slist_for_each_entry(thread, &threads, node) {
+		uint64_t state;
+
+		state = __atomic_load_n(&thread->state, __ATOMIC_SEQ_CST);
+		if (state && (state != cur))
+			return false;
+	}
+
+	__atomic_store_n(&global_epoch, global_epoch + 1, __ATOMIC_SEQ_CST);
+
+	return true;
+}
+
+/* detach all entries on the list that are safe to run in this epoch */
+static struct epoch_entry *collect(struct epoch_entry **list,
+				   struct epoch_entry ***tail,
+				   uint64_t epoch)
+{
+	struct epoch_entry *done = NULL;
+	struct epoch_entry **done_tail = &done;
+	struct epoch_entry **cur;
+
+	for (cur = list; *cur; ) {
+		struct epoch_entry *entry = *cur;
+
+		if ((entry->epoch + 2) > epoch) {
+			cur = &entry->next;
+			continue;
+		}
+
+		*cur = entry->next;
+		*done_tail = entry;
+		done_tail = &entry->next;
+	}
+
+	*done_tail = NULL;
+	*tail = cur;
+
+	return done;
+}
+
+static void run(struct epoch_entry *entry)
+{
+	struct epoch_entry *next;
+
+	for (; entry; entry = next) {
+		next = entry->next;
+
+		entry->fxn(entry);
+	}
+}
+
+static void reclaim(struct epoch_thread *thread)
+{
+	struct epoch_entry *done_orphans;
+	struct epoch_entry *done;
+	uint64_t epoch;
+
+	VERIFY0(pthread_mutex_lock(&lock));
+	try_advance();
+
+	epoch = global_epoch;
+
+	done_orphans = collect(&orphans, &orphans_tail, epoch);
+	VERIFY0(pthread_mutex_unlock(&lock));
+
+	done = collect(&thread->limbo, &thread->limbo_tail, epoch);
+	thread->ndeferred = 0;
+
+	run(done);
+	run(done_orphans);
+}
+
+void epoch_defer(struct epoch_entry *entry,
+		 void (*fxn)(struct epoch_entry *))
+{
+	if (!self.registered)
+		register_thread();
+
+	entry->next = NULL;
+	entry->epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+	entry->fxn = fxn;
+
+	*self.limbo_tail = entry;
+	self.limbo_tail = &entry->next;
+
+	if (++self.ndeferred >= BATCH)
+		reclaim(&self);
+}
+
+void epoch_synchronize(void)
+{
+	struct epoch_entry *done_orphans;
+	struct epoch_entry *done;
+	uint64_t target;
+	uint64_t epoch;
+
+	ASSERT0(self.depth);
+
+	VERIFY0(pthread_mutex_lock(&lock));
+	target = global_epoch + 2;
+
+	while (global_epoch < target) {
+		if (try_advance())
+			continue;
+
+		/* some reader is behind, give it a chance to leave */
+		VERIFY0(pthread_mutex_unlock(&lock));
+		sched_yield();
+		VERIFY0(pthread_mutex_lock(&lock));
+	}
+
+	epoch = global_epoch;
+
+	done_orphans = collect(&orphans, &orphans_tail, epoch);
+	VERIFY0(pthread_mutex_unlock(&lock));
+
+	if (self.registered) {
+		done = collect(&self.limbo, &self.limbo_tail, epoch);
+		self.ndeferred = 0;
+	} else {
+		done = NULL;
+	}
+
+	run(done);
+	run(done_orphans);
+}
@@ -194,6 +194,22 @@ static int filename_cmp(const void *va, const void *vb)
 	return 0;
 }
 
+static int fn_ctor(void *obj, void *priv)
+{
+	struct file_node *node = obj;
+
+	MXINIT(&node->lock, &file_node_lc);
+
+	return 0;
+}
+
+static void fn_dtor(void *obj, void *priv)
+{
+	struct file_node *node = obj;
+
+	MXDESTROY(&node->lock);
+}
+
 int file_cache_init(void)
 {
 	int ret;
@@ -203,8 +219,9 @@ int file_cache_init(void)
 	rb_create(&file_cache, filename_cmp, sizeof(struct file_node),
 		  offsetof(struct file_node, node));
 
-	file_node_cache = mem_cache_create("file-node-cache",
-					   sizeof(struct file_node), 0);
+	file_node_cache = mem_cache_create_ext("file-node-cache",
+					       sizeof(struct file_node), 0,
+					       fn_ctor, fn_dtor, NULL);
 	if (IS_ERR(file_node_cache)) {
 		ret = PTR_ERR(file_node_cache);
 		goto err;
@@ -252,7 +269,6 @@ static struct file_node *fn_alloc(const char *name)
 	node->needs_reload = true;
 	node->cache_rev = atomic_inc(&current_revision);
 
-	MXINIT(&node->lock, &file_node_lc);
 	refcnt_init(&node->refcnt, 1);
 
 	return node;
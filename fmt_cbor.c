@@ -24,6 +24,8 @@
 #include <jeffpc/cbor.h>
 #include <jeffpc/nvl.h>
 
+#include "val_impl.h"
+
 enum major_type {
 	CMT_UINT  = 0,
 	CMT_NINT  = 1,
@@ -244,21 +246,20 @@ int cbor_pack_map_end(struct buffer *buffer, size_t npairs)
 
 int cbor_pack_map_val(struct buffer *buffer, struct val *val)
 {
-	struct rb_tree *tree = &val->_set_nvl.values;
-	struct nvpair *cur;
+	const struct nvpair *cur;
 	size_t npairs;
 	int ret;
 
 	if (val->type != VT_NVL)
 		return -EINVAL;
 
-	npairs = rb_numnodes(tree);
+	npairs = __nvl_numpairs(val);
 
 	ret = cbor_pack_map_start(buffer, npairs);
 	if (ret)
 		return ret;
 
-	rb_for_each(tree, cur) {
+	nvl_for_each(cur, val_cast_to_nvl(val)) {
 		ret = cbor_pack_str(buffer, cur->name);
 		if (ret)
 			return ret;
@@ -366,7 +367,8 @@ int cbor_peek_type(struct buffer *buffer, enum val_type *type)
  * unpack
  */
 
-static struct val *unpack_cbor_val(struct buffer *buffer);
+static struct val *unpack_cbor_val(struct buffer *buffer,
+				   struct mem_arena *arena);
 
 static int read_cbor_type(struct buffer *buffer, enum major_type *type,
 			  uint8_t *extra)
@@ -788,24 +790,57 @@ static struct val *unpack_cbor_null(struct buffer *buffer)
 	return ret ? ERR_PTR(ret) : VAL_ALLOC_NULL();
 }
 
-static struct val *unpack_cbor_uint(struct buffer *buffer)
+static struct val *unpack_cbor_uint(struct buffer *buffer,
+				    struct mem_arena *arena)
 {
 	uint64_t tmp;
 	int ret;
 
 	ret = cbor_unpack_uint(buffer, &tmp);
 
-	return ret ? ERR_PTR(ret) : val_alloc_int(tmp);
+	return ret ? ERR_PTR(ret) : __val_alloc_int_arena(arena, tmp);
 }
 
-static struct val *unpack_cbor_str(struct buffer *buffer)
+static struct val *unpack_cbor_str(struct buffer *buffer,
+				   struct mem_arena *arena)
 {
-	struct str *str;
+	uint64_t len;
+	struct buffer tmp;
+	struct val *val;
+	ssize_t sret;
 	int ret;
 
-	ret = cbor_unpack_str(buffer, &str);
+	if (!arena) {
+		struct str *str;
+
+		ret = cbor_unpack_str(buffer, &str);
+
+		return ret ? ERR_PTR(ret) : str_cast_to_val(str);
+	}
+
+	/* copy the string straight from the buffer into the arena */
+	buffer_init_static(&tmp, buffer_data_current(buffer),
+			   buffer_remain(buffer), buffer_remain(buffer), false);
+
+	ret = unpack_cbor_int(&tmp, CMT_TEXT, &len);
+	if (ret)
+		return ERR_PTR(ret);
+
+	if (len > buffer_remain(&tmp))
+		return ERR_PTR(-EILSEQ);
+
+	val = __strsym_dup_len_arena(arena, buffer_data_current(&tmp), len,
+				     VT_STR);
+	if (IS_ERR(val))
+		return val;
+
+	sret = buffer_seek(&tmp, len, SEEK_CUR);
+	if (sret < 0)
+		return ERR_PTR(sret);
 
-	return ret ? ERR_PTR(ret) : str_cast_to_val(str);
+	ret = sync_buffers(buffer, &tmp);
+
+	return ret ? ERR_PTR(ret) : val;
 }
 
 static struct val *unpack_cbor_bool(struct buffer *buffer)
@@ -829,11 +864,13 @@ static struct val *unpack_cbor_blob(struct buffer *buffer)
 	return ret ? ERR_PTR(ret) : val_alloc_blob(data, size);
 }
 
-static struct val *unpack_cbor_array(struct buffer *buffer)
+static struct val *unpack_cbor_array(struct buffer *buffer,
+				     struct mem_arena *arena)
 {
 	bool end_required;
 	struct val **arr;
 	uint64_t nelem;
+	bool heap;
 	int ret;
 
 	ret = cbor_unpack_array_start(buffer, &nelem, &end_required);
@@ -841,6 +878,7 @@ static struct val *unpack_cbor_array(struct buffer *buffer)
 		return ERR_PTR(ret);
 
 	arr = NULL;
+	heap = true;
 
 	if (end_required) {
 		/* indef */
@@ -856,7 +894,7 @@ static struct val *unpack_cbor_array(struct buffer *buffer)
 			if (ret != -EILSEQ)
 				goto err; /* error */
 
-			elem = unpack_cbor_val(buffer);
+			elem = unpack_cbor_val(buffer, arena);
 			if (IS_ERR(elem)) {
 				ret = PTR_ERR(elem);
 				goto err;
@@ -873,21 +911,46 @@ static struct val *unpack_cbor_array(struct buffer *buffer)
 
 			arr[nelem++] = elem;
 		}
+
+		if (arena) {
+			struct val **tmparr;
+
+			/* move the array into the arena */
+			tmparr = mem_arena_alloc(arena,
+						 nelem * sizeof(struct val *));
+			if (!tmparr) {
+				ret = -ENOMEM;
+				goto err;
+			}
+
+			memcpy(tmparr, arr, nelem * sizeof(struct val *));
+			free(arr);
+
+			arr = tmparr;
+			heap = false;
+		}
 	} else {
 		/* def */
 		size_t i;
 
-		if (nelem > SIZE_MAX)
+		if (nelem > (SIZE_MAX / sizeof(struct val *)))
 			return ERR_PTR(-ENOMEM);
 
-		arr = mem_recallocarray(NULL, 0, nelem, sizeof(struct val *));
+		if (arena) {
+			arr = mem_arena_alloc(arena,
+					      nelem * sizeof(struct val *));
+			heap = false;
+		} else {
+			arr = mem_recallocarray(NULL, 0, nelem,
+						sizeof(struct val *));
+		}
 		if (!arr)
 			return ERR_PTR(-ENOMEM);
 
 		for (i = 0; i < nelem; i++) {
 			struct val *elem;
 
-			elem = unpack_cbor_val(buffer);
+			elem = unpack_cbor_val(buffer, arena);
 			if (IS_ERR(elem)) {
 				ret = PTR_ERR(elem);
 				goto err;
@@ -901,44 +964,101 @@ static struct val *unpack_cbor_array(struct buffer *buffer)
 	if (ret)
 		goto err;
 
-	return val_alloc_array(arr, nelem);
+	return __val_alloc_array_arena(arena, arr, nelem);
 
 err:
-	if (arr) {
+	/* arena allocated values go away with the arena */
+	if (arr && !arena) {
 		size_t i;
 
 		for (i = 0; i < nelem; i++)
 			val_putref(arr[i]);
+	}
 
+	if (heap)
 		free(arr);
-	}
 
 	return ERR_PTR(ret);
 }
 
-static int __unpack_cbor_pair(struct buffer *buffer, struct nvlist *nvl)
+static int __unpack_cbor_pair(struct buffer *buffer, struct mem_arena *arena,
+			      struct nvlist *nvl)
 {
-	struct nvpair pair;
 	struct val *name;
 	struct val *value;
 
-	name = unpack_cbor_str(buffer);
+	name = unpack_cbor_str(buffer, arena);
 	if (IS_ERR(name))
 		return PTR_ERR(name);
 
-	value = unpack_cbor_val(buffer);
+	value = unpack_cbor_val(buffer, arena);
 	if (IS_ERR(value)) {
 		val_putref(name);
 		return PTR_ERR(value);
 	}
 
-	pair.name = val_cast_to_str(name);
-	pair.value = value;
+	return __nvl_set_arena(arena, nvl, val_cast_to_str(name), value);
+}
+
+/*
+ * Deterministically encoded maps have their keys sorted, which lets us
+ * build the nvlist in one go instead of one pair at a time.
+ */
+static int unpack_cbor_pairs_bulk(struct buffer *buffer,
+				  struct mem_arena *arena,
+				  struct nvlist *nvl, size_t npairs)
+{
+	struct str **names;
+	struct val **vals;
+	size_t i;
+	int ret;
+
+	names = mem_reallocarray(NULL, npairs, sizeof(struct str *));
+	vals = mem_reallocarray(NULL, npairs, sizeof(struct val *));
+	if (!names || !vals) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < npairs; i++) {
+		struct val *name;
+		struct val *value;
+
+		name = unpack_cbor_str(buffer, arena);
+		if (IS_ERR(name)) {
+			ret = PTR_ERR(name);
+			goto err;
+		}
+
+		value = unpack_cbor_val(buffer, arena);
+		if (IS_ERR(value)) {
+			val_putref(name);
+			ret = PTR_ERR(value);
+			goto err;
+		}
+
+		names[i] = val_cast_to_str(name);
+		vals[i] = value;
+	}
+
+	ret = __nvl_set_bulk_arena(arena, nvl, names, vals, npairs);
+	goto out;
+
+err:
+	while (i--) {
+		str_putref(names[i]);
+		val_putref(vals[i]);
+	}
+
+out:
+	free(names);
+	free(vals);
 
-	return nvl_set_pair(nvl, &pair);
+	return ret;
 }
 
-static struct val *unpack_cbor_nvl(struct buffer *buffer)
+static struct val *unpack_cbor_nvl(struct buffer *buffer,
+				   struct mem_arena *arena)
 {
 	struct nvlist *nvl;
 	bool end_required;
@@ -949,7 +1069,7 @@ static struct val *unpack_cbor_nvl(struct buffer *buffer)
 	if (ret)
 		return ERR_PTR(ret);
 
-	nvl = nvl_alloc();
+	nvl = val_cast_to_nvl(__val_alloc_nvl_arena(arena));
 	if (IS_ERR(nvl))
 		return ERR_CAST(nvl);
 
@@ -962,7 +1082,7 @@ static struct val *unpack_cbor_nvl(struct buffer *buffer)
 			if (ret != -EILSEQ)
 				goto err; /* error */
 
-			ret = __unpack_cbor_pair(buffer, nvl);
+			ret = __unpack_cbor_pair(buffer, arena, nvl);
 			if (ret)
 				goto err;
 		}
@@ -975,10 +1095,24 @@ static struct val *unpack_cbor_nvl(struct buffer *buffer)
 			goto err;
 		}
 
-		for (i = 0; i < npairs; i++) {
-			ret = __unpack_cbor_pair(buffer, nvl);
+		/*
+		 * Small maps go straight into the nvlist.  So do maps that
+		 * claim more pairs than the buffer could possibly hold
+		 * (every pair takes at least two bytes) - we'd rather fail
+		 * parsing than allocate based on a bogus count.
+		 */
+		if ((npairs > NVL_SMALL_PAIRS) &&
+		    (npairs <= (buffer_remain(buffer) / 2))) {
+			ret = unpack_cbor_pairs_bulk(buffer, arena, nvl,
+						     npairs);
 			if (ret)
 				goto err;
+		} else {
+			for (i = 0; i < npairs; i++) {
+				ret = __unpack_cbor_pair(buffer, arena, nvl);
+				if (ret)
+					goto err;
+			}
 		}
 	}
 
@@ -994,7 +1128,8 @@ err:
 	return ERR_PTR(ret);
 }
 
-static struct val *unpack_cbor_val(struct buffer *buffer)
+static struct val *unpack_cbor_val(struct buffer *buffer,
+				   struct mem_arena *arena)
 {
 	enum val_type type;
 	int ret;
@@ -1007,9 +1142,9 @@ static struct val *unpack_cbor_val(struct buffer *buffer)
 		case VT_NULL:
 			return unpack_cbor_null(buffer);
 		case VT_INT:
-			return unpack_cbor_uint(buffer);
+			return unpack_cbor_uint(buffer, arena);
 		case VT_STR:
-			return unpack_cbor_str(buffer);
+			return unpack_cbor_str(buffer, arena);
 		case VT_SYM:
 			return ERR_PTR(-ENOTSUP);
 		case VT_BOOL:
@@ -1021,15 +1156,16 @@ static struct val *unpack_cbor_val(struct buffer *buffer)
 		case VT_BLOB:
 			return unpack_cbor_blob(buffer);
 		case VT_ARRAY:
-			return unpack_cbor_array(buffer);
+			return unpack_cbor_array(buffer, arena);
 		case VT_NVL:
-			return unpack_cbor_nvl(buffer);
+			return unpack_cbor_nvl(buffer, arena);
 	}
 
 	return ERR_PTR(-ENOTSUP);
 }
 
-struct val *cbor_unpack_val(struct buffer *buffer)
+static struct val *__cbor_unpack_val(struct buffer *buffer,
+				     struct mem_arena *arena)
 {
 	struct buffer tmp;
 	struct val *val;
@@ -1038,7 +1174,7 @@ struct val *cbor_unpack_val(struct buffer *buffer)
 	buffer_init_static(&tmp, buffer_data_current(buffer),
 			   buffer_remain(buffer), buffer_remain(buffer), false);
 
-	val = unpack_cbor_val(&tmp);
+	val = unpack_cbor_val(&tmp, arena);
 	if (IS_ERR(val))
 		return val;
 
@@ -1050,3 +1186,19 @@ struct val *cbor_unpack_val(struct buffer *buffer)
 
 	return ERR_PTR(ret);
 }
+
+struct val *cbor_unpack_val(struct buffer *buffer)
+{
+	return __cbor_unpack_val(buffer, NULL);
+}
+
+struct val *cbor_unpack_val_arena(struct buffer *buffer)
+{
+	struct mem_arena *arena;
+
+	arena = mem_arena_create();
+	if (IS_ERR(arena))
+		return ERR_CAST(arena);
+
+	return __val_arena_root(arena, __cbor_unpack_val(buffer, arena));
+}
@@ -93,33 +93,45 @@ static int __escape_ctrl_char(struct buffer *buffer, uint8_t c)
 
 int json_pack_cstr_len(struct buffer *buffer, const char *str, size_t len)
 {
+	size_t start;
 	size_t i;
 	int ret;
 
 	if ((ret = buffer_append_c(buffer, '"')))
 		return ret;
 
-	/* append the string... escaped */
-	for (i = 0; i < len; i++) {
+	/*
+	 * Append the string... escaped.  Runs of characters that don't need
+	 * escaping are appended all at once.
+	 */
+	for (start = 0, i = 0; i < len; i++) {
 		uint8_t c = str[i];
 
+		if ((c > 0x1f) && (c != '"') && (c != '\\'))
+			continue; /* no escape necessary */
+
+		if ((ret = buffer_append(buffer, &str[start], i - start)))
+			return ret;
+
+		start = i + 1;
+
 		if (c <= 0x1f) {
 			/* control character, must be escaped */
 			ret = __escape_ctrl_char(buffer, c);
-		} else if ((c == '"') || (c == '\\')) {
+		} else {
 			/* quote or backslash */
 			char tmp[3] = { '\\', c, '\0' };
 
 			ret = buffer_append_cstr(buffer, tmp);
-		} else {
-			/* no escape necessary */
-			ret = buffer_append_c(buffer, c);
 		}
 
 		if (ret)
 			return ret;
 	}
 
+	if ((ret = buffer_append(buffer, &str[start], len - start)))
+		return ret;
+
 	if ((ret = buffer_append_c(buffer, '"')))
 		return ret;
 
@@ -202,8 +214,7 @@ int json_pack_map_end(struct buffer *buffer)
 
 int json_pack_map_val(struct buffer *buffer, struct val *val)
 {
-	struct rb_tree *tree = &val->_set_nvl.values;
-	struct nvpair *cur;
+	const struct nvpair *cur;
 	bool first;
 	int ret;
 
@@ -216,7 +227,7 @@ int json_pack_map_val(struct buffer *buffer, struct val *val)
 
 	first = true;
 
-	rb_for_each(tree, cur) {
+	nvl_for_each(cur, val_cast_to_nvl(val)) {
 		if (!first) {
 			ret = json_pack_map_pair_sep(buffer);
 			if (ret)
@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <jeffpc/hashtab.h>
+#include <jeffpc/error.h>
+#include <jeffpc/mem.h>
+#include <jeffpc/types.h>
+
+#define MIN_BUCKETS		16
+
+/*
+ * Each insertion moves the items from this many non-empty old buckets,
+ * visiting at most four times as many buckets in total.  Since the table
+ * doubles when the number of items reaches the number of old buckets,
+ * this is enough to finish rehashing long before the next resize.
+ */
+#define REHASH_STEP		4
+
+static inline void *node2obj(struct hashtab *tab, struct hashtab_node *node)
+{
+	return (void *)(((uintptr_t) node) - tab->node_off);
+}
+
+static inline struct hashtab_node *obj2node(struct hashtab *tab,
+					    const void *obj)
+{
+	return (struct hashtab_node *)(((uintptr_t) obj) + tab->node_off);
+}
+
+static struct hashtab_node **alloc_buckets(size_t nbuckets)
+{
+	return mem_recallocarray(NULL, 0, nbuckets,
+				 sizeof(struct hashtab_node *));
+}
+
+int hashtab_create(struct hashtab *tab,
+		   uint32_t (*hash)(const void *),
+		   int (*cmp)(const void *, const void *),
+		   size_t size, size_t off)
+{
+	ASSERT3U(off + sizeof(struct hashtab_node), <=, size);
+
+	tab->buckets = alloc_buckets(MIN_BUCKETS);
+	if (!tab->buckets)
+		return -ENOMEM;
+
+	tab->hash = hash;
+	tab->cmp = cmp;
+	tab->node_size = size;
+	tab->node_off = off;
+	tab->num_nodes = 0;
+	tab->nbuckets = MIN_BUCKETS;
+	tab->old = NULL;
+	tab->old_nbuckets = 0;
+	tab->rehash_idx = 0;
+	tab->nresizes = 0;
+
+	return 0;
+}
+
+void hashtab_destroy(struct hashtab *tab)
+{
+	free(tab->buckets);
+	free(tab->old);
+
+	memset(tab, 0, sizeof(struct hashtab));
+}
+
+/* the bucket a hash maps to, taking rehashing into account */
+static struct hashtab_node **get_bucket(struct hashtab *tab, uint32_t hash)
+{
+	if (tab->old) {
+		size_t idx = hash & (tab->old_nbuckets - 1);
+
+		if (idx >= tab->rehash_idx)
+			return &tab->old[idx];
+	}
+
+	return &tab->buckets[hash & (tab->nbuckets - 1)];
+}
+
+/*
+ * Rehashing
+ */
+
+/* move the contents of the next old bucket, returns true if it had any */
+static bool rehash_bucket(struct hashtab *tab)
+{
+	struct hashtab_node *node;
+	struct hashtab_node *next;
+	bool moved = false;
+
+	for (node = tab->old[tab->rehash_idx]; node; node = next) {
+		struct hashtab_node **bucket;
+
+		next = node->next;
+
+		bucket = &tab->buckets[node->hash & (tab->nbuckets - 1)];
+		node->next = *bucket;
+		*bucket = node;
+
+		moved = true;
+	}
+
+	tab->old[tab->rehash_idx++] = NULL;
+
+	if (tab->rehash_idx == tab->old_nbuckets) {
+		free(tab->old);
+		tab->old = NULL;
+		tab->old_nbuckets = 0;
+		tab->rehash_idx = 0;
+	}
+
+	return moved;
+}
+
+static void rehash_step(struct hashtab *tab)
+{
+	size_t visited;
+	size_t moved;
+
+	for (visited = 0, moved = 0;
+	     tab->old && (moved < REHASH_STEP) &&
+	     (visited < (REHASH_STEP * 4));
+	     visited++)
+		moved += rehash_bucket(tab);
+}
+
+static void rehash_all(struct hashtab *tab)
+{
+	while (tab->old)
+		rehash_bucket(tab);
+}
+
+static void maybe_grow(struct hashtab *tab)
+{
+	struct hashtab_node **buckets;
+
+	if (tab->num_nodes < tab->nbuckets)
+		return;
+
+	/* this should never happen, but just in case... */
+	rehash_all(tab);
+
+	buckets = alloc_buckets(tab->nbuckets * 2);
+	if (!buckets)
+		return; /* try again next time */
+
+	tab->old = tab->buckets;
+	tab->old_nbuckets = tab->nbuckets;
+	tab->rehash_idx = 0;
+	tab->buckets = buckets;
+	tab->nbuckets *= 2;
+	tab->nresizes++;
+}
+
+/*
+ * Lookup, insertion, and removal
+ */
+
+static struct hashtab_node **find_node(struct hashtab *tab, const void *key,
+				       uint32_t hash)
+{
+	struct hashtab_node **pnode;
+
+	for (pnode = get_bucket(tab, hash); *pnode; pnode = &(*pnode)->next) {
+		struct hashtab_node *node = *pnode;
+
+		if ((node->hash == hash) &&
+		    !tab->cmp(key, node2obj(tab, node)))
+			return pnode;
+	}
+
+	return NULL;
+}
+
+void *hashtab_find(struct hashtab *tab, const void *key)
+{
+	struct hashtab_node **pnode;
+
+	pnode = find_node(tab, key, tab->hash(key));
+	if (!pnode)
+		return NULL;
+
+	return node2obj(tab, *pnode);
+}
+
+void *hashtab_insert(struct hashtab *tab, void *item)
+{
+	struct hashtab_node *node = obj2node(tab, item);
+	struct hashtab_node **bucket;
+	struct hashtab_node **pnode;
+	uint32_t hash;
+
+	hash = tab->hash(item);
+
+	pnode = find_node(tab, item, hash);
+	if (pnode)
+		return node2obj(tab, *pnode);
+
+	if (tab->old)
+		rehash_step(tab);
+
+	maybe_grow(tab);
+
+	bucket = get_bucket(tab, hash);
+
+	node->hash = hash;
+	node->next = *bucket;
+	*bucket = node;
+
+	tab->num_nodes++;
+
+	return NULL;
+}
+
+void hashtab_add(struct hashtab *tab, void *item)
+{
+	void *orig;
+
+	orig = hashtab_insert(tab, item);
+	if (orig)
+		panic("%s(%p, %p) failed: table already contains desired key",
+		      __func__, tab, item);
+}
+
+void hashtab_remove(struct hashtab *tab, void *item)
+{
+	struct hashtab_node *node = obj2node(tab, item);
+	struct hashtab_node **pnode;
+
+	for (pnode = get_bucket(tab, node->hash); *pnode != node;
+	     pnode = &(*pnode)->next)
+		if (!*pnode)
+			panic("%s: table %p does not contain item %p",
+			      __func__, tab, item);
+
+	*pnode = node->next;
+	node->next = NULL;
+
+	tab->num_nodes--;
+}
+
+/*
+ * Iteration
+ *
+ * The old bucket array (if any) is visited first, followed by the current
+ * one.  The cookie holds the next node in the current chain so that the
+ * node just returned can be removed.
+ */
+
+void *hashtab_next(struct hashtab *tab, struct hashtab_cookie *cookie)
+{
+	struct hashtab_node *node = cookie->next;
+
+	while (!node) {
+		struct hashtab_node **buckets;
+		size_t nbuckets;
+
+		buckets = cookie->old ? tab->old : tab->buckets;
+		nbuckets = cookie->old ? tab->old_nbuckets : tab->nbuckets;
+
+		if (cookie->idx < nbuckets) {
+			node = buckets[cookie->idx++];
+			continue;
+		}
+
+		if (!cookie->old)
+			return NULL;
+
+		cookie->old = false;
+		cookie->idx = 0;
+	}
+
+	cookie->next = node->next;
+
+	return node2obj(tab, node);
+}
+
+void *hashtab_first(struct hashtab *tab, struct hashtab_cookie *cookie)
+{
+	cookie->next = NULL;
+	cookie->old = tab->old != NULL;
+	cookie->idx = cookie->old ? tab->rehash_idx : 0;
+
+	return hashtab_next(tab, cookie);
+}
+
+void *hashtab_destroy_nodes(struct hashtab *tab, struct hashtab_cookie *cookie)
+{
+	/* moving nodes around does not allocate */
+	rehash_all(tab);
+
+	for (; cookie->idx < tab->nbuckets; cookie->idx++) {
+		struct hashtab_node *node = tab->buckets[cookie->idx];
+
+		if (!node)
+			continue;
+
+		tab->buckets[cookie->idx] = node->next;
+		node->next = NULL;
+
+		tab->num_nodes--;
+
+		return node2obj(tab, node);
+	}
+
+	return NULL;
+}
+
+/*
+ * Statistics
+ */
+
+static void bucket_stats(struct hashtab_node **buckets, size_t start,
+			 size_t nbuckets, struct hashtab_stats *stats)
+{
+	size_t i;
+
+	for (i = start; i < nbuckets; i++) {
+		struct hashtab_node *node;
+		size_t len;
+
+		for (len = 0, node = buckets[i]; node; node = node->next)
+			len++;
+
+		if (len)
+			stats->used_buckets++;
+
+		stats->max_chain = MAX(stats->max_chain, len);
+	}
+}
+
+void hashtab_stats(struct hashtab *tab, struct hashtab_stats *stats)
+{
+	stats->num_nodes = tab->num_nodes;
+	stats->nbuckets = tab->nbuckets;
+	stats->old_nbuckets = tab->old_nbuckets;
+	stats->used_buckets = 0;
+	stats->max_chain = 0;
+	stats->nresizes = tab->nresizes;
+
+	if (tab->old)
+		bucket_stats(tab->old, tab->rehash_idx, tab->old_nbuckets,
+			     stats);
+
+	bucket_stats(tab->buckets, 0, tab->nbuckets, stats);
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __JEFFPC_AVL_H
+#define __JEFFPC_AVL_H
+
+#include <stdbool.h>
+
+#include <jeffpc/tree_private.h>
+
+struct avl_node {
+	struct tree_node node;
+};
+
+struct avl_tree {
+	struct tree_tree tree;
+};
+
+struct avl_cookie {
+	struct tree_cookie cookie;
+};
+
+#define avl_for_each(tree, pos) \
+	for (pos = avl_first(tree); pos; pos = avl_next(tree, pos))
+
+extern void avl_create(struct avl_tree *tree,
+		       int (*cmp)(const void *, const void *),
+		       size_t size, size_t off);
+extern void avl_destroy(struct avl_tree *tree);
+
+extern void avl_add(struct avl_tree *tree, void *item);
+extern void *avl_insert_here(struct avl_tree *tree, void *item,
+			     struct avl_cookie *cookie);
+#define avl_insert(tree, item)	avl_insert_here((tree), (item), NULL)
+extern void avl_remove(struct avl_tree *tree, void *item);
+
+static inline bool avl_is_empty(struct avl_tree *tree)
+{
+	return tree_is_empty(&tree->tree);
+}
+
+static inline size_t avl_numnodes(struct avl_tree *tree)
+{
+	return tree_numnodes(&tree->tree);
+}
+
+/*
+ * Search, iteration, and swapping are completely generic
+ */
+static inline void *avl_find(struct avl_tree *tree, const void *key,
+			     struct avl_cookie *cookie)
+{
+	return tree_find(&tree->tree, key, &cookie->cookie);
+}
+
+static inline void *avl_nearest_lt(struct avl_tree *tree,
+				   struct avl_cookie *cookie)
+{
+	return tree_nearest(&tree->tree, &cookie->cookie, false);
+}
+
+static inline void *avl_nearest_gt(struct avl_tree *tree,
+				   struct avl_cookie *cookie)
+{
+	return tree_nearest(&tree->tree, &cookie->cookie, true);
+}
+
+static inline void *avl_first(struct avl_tree *tree)
+{
+	return tree_first(&tree->tree);
+}
+
+static inline void *avl_last(struct avl_tree *tree)
+{
+	return tree_last(&tree->tree);
+}
+
+static inline void *avl_next(struct avl_tree *tree, void *item)
+{
+	return tree_next(&tree->tree, item);
+}
+
+static inline void *avl_prev(struct avl_tree *tree, void *item)
+{
+	return tree_prev(&tree->tree, item);
+}
+
+static inline void *avl_destroy_nodes(struct avl_tree *tree,
+				      struct avl_cookie *cookie)
+{
+	return tree_destroy_nodes(&tree->tree, &cookie->cookie);
+}
+
+static inline void avl_swap(struct avl_tree *tree1, struct avl_tree *tree2)
+{
+	tree_swap(&tree1->tree, &tree2->tree);
+}
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __JEFFPC_BTREE_H
+#define __JEFFPC_BTREE_H
+
+#include <stdbool.h>
+
+#include <jeffpc/int.h>
+
+/*
+ * An in-memory B-tree.
+ *
+ * Unlike the bst and rb trees, the B-tree is not intrusive - the items do
+ * not embed a node structure.  Instead, the tree keeps pointers to them in
+ * wide nodes sized to a handful of cache lines.  This means that inserting
+ * an item allocates memory and therefore can fail.  Otherwise, the
+ * interface mirrors the rb_* one.
+ *
+ * Since a comparison of a key with an item has to dereference the item,
+ * the tree can optionally be given a prefix function.  The prefix of each
+ * item is stored next to the item pointer and compared first, and the
+ * comparison function is only called when the prefixes are equal.  The
+ * prefix function must be consistent with the comparison function - that
+ * is, prefix(a) < prefix(b) must imply cmp(a, b) < 0.  For example, an
+ * integer key can be used as-is, and a string key can use its first 8
+ * bytes as a big-endian integer.
+ *
+ * Pointers to items stay valid (they are the caller's memory), but
+ * cookies are invalidated by any insertion or removal.
+ */
+
+struct btree_node;
+
+struct btree {
+	int (*cmp)(const void *, const void *);
+	uint64_t (*prefix)(const void *);
+	struct btree_node *root;
+	size_t num_items;
+};
+
+struct btree_cookie {
+	struct btree_node *node;
+	size_t idx;
+};
+
+#define btree_for_each(tree, cookie, pos) \
+	for (pos = btree_iter_first((tree), (cookie)); \
+	     pos; \
+	     pos = btree_iter_next((tree), (cookie)))
+
+extern void btree_create(struct btree *tree,
+			 int (*cmp)(const void *, const void *),
+			 uint64_t (*prefix)(const void *));
+extern void btree_destroy(struct btree *tree);
+
+/*
+ * Returns 0 on success or -ENOMEM.  Panics if the tree already contains the
+ * key.
+ */
+extern int btree_add(struct btree *tree, void *item);
+/*
+ * Returns NULL on success, the already present item with the same key, or
+ * ERR_PTR(-ENOMEM).
+ */
+extern void *btree_insert_here(struct btree *tree, void *item,
+			       struct btree_cookie *cookie);
+#define btree_insert(tree, item)	btree_insert_here((tree), (item), NULL)
+extern void btree_remove(struct btree *tree, void *item);
+
+static inline bool btree_is_empty(struct btree *tree)
+{
+	return tree->root == NULL;
+}
+
+static inline size_t btree_numnodes(struct btree *tree)
+{
+	return tree->num_items;
+}
+
+extern void *btree_find(struct btree *tree, const void *key,
+			struct btree_cookie *cookie);
+extern void *btree_nearest_lt(struct btree *tree, struct btree_cookie *cookie);
+extern void *btree_nearest_gt(struct btree *tree, struct btree_cookie *cookie);
+
+/*
+ * Cursor based iteration.  The cookie keeps track of the position of the
+ * returned item, so stepping to the next or previous item usually stays
+ * within the same leaf and never calls the comparison function.
+ */
+extern void *btree_iter_first(struct btree *tree,
+			      struct btree_cookie *cookie);
+extern void *btree_iter_last(struct btree *tree, struct btree_cookie *cookie);
+extern void *btree_iter_next(struct btree *tree, struct btree_cookie *cookie);
+extern void *btree_iter_prev(struct btree *tree, struct btree_cookie *cookie);
+
+/*
+ * Since the items do not point back into the tree, btree_next and
+ * btree_prev have to look up the passed in item first.  Prefer the cursor
+ * based functions above.
+ */
+extern void *btree_first(struct btree *tree);
+extern void *btree_last(struct btree *tree);
+extern void *btree_next(struct btree *tree, void *item);
+extern void *btree_prev(struct btree *tree, void *item);
+
+/*
+ * Returns the items one at a time, freeing the tree's nodes along the way.
+ * The cookie must be zeroed before the first call.
+ */
+extern void *btree_destroy_nodes(struct btree *tree,
+				 struct btree_cookie *cookie);
+
+static inline void btree_swap(struct btree *tree1, struct btree *tree2)
+{
+	struct btree tmp;
+
+	tmp = *tree1;
+	*tree1 = *tree2;
+	*tree2 = tmp;
+}
+
+#endif
@@ -135,7 +135,7 @@ static inline int buffer_append_str(struct buffer *buffer, const struct str *s)
 	if (!str)
 		return 0;
 
-	return buffer_append_cstr(buffer, str);
+	return buffer_append(buffer, str, str_len(s));
 }
 
 /* same as buffer_pread(), but it uses and updates current offset */
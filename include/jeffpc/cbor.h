@@ -120,4 +120,16 @@ extern int cbor_unpack_array_start(struct buffer *buffer, uint64_t *nelem,
 extern int cbor_unpack_array_end(struct buffer *buffer, bool end_required);
 extern struct val *cbor_unpack_val(struct buffer *buffer);
 
+/*
+ * Like cbor_unpack_val, but the entire decoded tree is allocated from a
+ * single arena which is freed in one go when the last reference to the
+ * returned value is dropped.  This makes decoding and freeing of large
+ * documents considerably cheaper.
+ *
+ * The values inside the tree are not reference counted individually -
+ * references obtained to them (e.g., via nvl_lookup_str) are only valid
+ * while a reference to the root is held.  The tree must not be modified.
+ */
+extern struct val *cbor_unpack_val_arena(struct buffer *buffer);
+
 #endif
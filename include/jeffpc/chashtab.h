@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __JEFFPC_CHASHTAB_H
+#define __JEFFPC_CHASHTAB_H
+
+#include <jeffpc/int.h>
+#include <jeffpc/epoch.h>
+
+/*
+ * A concurrent hash table for read-mostly data.
+ *
+ * Lookups take no locks and do not write to any shared memory.  Instead,
+ * they must be done between epoch_enter and epoch_exit, and the returned
+ * item may be used only until epoch_exit (unless the caller takes a
+ * reference of some sort).
+ *
+ * Insertions and removals lock only the affected bucket (actually, one of
+ * a fixed number of locks shared by many buckets).  Removed items are
+ * passed to the release callback (if any) once no reader can be looking
+ * at them anymore.
+ *
+ * The table is not intrusive since it grows by building a complete copy
+ * of the buckets that readers switch to atomically.  Growing blocks other
+ * writers, but not readers.
+ */
+
+struct chashtab;
+
+extern struct chashtab *chashtab_alloc(uint32_t (*hash)(const void *),
+				       int (*cmp)(const void *, const void *),
+				       void (*release)(void *));
+/* there must not be any other users, releases all remaining items */
+extern void chashtab_free(struct chashtab *tab);
+
+/*
+ * Returns NULL on success, the already present item with the same key, or
+ * ERR_PTR(-ENOMEM).
+ *
+ * A concurrent chashtab_remove may release the already present item at any
+ * time.  It may therefore only be dereferenced if the caller is in an epoch
+ * read section or holds its own reference to it.
+ */
+extern void *chashtab_insert(struct chashtab *tab, void *item);
+/* returns 0 or -ENOENT */
+extern int chashtab_remove(struct chashtab *tab, const void *key);
+
+/* must be called in an epoch read section */
+extern void *chashtab_find(struct chashtab *tab, const void *key);
+
+extern size_t chashtab_numnodes(struct chashtab *tab);
+
+#endif
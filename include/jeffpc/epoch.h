@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __JEFFPC_EPOCH_H
+#define __JEFFPC_EPOCH_H
+
+#include <jeffpc/int.h>
+
+/*
+ * Epoch-based reclamation
+ *
+ * Readers bracket their accesses to a shared data structure with
+ * epoch_enter and epoch_exit.  Read sections may nest, but must not block
+ * for long since they hold up reclamation.  Entering and exiting only
+ * writes to the calling thread's own state.
+ *
+ * Writers unlink objects so that new readers cannot find them, and then
+ * hand them to epoch_defer.  The callback gets called (possibly from a
+ * different thread) once every reader that could have seen the object has
+ * left its read section.  The struct epoch_entry is typically embedded in
+ * the object being freed, so deferring never allocates or fails.
+ *
+ * Deferring only appends to a per-thread list; the epoch is advanced and
+ * the list checked once every several deferrals (and when the thread
+ * exits), so callbacks may run somewhat later than strictly necessary.
+ *
+ * epoch_synchronize waits for all readers currently in a read section and
+ * then runs all the callbacks deferred before it was called by the calling
+ * thread or by threads that have since exited.  It must not be called from
+ * within a read section.
+ */
+
+struct epoch_entry {
+	struct epoch_entry *next;
+	uint64_t epoch;
+	void (*fxn)(struct epoch_entry *);
+};
+
+extern void epoch_enter(void);
+extern void epoch_exit(void);
+extern void epoch_defer(struct epoch_entry *entry,
+			void (*fxn)(struct epoch_entry *));
+extern void epoch_synchronize(void);
+
+#endif
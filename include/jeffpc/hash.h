@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __JEFFPC_HASH_H
+#define __JEFFPC_HASH_H
+
+#include <jeffpc/int.h>
+
+/*
+ * Non-cryptographic hash functions.  These are fast and good enough for
+ * hash tables.  hash_bytes is fixed, so it should not be used where an
+ * adversary can pick the input and benefit from collisions.  hash_str is
+ * seeded with a random per-process value, which makes collisions
+ * impossible to precompute.  Its values differ between processes and
+ * therefore must never be stored or sent anywhere.
+ */
+
+/* INTERNAL - DO NOT USE DIRECTLY */
+extern uint64_t __hash_seed;
+
+/* INTERNAL FUNCTION - DO NOT USE DIRECTLY */
+static inline uint32_t __hash_fnv1a(uint32_t hash, const void *data,
+				    size_t len)
+{
+	const uint8_t *ptr = data;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= ptr[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/* 32-bit FNV-1a */
+static inline uint32_t hash_bytes(const void *data, size_t len)
+{
+	return __hash_fnv1a(2166136261u, data, len);
+}
+
+/* the MurmurHash3 64-bit finalizer, folded to 32 bits */
+static inline uint32_t hash_u64(uint64_t v)
+{
+	v ^= v >> 33;
+	v *= 0xff51afd7ed558ccdull;
+	v ^= v >> 33;
+	v *= 0xc4ceb9fe1a85ec53ull;
+	v ^= v >> 33;
+
+	return (uint32_t) v;
+}
+
+/* mix another hash into an existing one (order dependent) */
+static inline uint32_t hash_combine(uint32_t hash, uint32_t v)
+{
+	return hash ^ (v + 0x9e3779b9u + (hash << 6) + (hash >> 2));
+}
+
+/*
+ * 32-bit FNV-1a started from a seeded state.  The finalizer spreads the
+ * seed and all of the state into the low bits, which pick the bucket.
+ */
+static inline uint32_t hash_str(const void *data, size_t len)
+{
+	uint32_t hash;
+
+	hash = __hash_fnv1a(2166136261u ^ (uint32_t) __hash_seed, data, len);
+
+	return hash_u64(hash ^ __hash_seed);
+}
+
+#endif
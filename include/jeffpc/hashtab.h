@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __JEFFPC_HASHTAB_H
+#define __JEFFPC_HASHTAB_H
+
+#include <stdbool.h>
+
+#include <jeffpc/int.h>
+
+/*
+ * An intrusive hash table with chaining.
+ *
+ * Just like with the trees, the items embed a struct hashtab_node, and the
+ * table is told the item size and the node offset.  The hash function is
+ * called once per item when it is inserted - the result is cached in the
+ * node so that most mismatches are rejected without calling the
+ * comparison function.  The comparison function only needs to return 0
+ * for equal items, so the same function can be used with a tree.
+ *
+ * The table grows by doubling the number of buckets whenever there are
+ * more items than buckets.  Instead of moving all the items at once, every
+ * insertion moves a few buckets' worth of items from the old bucket array
+ * to the new one, so that no single insertion pays for the whole resize.
+ * Lookups and removals check both bucket arrays while this is going on.
+ * The table does not shrink.
+ *
+ * Insertion never fails - if allocating a bigger bucket array fails, the
+ * chains simply get longer.
+ *
+ * Iteration visits the items in no particular order.  The item just
+ * returned by the iterator may be removed, but the table must not be
+ * modified in any other way during iteration.
+ */
+
+struct hashtab_node {
+	struct hashtab_node *next;
+	uint32_t hash;
+};
+
+struct hashtab {
+	uint32_t (*hash)(const void *);
+	int (*cmp)(const void *, const void *);
+	size_t node_size;
+	size_t node_off;
+	size_t num_nodes;
+
+	struct hashtab_node **buckets;
+	size_t nbuckets;		/* always a power of 2 */
+
+	/* rehashing (old is NULL unless there is one in progress) */
+	struct hashtab_node **old;
+	size_t old_nbuckets;
+	size_t rehash_idx;		/* old buckets below this are empty */
+
+	size_t nresizes;
+};
+
+struct hashtab_cookie {
+	struct hashtab_node *next;
+	size_t idx;
+	bool old;
+};
+
+struct hashtab_stats {
+	size_t num_nodes;
+	size_t nbuckets;
+	size_t old_nbuckets;		/* 0 unless rehashing */
+	size_t used_buckets;		/* in both arrays */
+	size_t max_chain;
+	size_t nresizes;
+};
+
+#define hashtab_for_each(tab, cookie, pos) \
+	for (pos = hashtab_first((tab), (cookie)); \
+	     pos; \
+	     pos = hashtab_next((tab), (cookie)))
+
+/* returns 0 or -ENOMEM */
+extern int hashtab_create(struct hashtab *tab,
+			  uint32_t (*hash)(const void *),
+			  int (*cmp)(const void *, const void *),
+			  size_t size, size_t off);
+extern void hashtab_destroy(struct hashtab *tab);
+
+extern void hashtab_add(struct hashtab *tab, void *item);
+extern void *hashtab_insert(struct hashtab *tab, void *item);
+extern void hashtab_remove(struct hashtab *tab, void *item);
+
+extern void *hashtab_find(struct hashtab *tab, const void *key);
+
+extern void *hashtab_first(struct hashtab *tab, struct hashtab_cookie *cookie);
+extern void *hashtab_next(struct hashtab *tab, struct hashtab_cookie *cookie);
+
+/*
+ * Returns the items one at a time, removing them from the table.  The
+ * cookie must be zeroed before the first call.
+ */
+extern void *hashtab_destroy_nodes(struct hashtab *tab,
+				   struct hashtab_cookie *cookie);
+
+extern void hashtab_stats(struct hashtab *tab, struct hashtab_stats *stats);
+
+static inline bool hashtab_is_empty(struct hashtab *tab)
+{
+	return tab->num_nodes == 0;
+}
+
+static inline size_t hashtab_numnodes(struct hashtab *tab)
+{
+	return tab->num_nodes;
+}
+
+#endif
@@ -71,11 +71,74 @@ extern void *mem_recallocarray(void *ptr, size_t old_nelem, size_t new_nelem,
  */
 
 struct mem_cache;
+struct nvlist;
 
 extern struct mem_cache *mem_cache_create(char *name, size_t size, size_t align);
+/*
+ * Like mem_cache_create, but with object constructor and destructor
+ * callbacks.  The constructor is called when an object is brought into the
+ * cache, and the destructor when it leaves it.  Objects stay constructed
+ * while they sit in the cache unallocated, so mem_cache_alloc may return
+ * an object that was constructed long ago and used & freed many times
+ * since.  Therefore, mem_cache_free must be given objects in their
+ * constructed state.
+ *
+ * The constructor returns 0 on success or a negated errno on failure, in
+ * which case the allocation fails.  Either callback may be NULL.
+ */
+extern struct mem_cache *mem_cache_create_ext(char *name, size_t size,
+					      size_t align,
+					      int (*ctor)(void *obj, void *priv),
+					      void (*dtor)(void *obj, void *priv),
+					      void *priv);
 extern void mem_cache_destroy(struct mem_cache *cache);
 
 extern void *mem_cache_alloc(struct mem_cache *cache);
 extern void mem_cache_free(struct mem_cache *cache, void *buf);
 
+/*
+ * Returns an nvlist with statistics for all the caches, keyed by the cache
+ * name.  (Caches sharing a name are aggregated.)  Each value is an nvlist
+ * with the following integers:
+ *
+ *   size      - object size (including padding)
+ *   allocs    - number of allocations
+ *   frees     - number of frees
+ *   live      - allocs - frees
+ *   peak      - high-water mark of objects allocated from slabs
+ *               (including objects cached in magazines)
+ *   bytes     - memory held by the cache
+ *   slabs     - number of slabs
+ *   slab_objs - object capacity of all the slabs
+ *   slab_used - objects allocated from slabs
+ *   slab_util - slab_used as a percentage of slab_objs
+ *
+ * Returns -ENOTSUP when using libumem.
+ */
+extern struct nvlist *mem_cache_stats(void);
+
+/*
+ * arena allocator
+ *
+ * Memory allocated from an arena cannot be freed individually.  Instead,
+ * mem_arena_reset frees all the allocations at once (while keeping the
+ * arena around for reuse) and mem_arena_destroy frees them along with the
+ * arena itself.
+ *
+ * mem_arena_alloc returns memory suitably aligned for any type.
+ * mem_arena_alloc_aligned takes an explicit power-of-two alignment (0
+ * means the same as mem_arena_alloc).  Both return NULL on failure.
+ *
+ * Arenas are not thread-safe.
+ */
+
+struct mem_arena;
+
+extern struct mem_arena *mem_arena_create(void);
+extern void mem_arena_destroy(struct mem_arena *arena);
+extern void mem_arena_reset(struct mem_arena *arena);
+extern void *mem_arena_alloc(struct mem_arena *arena, size_t size);
+extern void *mem_arena_alloc_aligned(struct mem_arena *arena, size_t size,
+				     size_t align);
+
 #endif
@@ -27,6 +27,7 @@
 
 #include <jeffpc/val.h>
 #include <jeffpc/buffer.h>
+#include <jeffpc/hash.h>
 
 struct nvlist {
 	struct val val;
@@ -34,12 +35,20 @@ struct nvlist {
 
 /* do not access these directly */
 struct nvpair {
-	struct rb_node node;
-
 	struct str *name;
 	struct val *value;
 };
 
+/*
+ * A precompiled key for repeated lookups of the same name.  The name must
+ * outlive the key.
+ */
+struct nvl_key {
+	const char *name;
+	size_t len;
+	uint32_t hash;
+};
+
 enum nvcvtcond {
 	NVCVT_COND_ALWAYS = 0,
 	NVCVT_COND_STR_EMPTY,
@@ -53,6 +62,16 @@ struct nvl_convert_info {
 
 #define nvl_alloc()	((struct nvlist *) val_alloc_nvl())
 
+/*
+ * Regular nvlists start out as a small array (allocated when the first
+ * pair is added), switch to a tree once the array fills up, and switch to
+ * a hash table once they grow past a handful more pairs.
+ * nvl_alloc_hashed allocates an nvlist that uses a hash table from the
+ * start - useful for nvlists that are known to end up big.  Either way,
+ * iteration is always in name order.
+ */
+extern struct nvlist *nvl_alloc_hashed(void);
+
 /*
  * struct val reference counting & casting to struct nvl
  */
@@ -121,7 +140,13 @@ static inline struct buffer *nvl_pack(struct nvlist *nvl,
 	return val_pack(nvl_cast_to_val(nvl), format);
 }
 
-/* iteration */
+/*
+ * Iteration
+ *
+ * The nvpair pointers returned by the iteration and lookup functions are
+ * only valid until a pair is added to or removed from the nvlist.
+ * Changing the value of an existing pair is fine.
+ */
 extern const struct nvpair *nvl_iter_start(struct nvlist *nvl);
 extern const struct nvpair *nvl_iter_next(struct nvlist *nvl,
 					  const struct nvpair *prev);
@@ -152,6 +177,83 @@ extern const struct nvpair *nvl_lookup(struct nvlist *nvl, const char *name);
 extern struct nvlist *nvl_lookup_nvl(struct nvlist *nvl, const char *name);
 extern struct str *nvl_lookup_str(struct nvlist *nvl, const char *name);
 
+/*
+ * The _key variants behave just like the above, but take a precompiled
+ * key instead of a name.  This saves computing the name's length and
+ * hash on every lookup, which adds up for code that looks up the same
+ * constant names over and over (e.g., request headers).
+ */
+static inline void nvl_key_init(struct nvl_key *key, const char *name)
+{
+	key->name = name;
+	key->len = strlen(name);
+	key->hash = hash_str(name, key->len);
+}
+
+extern int nvl_lookup_array_key(struct nvlist *nvl, const struct nvl_key *key,
+				struct val ***vals, size_t *nelem);
+extern int nvl_lookup_blob_key(struct nvlist *nvl, const struct nvl_key *key,
+			       const void **ptr, size_t *size);
+extern int nvl_lookup_bool_key(struct nvlist *nvl, const struct nvl_key *key,
+			       bool *out);
+extern int nvl_lookup_int_key(struct nvlist *nvl, const struct nvl_key *key,
+			      uint64_t *out);
+extern int nvl_lookup_null_key(struct nvlist *nvl, const struct nvl_key *key);
+extern const struct nvpair *nvl_lookup_key(struct nvlist *nvl,
+					   const struct nvl_key *key);
+extern struct nvlist *nvl_lookup_nvl_key(struct nvlist *nvl,
+					 const struct nvl_key *key);
+extern struct str *nvl_lookup_str_key(struct nvlist *nvl,
+				      const struct nvl_key *key);
+
+/*
+ * The _noref variants return the value without getting a new reference.
+ * The returned pointer is borrowed from the nvlist and it is valid only
+ * as long as the pair's value does not change (and the nvlist stays
+ * around).  The caller must not put the reference.
+ */
+extern struct nvlist *nvl_lookup_nvl_noref(struct nvlist *nvl,
+					   const char *name);
+extern struct nvlist *nvl_lookup_nvl_noref_key(struct nvlist *nvl,
+					       const struct nvl_key *key);
+extern struct str *nvl_lookup_str_noref(struct nvlist *nvl, const char *name);
+extern struct str *nvl_lookup_str_noref_key(struct nvlist *nvl,
+					    const struct nvl_key *key);
+
+/*
+ * Path queries
+ *
+ * A path names a value nested inside an nvlist - e.g., "server.listen.port"
+ * or "servers[2].name".  Names are separated by dots and array elements
+ * are selected with a zero-based index in brackets.  Names cannot contain
+ * dots or brackets.
+ *
+ * A path is compiled once with nvl_path_compile (which returns -EINVAL if
+ * the path is malformed) and can then be looked up in any number of
+ * nvlists.  The lookups do not get any references - neither on the
+ * intermediate nvlists and arrays nor on the returned value.  The returned
+ * value is borrowed from the nvlist just like with the nvl_lookup_*_noref
+ * functions.
+ *
+ * -ENOENT = a name does not exist or an index is out of range
+ * -ERANGE = wrong type (either along the way or of the final value)
+ */
+struct nvl_path;
+
+extern struct nvl_path *nvl_path_compile(const char *path);
+extern void nvl_path_free(struct nvl_path *path);
+
+extern struct val *nvl_path_lookup(struct nvlist *nvl,
+				   const struct nvl_path *path);
+extern int nvl_path_lookup_bool(struct nvlist *nvl,
+				const struct nvl_path *path, bool *out);
+extern int nvl_path_lookup_int(struct nvlist *nvl,
+			       const struct nvl_path *path, uint64_t *out);
+extern struct nvlist *nvl_path_lookup_nvl_noref(struct nvlist *nvl,
+						const struct nvl_path *path);
+extern struct str *nvl_path_lookup_str_noref(struct nvlist *nvl,
+					     const struct nvl_path *path);
+
 /*
  * Add a new key-value pair or change the value of an existing key-value
  * pair.
@@ -159,6 +261,7 @@ extern struct str *nvl_lookup_str(struct nvlist *nvl, const char *name);
  * always consume val's reference
  *
  * -ENOMEM = out of memory
+ * -EROFS  = the nvlist is persistent
  */
 extern int nvl_set(struct nvlist *nvl, const char *name, struct val *val);
 extern int nvl_set_array(struct nvlist *nvl, const char *name,
@@ -179,11 +282,23 @@ extern int nvl_set_str(struct nvlist *nvl, const char *name, struct str *val);
 
 extern int nvl_set_pair(struct nvlist *nvl, const struct nvpair *pair);
 
+/*
+ * Add many key-value pairs at once.  If the nvlist is empty and the names
+ * are sorted (e.g., they come from iterating over another nvlist), the
+ * nvlist is built in O(n) time instead of adding one pair at a time.
+ * Otherwise, this is equivalent to calling nvl_set for each pair in order.
+ *
+ * always consumes all the names' and values' references
+ */
+extern int nvl_set_bulk(struct nvlist *nvl, struct str **names,
+			struct val **vals, size_t npairs);
+
 /*
  * Remove a key-value pair from the list.
  *
  * -ENOENT = not found
  * -ERANGE = existing item's type doesn't match requested type
+ * -EROFS  = the nvlist is persistent
  */
 extern int nvl_unset(struct nvlist *nvl, const char *name);
 extern int nvl_unset_type(struct nvlist *nvl, const char *name, enum val_type type);
@@ -204,6 +319,36 @@ extern bool nvl_exists(struct nvlist *nvl, const char *name);
 extern int nvl_exists_type(struct nvlist *nvl, const char *name,
 			   enum val_type type);
 
+/*
+ * Persistent nvlists
+ *
+ * A persistent nvlist is immutable.  Instead of modifying it in place,
+ * nvl_pset and nvl_punset return a new nvlist with the change applied.
+ * The new nvlist shares all the unchanged parts with the original, so
+ * each change costs O(log n) time and space regardless of the size of the
+ * nvlist.  The original remains valid and unchanged.
+ *
+ * Lookups, iteration, and packing work on persistent nvlists just like on
+ * regular ones.  The in-place modification functions (nvl_set, nvl_unset,
+ * and friends) fail with -EROFS.
+ *
+ * nvl_persist returns a persistent copy of the nvlist (or a new reference
+ * if it is already persistent).
+ *
+ * nvl_pset always consumes val's reference.  nvl_pset and nvl_punset
+ * return -EINVAL if the nvlist isn't persistent and nvl_punset returns
+ * -ENOENT if the key doesn't exist.
+ */
+extern struct nvlist *nvl_persist(struct nvlist *nvl);
+extern struct nvlist *nvl_pset(struct nvlist *nvl, const char *name,
+			       struct val *val);
+extern struct nvlist *nvl_punset(struct nvlist *nvl, const char *name);
+
+static inline bool nvl_is_persistent(struct nvlist *nvl)
+{
+	return nvl->val.persistent;
+}
+
 /*
  * nvpair related functions
  */
@@ -242,4 +387,8 @@ extern int nvpair_value_null(const struct nvpair *pair);
 extern struct nvlist *nvpair_value_nvl(const struct nvpair *pair);
 extern struct str *nvpair_value_str(const struct nvpair *pair);
 
+/* same as above, but without a new reference (see nvl_lookup_*_noref) */
+extern struct nvlist *nvpair_value_nvl_noref(const struct nvpair *pair);
+extern struct str *nvpair_value_str_noref(const struct nvpair *pair);
+
 #endif
@@ -53,6 +53,13 @@ extern void *rb_insert_here(struct rb_tree *tree, void *item,
 #define rb_insert(tree, item)	rb_insert_here((tree), (item), NULL)
 extern void rb_remove(struct rb_tree *tree, void *item);
 
+/*
+ * Build a balanced tree out of an array of items in O(n) time.  The tree
+ * must be empty and the items must already be sorted in strictly ascending
+ * order according to the tree's comparison function.
+ */
+extern void rb_build(struct rb_tree *tree, void **items, size_t nitems);
+
 static inline bool rb_is_empty(struct rb_tree *tree)
 {
 	return tree_is_empty(&tree->tree);
@@ -102,40 +102,221 @@
  * indication of a use-after-free bug.
  *
  * TODO: document the is-static macro argument
+ *
+ * Biased reference counting
+ *
+ * Most objects are only ever used by the thread that allocated them, so
+ * the reference count is split in two (see Choi, Shull, and Torrellas,
+ * "Biased Reference Counting", PACT 2018).  The thread that initializes
+ * the reference count becomes its owner and adjusts a plain (non-atomic)
+ * biased counter.  All other threads atomically adjust a shared counter.
+ * The object is alive as long as the sum of the two is non-zero.
+ *
+ * Only the owner can read the biased counter, so it is the owner that
+ * decides when the two counters get merged:
+ *
+ *  (1) When the biased counter drops to zero, the owner marks the shared
+ *      counter as merged.  From then on, everyone (including the former
+ *      owner) uses the shared counter alone.
+ *
+ *  (2) When another thread makes the shared counter negative (i.e., it
+ *      released a reference the owner obtained), the object might be dead
+ *      already.  The thread marks the shared counter as queued and puts
+ *      the object on the owner's queue.  The owner merges the queued
+ *      objects the next time it releases a reference and when it exits.
+ *      (Once the owner exited, the enqueuing thread merges the counters
+ *      itself.)
+ *
+ * As a shortcut for (2), a thread that sees that it is dropping the very
+ * last reference (i.e., the two counters add up to one and nothing is
+ * queued) can't be racing with anyone, so it marks the object merged and
+ * frees it directly.  This keeps objects handed off to another thread
+ * (e.g., to be freed in the background) from bouncing back to the owner.
+ * Since the shortcut inspects both counters at once, the owner updates
+ * the biased counter atomically and does the merge in (1) with a single
+ * compare-and-swap of the whole reference count.
+ *
+ * Threads are identified by a small integer, which gets reused once the
+ * thread exits.  If there are too many threads at the same time, new
+ * threads don't get one and their objects start out merged - i.e., they
+ * use plain atomic reference counting.
  */
 
 #ifndef __JEFFPC_REFCNT_H
 #define __JEFFPC_REFCNT_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <jeffpc/atomic.h>
 #include <jeffpc/error.h>
 
-typedef struct {
-	atomic_t count;
+typedef union {
+	struct {
+		uint16_t owner;		/* owning thread id, 0 if merged */
+		uint16_t biased;	/* owner's references */
+		atomic_t shared;	/* everyone else's refs & flags */
+	};
+	uint64_t word;			/* all of the above at once */
 } refcnt_t;
 
+/* the shared counter holds a signed count above two flags */
+#define __REFCNT_MERGED		0x1u
+#define __REFCNT_QUEUED		0x2u
+#define __REFCNT_ONE		0x4u
+#define __REFCNT_COUNT(v)	(((int32_t) (v)) >> 2)
+
+#define __REFCNT_TID_UNSET	0xffff	/* thread hasn't been set up yet */
+#define __REFCNT_TID_NONE	0xfffe	/* thread has no id */
+
+struct __refcnt_tls {
+	uint16_t tid;
+	atomic_t pending;	/* the thread has queued objects */
+};
+
+extern __thread struct __refcnt_tls __refcnt_tls
+	__attribute__((tls_model("initial-exec")));
+
+extern uint16_t __refcnt_thread_init(void);
+extern void __refcnt_drain(void);
+extern bool __refcnt_queue(refcnt_t *x, void *obj, void (*freefxn)(void *));
+
+/* INTERNAL FUNCTION - DO NOT USE DIRECTLY */
+static inline uint16_t __refcnt_owner(refcnt_t *x)
+{
+	return __atomic_load_n(&x->owner, __ATOMIC_RELAXED);
+}
+
 static inline void refcnt_init(refcnt_t *x, uint32_t v)
 {
-	atomic_set(&x->count, v);
+	uint16_t tid = __refcnt_tls.tid;
+
+	if (tid == __REFCNT_TID_UNSET)
+		tid = __refcnt_thread_init();
+
+	if ((tid == __REFCNT_TID_NONE) || !v || (v > UINT16_MAX)) {
+		x->owner = 0;
+		x->biased = 0;
+		atomic_set(&x->shared, (v * __REFCNT_ONE) | __REFCNT_MERGED);
+	} else {
+		x->owner = tid;
+		x->biased = v;
+		atomic_set(&x->shared, 0);
+	}
 }
 
+/*
+ * Only exact when no other thread is using the reference count (e.g., in
+ * the free function).
+ */
 static inline uint32_t refcnt_read(refcnt_t *x)
 {
-	return atomic_read(&x->count);
+	int32_t count = __REFCNT_COUNT(atomic_read(&x->shared));
+
+	if (__refcnt_owner(x))
+		count += __atomic_load_n(&x->biased, __ATOMIC_RELAXED);
+
+	return count;
 }
 
 /* INTERNAL FUNCTION - DO NOT USE DIRECTLY */
-static inline void __refcnt_inc(refcnt_t *x)
+static inline bool __refcnt_dead(refcnt_t *x)
 {
-	atomic_inc(&x->count);
+	uint32_t v;
+
+	if (__refcnt_owner(x) == __refcnt_tls.tid)
+		return !x->biased;
+
+	v = atomic_read(&x->shared);
+
+	return (v & __REFCNT_MERGED) && (__REFCNT_COUNT(v) <= 0);
 }
 
 /* INTERNAL FUNCTION - DO NOT USE DIRECTLY */
-static inline uint32_t __refcnt_dec(refcnt_t *x)
+static inline void __refcnt_inc(refcnt_t *x)
 {
-	return atomic_dec(&x->count);
+	if ((__refcnt_owner(x) == __refcnt_tls.tid) &&
+	    (x->biased < UINT16_MAX))
+		__atomic_store_n(&x->biased, x->biased + 1, __ATOMIC_RELAXED);
+	else
+		atomic_add(&x->shared, __REFCNT_ONE);
+}
+
+/*
+ * INTERNAL FUNCTION - DO NOT USE DIRECTLY
+ *
+ * A non-owner trying to drop the last reference.  If the counters say
+ * that there is only one reference, it must be the caller's and nobody
+ * else can be touching them.
+ */
+static inline bool __refcnt_drop_last(refcnt_t *x)
+{
+	refcnt_t old, new;
+
+	old.word = __atomic_load_n(&x->word, __ATOMIC_RELAXED);
+
+	if (!old.owner || (old.shared.v & __REFCNT_QUEUED) ||
+	    ((old.biased + __REFCNT_COUNT(old.shared.v)) != 1))
+		return false;
+
+	new.owner = 0;
+	new.biased = 0;
+	new.shared.v = __REFCNT_MERGED;
+
+	return __atomic_compare_exchange_n(&x->word, &old.word, new.word,
+					   false, __ATOMIC_ACQ_REL,
+					   __ATOMIC_RELAXED);
+}
+
+/*
+ * INTERNAL FUNCTION - DO NOT USE DIRECTLY
+ *
+ * Returns true if the caller should free the object.
+ */
+static inline bool __refcnt_dec(refcnt_t *x, void *obj,
+				void (*freefxn)(void *))
+{
+	uint32_t v;
+
+	if (__refcnt_owner(x) == __refcnt_tls.tid) {
+		refcnt_t old, new;
+
+		if (x->biased > 1) {
+			__atomic_store_n(&x->biased, x->biased - 1,
+					 __ATOMIC_RELAXED);
+			return false;
+		}
+
+		/*
+		 * case (1): merge - all at once, so that __refcnt_drop_last
+		 * never sees the biased reference gone but not yet merged
+		 */
+		old.word = __atomic_load_n(&x->word, __ATOMIC_RELAXED);
+		do {
+			new.owner = 0;
+			new.biased = 0;
+			new.shared.v = old.shared.v | __REFCNT_MERGED;
+		} while (!__atomic_compare_exchange_n(&x->word, &old.word,
+						      new.word, false,
+						      __ATOMIC_ACQ_REL,
+						      __ATOMIC_RELAXED));
+
+		v = new.shared.v;
+	} else {
+		if (__refcnt_drop_last(x))
+			return true;
+
+		v = atomic_sub(&x->shared, __REFCNT_ONE);
+
+		/* case (2): let the owner merge */
+		if (!(v & (__REFCNT_MERGED | __REFCNT_QUEUED)) &&
+		    (__REFCNT_COUNT(v) < 0))
+			return __refcnt_queue(x, obj, freefxn);
+	}
+
+	/* queued objects are freed by whoever merges them */
+	return (v & __REFCNT_MERGED) && !(v & __REFCNT_QUEUED) &&
+		!__REFCNT_COUNT(v);
 }
 
 /*
@@ -154,7 +335,7 @@ vol type *name##_getref(type *x)					\
 		return NULL;						\
 									\
 	if (!isstatic || !isstatic(x)) {				\
-		if (refcnt_read(&x->member) <= 0)			\
+		if (__refcnt_dead(&x->member))				\
 			panic("%s(%p) called with zero refcount",	\
 			      __func__, x);				\
 									\
@@ -163,6 +344,10 @@ vol type *name##_getref(type *x)					\
 									\
 	return x;							\
 }									\
+static inline void name##__refcnt_free(void *x)				\
+{									\
+	freefxn(x);							\
+}									\
 vol void name##_putref(type *x)						\
 {									\
 	bool (*isstatic)(type *) = isstaticfxn;				\
@@ -170,11 +355,15 @@ vol void name##_putref(type *x)						\
 	if (!x || (isstatic && isstatic(x)))				\
 		return;							\
 									\
-	if (refcnt_read(&x->member) <= 0)				\
+	if (__refcnt_dead(&x->member))					\
 		panic("%s(%p) called with zero refcount", __func__, x);	\
 									\
-	if (!__refcnt_dec(&x->member))					\
+	if (__refcnt_dec(&x->member, x, name##__refcnt_free))		\
 		freefxn(x);						\
+									\
+	/* a safe point to merge objects other threads released */	\
+	if (__atomic_load_n(&__refcnt_tls.pending.v, __ATOMIC_RELAXED))	\
+		__refcnt_drain();					\
 }
 
 /*
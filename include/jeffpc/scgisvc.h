@@ -24,6 +24,7 @@
 #define __JEFFPC_SCGISVC_H
 
 #include <jeffpc/int.h>
+#include <jeffpc/mem.h>
 #include <jeffpc/nvl.h>
 #include <jeffpc/socksvc.h>
 
@@ -43,6 +44,9 @@ struct scgi {
 	const struct scgiops *ops;
 	void *private;
 
+	/* request-lifetime allocations, freed after the response is sent */
+	struct mem_arena *arena;
+
 	/* request */
 	struct {
 		struct nvlist *headers;
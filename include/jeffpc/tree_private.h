@@ -54,6 +54,7 @@ struct tree_tree {
 	enum {
 		TREE_FLAVOR_UNBALANCED,
 		TREE_FLAVOR_RED_BLACK,
+		TREE_FLAVOR_AVL,
 	} flavor;
 };
 
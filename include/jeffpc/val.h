@@ -68,17 +68,34 @@ enum val_format {
 #define STR_INLINE_LEN	15
 
 struct val {
-	enum val_type type;
-	refcnt_t refcnt;
+	enum val_type type:8;
 	bool static_struct:1;	/* struct statically allocated */
 	bool static_alloc:1;	/* pointer is static */
 	bool inline_alloc:1;	/* data is inline */
+	bool arena_root:1;	/* struct owns the arena it lives in */
+	bool len_valid:1;	/* str/sym length is cached */
+	bool interned:1;	/* sym is in the intern table */
+	bool hash_valid:1;	/* str/sym hash is cached */
+	bool slice:1;		/* str points into another val */
+	bool ext_release:1;	/* blob is released by a callback */
+	bool persistent:1;	/* nvl is an immutable persistent tree */
+	bool hashed:1;		/* nvl is a hash table */
+	bool small:1;		/* nvl is a small array */
+	uint8_t inline_len;	/* str/sym length if inline */
+	uint32_t hash;		/* str/sym hash if hash_valid */
+	union {
+		refcnt_t refcnt;
+		struct val *_free_next;	/* only used by val_free */
+	};
 	union {
 		const uint64_t i;
 		const bool b;
 		struct {
 			union {
-				const char *ptr;
+				struct {
+					const char *ptr;
+					size_t len;
+				};
 				const char inline_str[STR_INLINE_LEN + 1];
 			};
 		} str;
@@ -95,7 +112,13 @@ struct val {
 			size_t nelem;
 		} array;
 		const struct {
-			struct rb_tree values;
+			union {
+				struct rb_tree *values;
+				struct nvl_pnode *root; /* if persistent */
+				struct nvl_htab *htab;	/* if hashed */
+				struct nvl_small *small; /* if small */
+			};
+			size_t npairs;		/* unless a plain tree */
 		} nvl;
 
 		/*
@@ -126,7 +149,13 @@ struct val {
 			size_t nelem;
 		} _set_array;
 		struct {
-			struct rb_tree values;
+			union {
+				struct rb_tree *values;
+				struct nvl_pnode *root;
+				struct nvl_htab *htab;
+				struct nvl_small *small;
+			};
+			size_t npairs;
 		} _set_nvl;
 	};
 };
@@ -148,6 +177,15 @@ struct sym {
 extern struct val *val_alloc_blob(void *ptr, size_t size);
 extern struct val *val_alloc_blob_dup(const void *ptr, size_t size);
 extern struct val *val_alloc_blob_static(const void *ptr, size_t size);
+/*
+ * The blob's data is owned by the caller (e.g., it is a mmap'd file or a
+ * pooled buffer).  When the val is freed - or if the allocation fails -
+ * release is called with the pointer, size, and the cookie.
+ */
+extern struct val *val_alloc_blob_ext(void *ptr, size_t size,
+				      void (*release)(void *ptr, size_t size,
+						      void *cookie),
+				      void *cookie);
 extern struct val *val_alloc_bool(bool v);
 extern struct val *val_alloc_char(uint64_t v);
 extern struct val *val_alloc_int(uint64_t v);
@@ -208,6 +246,16 @@ extern struct val *_strsym_dup(const char *s, enum val_type type);
 #define val_dup_sym_len(s, l)	_strsym_dup_len((s), (l), VT_SYM)
 extern struct val *_strsym_dup_len(const char *s, size_t len,
 				   enum val_type type);
+/*
+ * Allocate a string which refers to len bytes at offset off in the parent's
+ * buffer (a str or a blob) instead of copying them.  The string holds the
+ * passed in reference on the parent until it is freed.
+ *
+ * The bytes must be followed by a nul inside the parent's buffer.  If they
+ * are not - or if the string is short enough to be inlined - they are
+ * copied instead.
+ */
+extern struct str *str_slice(struct val *parent, size_t off, size_t len);
 
 /* assorted preallocated strings */
 extern struct str *str_empty_string(void);
@@ -218,6 +266,32 @@ extern struct str *str_empty_string(void);
 
 extern void val_free(struct val *v);
 
+/*
+ * Deferred freeing
+ *
+ * Once enabled, freeing an array or an nvlist with at least threshold
+ * elements (or a list at least that long) is handed off to a taskq with
+ * nthreads threads (-1 for one per CPU) instead of stalling the thread
+ * that dropped the last reference.
+ *
+ * val_deferred_free_disable waits for the backlog to be freed.  It must
+ * not race with other threads freeing values.
+ *
+ * val_deferred_free_stats returns an nvlist with the following:
+ *
+ *   enabled      - whether deferred freeing is enabled
+ *   threshold    - the current threshold
+ *   queued       - values handed off to the taskq
+ *   completed    - values freed by the taskq
+ *   backlog      - values waiting to be freed (queued - completed)
+ *   backlog_peak - the largest backlog seen
+ */
+struct nvlist;
+
+extern int val_deferred_free_enable(size_t threshold, long nthreads);
+extern void val_deferred_free_disable(void);
+extern struct nvlist *val_deferred_free_stats(void);
+
 /*
  * Serialization functions
  */
@@ -255,6 +329,23 @@ static inline const char *val_rawtypename(int type)
 	return __val_typename(type, false);
 }
 
+/*
+ * Hashing & comparison
+ *
+ * val_hash returns a hash of the value's contents.  Values that are equal
+ * according to val_equal hash to the same value.  The hash of strings and
+ * symbols is computed when they are allocated and cached in the struct
+ * val.  Since strings are hashed with a per-process seed (see hash_str),
+ * the hashes differ between processes.
+ *
+ * val_equal compares two values structurally.  It does not consume any
+ * references.  (Unlike sexpr_equal, it considers NULL and an empty cons
+ * cell different.)
+ */
+
+extern uint32_t val_hash(const struct val *val);
+extern bool val_equal(const struct val *a, const struct val *b);
+
 /*
  * Misc functions
  */
@@ -267,6 +358,21 @@ extern size_t _strsym_len(const struct val *val);
 #define sym_cmp(a, b)	_strsym_cmp(&(a)->val, &(b)->val)
 extern int _strsym_cmp(const struct val *a, const struct val *b);
 
+/*
+ * Symbols allocated at runtime (sym_alloc, sym_dup, etc.) are interned -
+ * there is only one struct sym for any given name and it is never freed.
+ * Statically initialized symbols (e.g., STATIC_SYM) are not interned.
+ *
+ * Since interned symbols are never reclaimed, the intern table grows with
+ * every distinct name ever used.  Code turning untrusted input into
+ * symbols (e.g., sexpr parsing) should limit the size of the input or use
+ * strings instead.
+ *
+ * sym_lookup returns the interned symbol with the given name, or NULL if
+ * no such symbol has been allocated.  It never allocates.
+ */
+extern struct sym *sym_lookup(const char *name);
+
 extern struct str *str_cat(size_t n, ...);
 extern struct str *str_printf(const char *fmt, ...)
 	__attribute__((format (printf, 1, 2)));
@@ -343,6 +449,18 @@ static inline const char *sym_cstr(const struct sym *sym)
 	return val_cstr(&sym->val);
 }
 
+/* interned symbols are equal only if they are the same symbol */
+static inline bool sym_equal(const struct sym *a, const struct sym *b)
+{
+	if (a == b)
+		return true;
+
+	if (a->val.interned && b->val.interned)
+		return false;
+
+	return !strcmp(sym_cstr(a), sym_cstr(b));
+}
+
 /*
  * Initializers
  */
@@ -355,6 +473,8 @@ static inline const char *sym_cstr(const struct sym *sym)
 			.static_struct = true,		\
 			.static_alloc = true,		\
 			.inline_alloc = true,		\
+			.len_valid = true,		\
+			.inline_len = 1,		\
 		}					\
 	}
 #define STR_STATIC_CHAR_INITIALIZER(v)			\
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <jeffpc/mem.h>
+#include <jeffpc/int.h>
+#include <jeffpc/types.h>
+#include <jeffpc/error.h>
+
+/*
+ * Arena allocator
+ *
+ * An arena is a list of fixed-size chunks which are carved up by bumping
+ * a pointer.  Individual allocations are never freed; instead the whole
+ * arena is reset or destroyed at once.
+ *
+ * The arena structure itself lives at the start of its first chunk, so
+ * creating an arena costs a single chunk allocation.  Chunks come from a
+ * slab cache, which means that the per-thread magazines recycle them
+ * between arenas without touching the system allocator - a short-lived
+ * arena (e.g., one per request) never has to go to malloc in the common
+ * case.
+ *
+ * Allocations that would use up a sizable fraction of a chunk are
+ * satisfied directly by malloc and kept on a separate list so that they
+ * can be freed when the arena is reset.
+ */
+
+#define ARENA_CHUNK_SIZE	16384
+#define ARENA_LARGE_SIZE	(ARENA_CHUNK_SIZE / 4)
+#define ARENA_DEFAULT_ALIGN	16
+
+/* header of every chunk but the first */
+struct arena_chunk {
+	struct arena_chunk *next;
+};
+
+struct mem_arena {
+	uintptr_t cur;			/* next free byte */
+	uintptr_t end;			/* end of the current chunk */
+	struct arena_chunk *chunks;	/* additional chunks */
+	struct arena_chunk *large;	/* oversized allocations */
+};
+
+static struct mem_cache *arena_chunk_cache;
+
+static void __attribute__((constructor)) init_mem_arena_subsys(void)
+{
+	arena_chunk_cache = mem_cache_create("mem-arena-chunk-cache",
+					     ARENA_CHUNK_SIZE, 0);
+	ASSERT(!IS_ERR(arena_chunk_cache));
+}
+
+static void arena_init(struct mem_arena *arena)
+{
+	arena->cur = (uintptr_t) (arena + 1);
+	arena->end = ((uintptr_t) arena) + ARENA_CHUNK_SIZE;
+	arena->chunks = NULL;
+	arena->large = NULL;
+}
+
+struct mem_arena *mem_arena_create(void)
+{
+	struct mem_arena *arena;
+
+	arena = mem_cache_alloc(arena_chunk_cache);
+	if (!arena)
+		return ERR_PTR(-ENOMEM);
+
+	arena_init(arena);
+
+	return arena;
+}
+
+void mem_arena_reset(struct mem_arena *arena)
+{
+	struct arena_chunk *chunk;
+
+	if (!arena)
+		return;
+
+	while ((chunk = arena->large) != NULL) {
+		arena->large = chunk->next;
+		free(chunk);
+	}
+
+	while ((chunk = arena->chunks) != NULL) {
+		arena->chunks = chunk->next;
+		mem_cache_free(arena_chunk_cache, chunk);
+	}
+
+	arena_init(arena);
+}
+
+void mem_arena_destroy(struct mem_arena *arena)
+{
+	if (!arena)
+		return;
+
+	mem_arena_reset(arena);
+
+	mem_cache_free(arena_chunk_cache, arena);
+}
+
+static void *alloc_large(struct mem_arena *arena, size_t size, size_t align)
+{
+	struct arena_chunk *chunk;
+	size_t hdrsize;
+	void *tmp;
+
+	align = MAX(align, ARENA_DEFAULT_ALIGN);
+	hdrsize = p2roundup(sizeof(struct arena_chunk), align);
+
+	if (size > SIZE_MAX - hdrsize)
+		return NULL;
+
+	if (posix_memalign(&tmp, align, hdrsize + size))
+		return NULL;
+
+	chunk = tmp;
+	chunk->next = arena->large;
+	arena->large = chunk;
+
+	return ((uint8_t *) chunk) + hdrsize;
+}
+
+static void *alloc_slow(struct mem_arena *arena, size_t size, size_t align)
+{
+	struct arena_chunk *chunk;
+	uintptr_t ptr;
+
+	if ((size > ARENA_LARGE_SIZE) || (align > ARENA_LARGE_SIZE))
+		return alloc_large(arena, size, align);
+
+	/*
+	 * Get a new chunk.  Whatever space was left in the current chunk is
+	 * wasted, but since we only get here for allocations smaller than a
+	 * quarter of a chunk, at most 25% of a chunk is lost.
+	 */
+	chunk = mem_cache_alloc(arena_chunk_cache);
+	if (!chunk)
+		return NULL;
+
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+
+	ptr = p2roundup((uintptr_t) (chunk + 1), align);
+
+	arena->cur = ptr + size;
+	arena->end = ((uintptr_t) chunk) + ARENA_CHUNK_SIZE;
+
+	return (void *) ptr;
+}
+
+void *mem_arena_alloc_aligned(struct mem_arena *arena, size_t size,
+			      size_t align)
+{
+	uintptr_t ptr;
+
+	if (!align)
+		align = ARENA_DEFAULT_ALIGN;
+	else if (!is_p2(align))
+		return NULL;
+
+	/* give each zero-sized allocation a unique address */
+	if (!size)
+		size = 1;
+
+	ptr = p2roundup(arena->cur, align);
+
+	if ((ptr < arena->cur) || (ptr > arena->end) ||
+	    (size > (arena->end - ptr)))
+		return alloc_slow(arena, size, align);
+
+	arena->cur = ptr + size;
+
+	return (void *) ptr;
+}
+
+void *mem_arena_alloc(struct mem_arena *arena, size_t size)
+{
+	return mem_arena_alloc_aligned(arena, size, 0);
+}
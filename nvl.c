@@ -26,9 +26,47 @@
 
 #include "val_impl.h"
 
+/* iteration is sorted, so we can hand the pairs over in one go */
+static int merge_bulk(struct nvlist *dest, struct nvlist *src, size_t npairs)
+{
+	const struct nvpair *spair;
+	struct str **names;
+	struct val **vals;
+	size_t i;
+	int ret;
+
+	names = mem_reallocarray(NULL, npairs, sizeof(struct str *));
+	vals = mem_reallocarray(NULL, npairs, sizeof(struct val *));
+	if (!names || !vals) {
+		free(names);
+		free(vals);
+		return -ENOMEM;
+	}
+
+	i = 0;
+	nvl_for_each(spair, src) {
+		names[i] = str_getref(spair->name);
+		vals[i] = val_getref(spair->value);
+		i++;
+	}
+
+	ret = nvl_set_bulk(dest, names, vals, npairs);
+
+	free(names);
+	free(vals);
+
+	return ret;
+}
+
 int nvl_merge(struct nvlist *dest, struct nvlist *src)
 {
 	const struct nvpair *spair;
+	size_t npairs;
+
+	npairs = __nvl_numpairs(&src->val);
+
+	if (!__nvl_numpairs(&dest->val) && (npairs > NVL_SMALL_PAIRS))
+		return merge_bulk(dest, src, npairs);
 
 	nvl_for_each(spair, src) {
 		int ret;
@@ -42,14 +80,35 @@ int nvl_merge(struct nvlist *dest, struct nvlist *src)
 	return 0;
 }
 
-static struct nvpair *find(struct nvlist *nvl, const char *name)
+/* regular nvlists switch to a hash table once they get this big */
+#define NVL_HASH_MIN_PAIRS	16
+
+static struct nvpair *find_key(struct nvlist *nvl, const struct nvl_key *key)
 {
-	struct str name_str = STR_STATIC_INITIALIZER(name);
-	struct nvpair key = {
+	struct str name_str = STR_STATIC_INITIALIZER(key->name);
+	struct nvpair pkey = {
 		.name = &name_str,
 	};
 
-	return rb_find(&nvl->val._set_nvl.values, &key, NULL);
+	if (nvl->val.hashed)
+		return __nvl_hfind(&nvl->val, key);
+
+	if (nvl->val.persistent)
+		return __nvl_pfind(&nvl->val, &name_str);
+
+	if (nvl->val.small)
+		return __nvl_sfind(&nvl->val, key);
+
+	return rb_find(nvl->val._set_nvl.values, &pkey, NULL);
+}
+
+static struct nvpair *find(struct nvlist *nvl, const char *name)
+{
+	struct nvl_key key;
+
+	nvl_key_init(&key, name);
+
+	return find_key(nvl, &key);
 }
 
 /*
@@ -58,13 +117,31 @@ static struct nvpair *find(struct nvlist *nvl, const char *name)
 
 const struct nvpair *nvl_iter_start(struct nvlist *nvl)
 {
-	return rb_first(&nvl->val._set_nvl.values);
+	if (nvl->val.hashed)
+		return __nvl_hfirst(&nvl->val);
+
+	if (nvl->val.persistent)
+		return __nvl_pfirst(&nvl->val);
+
+	if (nvl->val.small)
+		return __nvl_sfirst(&nvl->val);
+
+	return rb_first(nvl->val._set_nvl.values);
 }
 
 const struct nvpair *nvl_iter_next(struct nvlist *nvl,
 				   const struct nvpair *prev)
 {
-	return rb_next(&nvl->val._set_nvl.values, (void *) prev);
+	if (nvl->val.hashed)
+		return __nvl_hnext(&nvl->val, prev);
+
+	if (nvl->val.persistent)
+		return __nvl_pnext(&nvl->val, prev);
+
+	if (nvl->val.small)
+		return __nvl_snext(&nvl->val, prev);
+
+	return rb_next(nvl->val._set_nvl.values, (void *) prev);
 }
 
 /*
@@ -75,35 +152,54 @@ const struct nvpair *nvl_iter_next(struct nvlist *nvl,
 int fxn(struct nvlist *nvl, const char *name, ctype *out)		\
 {									\
 	return pairfxn(find(nvl, name), out);				\
+}									\
+int fxn##_key(struct nvlist *nvl, const struct nvl_key *key,		\
+	      ctype *out)						\
+{									\
+	return pairfxn(find_key(nvl, key), out);			\
 }
 
 #define LOOKUP_PTR(fxn, ctype, pairfxn)					\
 ctype fxn(struct nvlist *nvl, const char *name)				\
 {									\
 	return pairfxn(find(nvl, name));				\
+}									\
+ctype fxn##_key(struct nvlist *nvl, const struct nvl_key *key)		\
+{									\
+	return pairfxn(find_key(nvl, key));				\
 }
 
-const struct nvpair *nvl_lookup(struct nvlist *nvl, const char *name)
+static inline const struct nvpair *pair_or_enoent(const struct nvpair *pair)
 {
-	struct nvpair *pair;
-
-	pair = find(nvl, name);
-
 	return pair ? pair : ERR_PTR(-ENOENT);
 }
 
+LOOKUP_PTR(nvl_lookup, const struct nvpair *, pair_or_enoent);
+
 int nvl_lookup_array(struct nvlist *nvl, const char *name,
 		     struct val ***vals, size_t *nelem)
 {
 	return nvpair_value_array(find(nvl, name), vals, nelem);
 }
 
+int nvl_lookup_array_key(struct nvlist *nvl, const struct nvl_key *key,
+			 struct val ***vals, size_t *nelem)
+{
+	return nvpair_value_array(find_key(nvl, key), vals, nelem);
+}
+
 int nvl_lookup_blob(struct nvlist *nvl, const char *name,
 		    const void **ptr, size_t *size)
 {
 	return nvpair_value_blob(find(nvl, name), ptr, size);
 }
 
+int nvl_lookup_blob_key(struct nvlist *nvl, const struct nvl_key *key,
+			const void **ptr, size_t *size)
+{
+	return nvpair_value_blob(find_key(nvl, key), ptr, size);
+}
+
 LOOKUP_INT(nvl_lookup_bool, bool, nvpair_value_bool);
 LOOKUP_INT(nvl_lookup_int, uint64_t, nvpair_value_int);
 
@@ -112,28 +208,91 @@ int nvl_lookup_null(struct nvlist *nvl, const char *name)
 	return nvpair_value_null(find(nvl, name));
 }
 
+int nvl_lookup_null_key(struct nvlist *nvl, const struct nvl_key *key)
+{
+	return nvpair_value_null(find_key(nvl, key));
+}
+
 LOOKUP_PTR(nvl_lookup_nvl, struct nvlist *, nvpair_value_nvl);
+LOOKUP_PTR(nvl_lookup_nvl_noref, struct nvlist *, nvpair_value_nvl_noref);
 LOOKUP_PTR(nvl_lookup_str, struct str *, nvpair_value_str);
+LOOKUP_PTR(nvl_lookup_str_noref, struct str *, nvpair_value_str_noref);
 
 /*
  * nvlist set
  */
 
-static inline int do_nvl_set(struct nvlist *nvl, const char *cname,
-			     struct str *name, struct val *val)
+/* consumes name's reference */
+static struct nvpair *add_pair(struct mem_arena *arena, struct val *nvl,
+			       struct str *name)
+{
+	struct nvpair *pair;
+	int ret;
+
+	if (IS_ERR(name))
+		return ERR_CAST(name);
+
+	if (nvl->small) {
+		if (nvl->_set_nvl.npairs < NVL_SMALL_PAIRS)
+			return __nvl_sadd(arena, nvl, name);
+
+		ret = __nvl_sconvert(arena, nvl);
+		if (ret) {
+			str_putref(name);
+			return ERR_PTR(ret);
+		}
+	}
+
+	pair = __nvpair_alloc(arena, name);
+	if (!pair)
+		return ERR_PTR(-ENOMEM);
+
+	if (nvl->hashed) {
+		ret = __nvl_hinsert(nvl, pair);
+		if (ret) {
+			__nvpair_free(pair);
+			return ERR_PTR(ret);
+		}
+	} else {
+		struct rb_tree *tree = nvl->_set_nvl.values;
+
+		rb_add(tree, pair);
+
+		/*
+		 * Big nvlists are looked up far more often than they are
+		 * iterated over, so switch to a hash table.  (Arena
+		 * allocated nvlists stay as they are - the table would
+		 * outlive the arena.)  If the switch fails, we just keep
+		 * using the tree.
+		 */
+		if (!__nvl_in_arena(nvl) &&
+		    (rb_numnodes(tree) >= NVL_HASH_MIN_PAIRS))
+			(void) __nvl_hconvert(nvl);
+	}
+
+	return pair;
+}
+
+static inline int do_nvl_set(struct mem_arena *arena, struct nvlist *nvl,
+			     const char *cname, struct str *name,
+			     struct val *val)
 {
 	struct nvpair *pair;
 
+	if (nvl->val.persistent) {
+		str_putref(name);
+		val_putref(val);
+		return -EROFS;
+	}
+
 	pair = find(nvl, cname);
 	if (!pair) {
-		/* not found - allocate a new pair */
-		pair = __nvpair_alloc(name ? name : str_dup(cname));
-		if (!pair) {
+		/* not found - add a new pair */
+		pair = add_pair(arena, &nvl->val, name ? name : str_dup(cname));
+		if (IS_ERR(pair)) {
 			val_putref(val);
-			return -ENOMEM;
+			return PTR_ERR(pair);
 		}
-
-		rb_add(&nvl->val._set_nvl.values, pair);
 	} else {
 		str_putref(name);
 	}
@@ -146,13 +305,146 @@ static inline int do_nvl_set(struct nvlist *nvl, const char *cname,
 
 int nvl_set_pair(struct nvlist *nvl, const struct nvpair *value)
 {
-	return do_nvl_set(nvl, nvpair_name(value), nvpair_name_str(value),
+	return do_nvl_set(NULL, nvl, nvpair_name(value), nvpair_name_str(value),
 			  nvpair_value(value));
 }
 
 int nvl_set(struct nvlist *nvl, const char *name, struct val *val)
 {
-	return do_nvl_set(nvl, name, NULL, val);
+	return do_nvl_set(NULL, nvl, name, NULL, val);
+}
+
+/* name must be allocated from the arena as well */
+int __nvl_set_arena(struct mem_arena *arena, struct nvlist *nvl,
+		    struct str *name, struct val *val)
+{
+	return do_nvl_set(arena, nvl, str_cstr(name), name, val);
+}
+
+/*
+ * nvlist bulk set
+ */
+
+/* we can build the nvlist directly only if it is empty & the input sorted */
+static bool can_build(struct nvlist *nvl, struct str **names, size_t npairs)
+{
+	size_t i;
+
+	/* small nvlists are cheap to fill one pair at a time */
+	if (!nvl->val.small || nvl->val._set_nvl.npairs ||
+	    (npairs <= NVL_SMALL_PAIRS))
+		return false;
+
+	for (i = 1; i < npairs; i++)
+		if (str_cmp(names[i - 1], names[i]) >= 0)
+			return false;
+
+	return true;
+}
+
+static int build_tree(struct mem_arena *arena, struct val *nvl,
+		      struct nvpair **pairs, size_t npairs)
+{
+	struct rb_tree *tree;
+
+	tree = __nvl_alloc_tree(arena);
+	if (!tree)
+		return -ENOMEM;
+
+	rb_build(tree, (void **) pairs, npairs);
+
+	if (!__nvl_in_arena(nvl))
+		__nvl_sfree_empty(nvl->_set_nvl.small);
+
+	nvl->small = false;
+	nvl->_set_nvl.values = tree;
+
+	free(pairs);
+
+	return 0;
+}
+
+/* returns true if the nvlist was built */
+static bool build(struct mem_arena *arena, struct nvlist *nvl,
+		  struct str **names, struct val **vals, size_t npairs)
+{
+	struct nvpair **pairs;
+	size_t i;
+	int ret;
+
+	pairs = mem_reallocarray(NULL, npairs, sizeof(struct nvpair *));
+	if (!pairs)
+		return false;
+
+	for (i = 0; i < npairs; i++) {
+		pairs[i] = __nvpair_alloc(arena, NULL);
+		if (!pairs[i])
+			goto err;
+
+		pairs[i]->name = names[i];
+		pairs[i]->value = vals[i];
+	}
+
+	if (!__nvl_in_arena(&nvl->val) && (npairs >= NVL_HASH_MIN_PAIRS))
+		ret = __nvl_hbuild(&nvl->val, pairs, npairs);
+	else
+		ret = build_tree(arena, &nvl->val, pairs, npairs);
+	if (!ret)
+		return true;
+
+err:
+	/* the caller still owns the names & values */
+	while (i--) {
+		pairs[i]->name = NULL;
+		pairs[i]->value = VAL_ALLOC_NULL();
+
+		if (!arena)
+			__nvpair_free(pairs[i]);
+	}
+
+	free(pairs);
+
+	return false;
+}
+
+static int do_nvl_set_bulk(struct mem_arena *arena, struct nvlist *nvl,
+			   struct str **names, struct val **vals,
+			   size_t npairs)
+{
+	size_t i;
+	int ret;
+
+	if (can_build(nvl, names, npairs) &&
+	    build(arena, nvl, names, vals, npairs))
+		return 0;
+
+	/* fall back to adding one pair at a time */
+	ret = 0;
+	for (i = 0; i < npairs; i++) {
+		if (ret) {
+			str_putref(names[i]);
+			val_putref(vals[i]);
+			continue;
+		}
+
+		ret = do_nvl_set(arena, nvl, str_cstr(names[i]), names[i],
+				 vals[i]);
+	}
+
+	return ret;
+}
+
+int nvl_set_bulk(struct nvlist *nvl, struct str **names, struct val **vals,
+		 size_t npairs)
+{
+	return do_nvl_set_bulk(NULL, nvl, names, vals, npairs);
+}
+
+/* names must be allocated from the arena as well */
+int __nvl_set_bulk_arena(struct mem_arena *arena, struct nvlist *nvl,
+			 struct str **names, struct val **vals, size_t npairs)
+{
+	return do_nvl_set_bulk(arena, nvl, names, vals, npairs);
 }
 
 #define SET(nvl, name, valalloc)					\
@@ -204,6 +496,9 @@ static int unset(struct nvlist *nvl, const char *name, enum val_type type,
 {
 	struct nvpair *pair;
 
+	if (nvl->val.persistent)
+		return -EROFS;
+
 	pair = find(nvl, name);
 	if (!pair)
 		return -ENOENT;
@@ -211,7 +506,15 @@ static int unset(struct nvlist *nvl, const char *name, enum val_type type,
 	if (matchtype && (pair->value->type != type))
 		return -ERANGE;
 
-	rb_remove(&nvl->val._set_nvl.values, pair);
+	if (nvl->val.small) {
+		__nvl_sremove(&nvl->val, pair);
+		return 0;
+	}
+
+	if (nvl->val.hashed)
+		__nvl_hremove(&nvl->val, pair);
+	else
+		rb_remove(nvl->val._set_nvl.values, pair);
 
 	__nvpair_free(pair);
 
@@ -324,7 +627,9 @@ int nvpair_value_null(const struct nvpair *pair)
 }
 
 VALUE_PTR(nvpair_value_nvl, struct nvlist *, VT_NVL, val_getref_nvl);
+VALUE_PTR(nvpair_value_nvl_noref, struct nvlist *, VT_NVL, val_cast_to_nvl);
 VALUE_PTR(nvpair_value_str, struct str *, VT_STR, val_getref_str);
+VALUE_PTR(nvpair_value_str_noref, struct str *, VT_STR, val_cast_to_str);
 
 /*
  * Packing & unpacking
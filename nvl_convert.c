@@ -51,7 +51,11 @@ static int cvt_string(struct nvlist *nvl, const struct nvpair *pair,
 
 	ASSERT3U(nvpair_type(pair), ==, VT_STR);
 
-	str = nvpair_value_str(pair);
+	/*
+	 * We don't need a reference - we're done with the string by the
+	 * time we replace the pair's value.
+	 */
+	str = nvpair_value_str_noref(pair);
 	if (IS_ERR(str)) {
 		VERIFY3S(PTR_ERR(str), !=, -ENOENT);
 		VERIFY3S(PTR_ERR(str), !=, -ERANGE);
@@ -60,10 +64,8 @@ static int cvt_string(struct nvlist *nvl, const struct nvpair *pair,
 
 	/* check if the specified condition is true */
 	ret = check_condition_str(str, cond);
-	if (ret != 0) {
-		str_putref(str);
+	if (ret != 0)
 		return (ret == -EBUSY) ? 0 : ret;
-	}
 
 	switch (tgt) {
 		case VT_ARRAY:
@@ -91,8 +93,6 @@ static int cvt_string(struct nvlist *nvl, const struct nvpair *pair,
 			break;
 	}
 
-	str_putref(str);
-
 	return ret;
 }
 
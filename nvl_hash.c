@@ -0,0 +1,480 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include <jeffpc/error.h>
+#include <jeffpc/mem.h>
+#include <jeffpc/nvl.h>
+
+#include "val_impl.h"
+
+/*
+ * Hashed nvlists
+ *
+ * A hashed nvlist keeps its pairs in an open addressing hash table with
+ * linear probing.  Each slot holds the hash of the name along with the
+ * pair so that most mismatches can be rejected without touching the pair
+ * itself.  Removal shifts the following entries back instead of leaving
+ * tombstones behind.
+ *
+ * Names are hashed with hash_str, so whoever picks the names (e.g., a
+ * remote peer) can't know which of them collide and force long probe
+ * sequences.
+ *
+ * The table has no order, so the first time an nvlist is iterated over,
+ * we sort the pairs into an array which is kept around until the set of
+ * names changes.  Iteration does not modify the nvlist as far as the
+ * caller is concerned, so multiple threads may iterate at the same time -
+ * the sorted array is published atomically and the loser of a race simply
+ * frees its copy.
+ */
+
+#define HTAB_MIN_SLOTS		32
+
+struct nvl_hslot {
+	uint32_t hash;
+	struct nvpair *pair;	/* NULL if the slot is free */
+};
+
+struct nvl_htab {
+	struct nvl_hslot *slots;
+	size_t nslots;			/* always a power of 2 */
+
+	/* iteration */
+	struct nvpair **sorted;		/* NULL if not (yet) sorted */
+	size_t iter_hint;		/* index of the last returned pair */
+};
+
+static inline struct nvl_htab *get_htab(struct val *val)
+{
+	ASSERT(val->hashed);
+
+	return val->_set_nvl.htab;
+}
+
+static inline uint32_t pair_hash(const struct nvpair *pair)
+{
+	return __strsym_hash(str_cast_to_val(pair->name));
+}
+
+static void invalidate_sorted(struct nvl_htab *htab)
+{
+	free(htab->sorted);
+	htab->sorted = NULL;
+}
+
+/* put a pair into the first free slot of its probe sequence */
+static void place(struct nvl_hslot *slots, size_t nslots, uint32_t hash,
+		  struct nvpair *pair)
+{
+	size_t idx;
+
+	for (idx = hash & (nslots - 1);
+	     slots[idx].pair;
+	     idx = (idx + 1) & (nslots - 1))
+		;
+
+	slots[idx].hash = hash;
+	slots[idx].pair = pair;
+}
+
+static int resize(struct nvl_htab *htab, size_t nslots)
+{
+	struct nvl_hslot *slots;
+	size_t i;
+
+	slots = mem_recallocarray(NULL, 0, nslots, sizeof(struct nvl_hslot));
+	if (!slots)
+		return -ENOMEM;
+
+	for (i = 0; i < htab->nslots; i++)
+		if (htab->slots[i].pair)
+			place(slots, nslots, htab->slots[i].hash,
+			      htab->slots[i].pair);
+
+	free(htab->slots);
+
+	htab->slots = slots;
+	htab->nslots = nslots;
+
+	return 0;
+}
+
+static struct nvl_htab *htab_alloc(size_t nslots)
+{
+	struct nvl_htab *htab;
+
+	htab = malloc(sizeof(struct nvl_htab));
+	if (!htab)
+		return NULL;
+
+	htab->slots = NULL;
+	htab->nslots = 0;
+	htab->sorted = NULL;
+	htab->iter_hint = 0;
+
+	if (resize(htab, MAX(nslots, HTAB_MIN_SLOTS))) {
+		free(htab);
+		return NULL;
+	}
+
+	return htab;
+}
+
+struct nvlist *nvl_alloc_hashed(void)
+{
+	struct nvl_htab *htab;
+	struct val *val;
+
+	htab = htab_alloc(0);
+	if (!htab)
+		return ERR_PTR(-ENOMEM);
+
+	val = __val_alloc(VT_NVL);
+	if (IS_ERR(val)) {
+		free(htab->slots);
+		free(htab);
+		return ERR_CAST(val);
+	}
+
+	val->hashed = true;
+	val->_set_nvl.htab = htab;
+	val->_set_nvl.npairs = 0;
+
+	return val_cast_to_nvl(val);
+}
+
+/* switch a tree based nvlist to a hash table */
+int __nvl_hconvert(struct val *val)
+{
+	struct rb_tree *tree = val->_set_nvl.values;
+	struct rb_cookie cookie;
+	struct nvl_htab *htab;
+	struct nvpair *pair;
+	size_t nslots;
+	size_t npairs;
+
+	ASSERT(!val->hashed);
+	ASSERT(!val->persistent);
+	ASSERT(!val->small);
+
+	npairs = rb_numnodes(tree);
+
+	/* start with the load factor at or under 50% */
+	for (nslots = HTAB_MIN_SLOTS; nslots < (npairs * 2); nslots *= 2)
+		;
+
+	htab = htab_alloc(nslots);
+	if (!htab)
+		return -ENOMEM;
+
+	memset(&cookie, 0, sizeof(struct rb_cookie));
+	while ((pair = rb_destroy_nodes(tree, &cookie)))
+		place(htab->slots, htab->nslots, pair_hash(pair), pair);
+
+	__nvl_free_tree(tree);
+
+	val->hashed = true;
+	val->_set_nvl.htab = htab;
+	val->_set_nvl.npairs = npairs;
+
+	return 0;
+}
+
+/*
+ * Switch an empty small nvlist to a hash table holding the given pairs.
+ * The pairs must be sorted by name - the array becomes the table's sorted
+ * iteration array.
+ */
+int __nvl_hbuild(struct val *val, struct nvpair **pairs, size_t npairs)
+{
+	struct nvl_htab *htab;
+	size_t nslots;
+	size_t i;
+
+	ASSERT(val->small);
+	ASSERT0(val->_set_nvl.npairs);
+	ASSERT(!__nvl_in_arena(val));
+
+	/* start with the load factor at or under 50% */
+	for (nslots = HTAB_MIN_SLOTS; nslots < (npairs * 2); nslots *= 2)
+		;
+
+	htab = htab_alloc(nslots);
+	if (!htab)
+		return -ENOMEM;
+
+	for (i = 0; i < npairs; i++)
+		place(htab->slots, htab->nslots, pair_hash(pairs[i]),
+		      pairs[i]);
+
+	htab->sorted = pairs;
+
+	__nvl_sfree_empty(val->_set_nvl.small);
+
+	val->small = false;
+	val->hashed = true;
+	val->_set_nvl.htab = htab;
+	val->_set_nvl.npairs = npairs;
+
+	return 0;
+}
+
+/* the reference count is already reused by val_free */
+void __nvl_hfree(struct val *val, struct val **todo)
+{
+	struct nvl_htab *htab = get_htab(val);
+	size_t i;
+
+	for (i = 0; i < htab->nslots; i++)
+		if (htab->slots[i].pair)
+			__nvpair_free_todo(htab->slots[i].pair, todo);
+
+	free(htab->sorted);
+	free(htab->slots);
+	free(htab);
+}
+
+/*
+ * Lookup
+ */
+
+static inline struct nvl_hslot *find_slot(struct nvl_htab *htab,
+					  const char *name, size_t len,
+					  uint32_t hash)
+{
+	size_t idx;
+
+	for (idx = hash & (htab->nslots - 1);
+	     htab->slots[idx].pair;
+	     idx = (idx + 1) & (htab->nslots - 1)) {
+		struct nvl_hslot *slot = &htab->slots[idx];
+
+		if ((slot->hash == hash) &&
+		    (str_len(slot->pair->name) == len) &&
+		    !memcmp(str_cstr(slot->pair->name), name, len))
+			return slot;
+	}
+
+	return NULL;
+}
+
+struct nvpair *__nvl_hfind(struct val *val, const struct nvl_key *key)
+{
+	struct nvl_hslot *slot;
+
+	slot = find_slot(get_htab(val), key->name, key->len, key->hash);
+
+	return slot ? slot->pair : NULL;
+}
+
+/*
+ * Insertion & removal
+ */
+
+int __nvl_hinsert(struct val *val, struct nvpair *pair)
+{
+	struct nvl_htab *htab = get_htab(val);
+	size_t npairs = val->_set_nvl.npairs;
+
+	/* keep the load factor under 75% */
+	if ((npairs + 1) * 4 > htab->nslots * 3) {
+		int ret;
+
+		ret = resize(htab, htab->nslots * 2);
+		if (ret)
+			return ret;
+	}
+
+	place(htab->slots, htab->nslots, pair_hash(pair), pair);
+
+	val->_set_nvl.npairs++;
+
+	invalidate_sorted(htab);
+
+	return 0;
+}
+
+void __nvl_hremove(struct val *val, struct nvpair *pair)
+{
+	struct nvl_htab *htab = get_htab(val);
+	const size_t mask = htab->nslots - 1;
+	size_t hole;
+	size_t idx;
+
+	for (hole = pair_hash(pair) & mask;
+	     htab->slots[hole].pair != pair;
+	     hole = (hole + 1) & mask)
+		ASSERT(htab->slots[hole].pair);
+
+	/*
+	 * Shift back any following entries that would become unreachable
+	 * with the hole in their probe sequence.
+	 */
+	for (idx = (hole + 1) & mask; htab->slots[idx].pair;
+	     idx = (idx + 1) & mask) {
+		size_t home = htab->slots[idx].hash & mask;
+
+		/* is home cyclically in (hole, idx]?  if so, leave it */
+		if (((idx - home) & mask) < ((idx - hole) & mask))
+			continue;
+
+		htab->slots[hole] = htab->slots[idx];
+		hole = idx;
+	}
+
+	htab->slots[hole].pair = NULL;
+
+	val->_set_nvl.npairs--;
+
+	invalidate_sorted(htab);
+}
+
+/*
+ * Iteration
+ */
+
+static int pair_cmp(const void *a, const void *b)
+{
+	const struct nvpair * const *pa = a;
+	const struct nvpair * const *pb = b;
+
+	return str_cmp((*pa)->name, (*pb)->name);
+}
+
+static struct nvpair **get_sorted(struct val *val)
+{
+	struct nvl_htab *htab = get_htab(val);
+	struct nvpair **sorted;
+	struct nvpair **old;
+	size_t i, j;
+
+	sorted = __atomic_load_n(&htab->sorted, __ATOMIC_ACQUIRE);
+	if (sorted)
+		return sorted;
+
+	sorted = mem_reallocarray(NULL, val->_set_nvl.npairs,
+				  sizeof(struct nvpair *));
+	if (!sorted)
+		return NULL;
+
+	for (i = 0, j = 0; i < htab->nslots; i++)
+		if (htab->slots[i].pair)
+			sorted[j++] = htab->slots[i].pair;
+
+	qsort(sorted, j, sizeof(struct nvpair *), pair_cmp);
+
+	old = NULL;
+	if (!__atomic_compare_exchange_n(&htab->sorted, &old, sorted, false,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		/* someone else beat us to it */
+		free(sorted);
+		sorted = old;
+	}
+
+	return sorted;
+}
+
+/*
+ * Iteration can't fail, so if we can't allocate the sorted array, we
+ * fall back to an O(n) scan of the table for each step.
+ */
+static const struct nvpair *scan_next(struct val *val,
+				      const struct nvpair *prev)
+{
+	struct nvl_htab *htab = get_htab(val);
+	const struct nvpair *best = NULL;
+	size_t i;
+
+	for (i = 0; i < htab->nslots; i++) {
+		const struct nvpair *cur = htab->slots[i].pair;
+
+		if (!cur)
+			continue;
+
+		if (prev && (str_cmp(cur->name, prev->name) <= 0))
+			continue;
+
+		if (!best || (str_cmp(cur->name, best->name) < 0))
+			best = cur;
+	}
+
+	return best;
+}
+
+const struct nvpair *__nvl_hfirst(struct val *val)
+{
+	struct nvpair **sorted;
+
+	if (!val->_set_nvl.npairs)
+		return NULL;
+
+	sorted = get_sorted(val);
+	if (!sorted)
+		return scan_next(val, NULL);
+
+	__atomic_store_n(&get_htab(val)->iter_hint, 0, __ATOMIC_RELAXED);
+
+	return sorted[0];
+}
+
+const struct nvpair *__nvl_hnext(struct val *val, const struct nvpair *prev)
+{
+	struct nvl_htab *htab = get_htab(val);
+	size_t npairs = val->_set_nvl.npairs;
+	struct nvpair **sorted;
+	size_t lo, hi;
+	size_t idx;
+
+	sorted = get_sorted(val);
+	if (!sorted)
+		return scan_next(val, prev);
+
+	/* the hint is only a guess, so a racy access is fine */
+	idx = __atomic_load_n(&htab->iter_hint, __ATOMIC_RELAXED);
+	if ((idx >= npairs) || (sorted[idx] != prev)) {
+		/* find the first pair past prev */
+		lo = 0;
+		hi = npairs;
+
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+
+			if (str_cmp(sorted[mid]->name, prev->name) <= 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		idx = lo;
+	} else {
+		idx++;
+	}
+
+	if (idx >= npairs)
+		return NULL;
+
+	__atomic_store_n(&htab->iter_hint, idx, __ATOMIC_RELAXED);
+
+	return sorted[idx];
+}
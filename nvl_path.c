@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include <jeffpc/error.h>
+#include <jeffpc/nvl.h>
+
+struct nvl_path_step {
+	bool is_idx;
+	size_t idx;		/* if is_idx */
+	struct nvl_key key;	/* unless is_idx */
+};
+
+struct nvl_path {
+	char *names;		/* the names, each NUL terminated */
+	size_t nsteps;
+	struct nvl_path_step steps[];
+};
+
+/*
+ * Path compilation
+ */
+
+static int parse_idx(char **p, size_t *out)
+{
+	char *cur = *p;
+	size_t idx = 0;
+
+	if (*cur == ']')
+		return -EINVAL; /* empty */
+
+	for (; *cur != ']'; cur++) {
+		unsigned digit;
+
+		if ((*cur < '0') || (*cur > '9'))
+			return -EINVAL;
+
+		digit = *cur - '0';
+
+		if (idx > ((SIZE_MAX - digit) / 10))
+			return -EINVAL; /* overflow */
+
+		idx = idx * 10 + digit;
+	}
+
+	*p = cur + 1; /* skip the ] */
+	*out = idx;
+
+	return 0;
+}
+
+static int parse(struct nvl_path *path)
+{
+	char *p = path->names;
+
+	for (;;) {
+		struct nvl_path_step *step;
+		char *name = p;
+		char delim;
+		int ret;
+
+		p += strcspn(p, ".[]");
+		if (p == name)
+			return -EINVAL; /* empty name */
+
+		delim = *p;
+		*p = '\0';
+
+		step = &path->steps[path->nsteps++];
+		step->is_idx = false;
+		nvl_key_init(&step->key, name);
+
+		while (delim == '[') {
+			p++;
+
+			step = &path->steps[path->nsteps++];
+			step->is_idx = true;
+
+			ret = parse_idx(&p, &step->idx);
+			if (ret)
+				return ret;
+
+			delim = *p;
+		}
+
+		if (delim == '\0')
+			return 0;
+
+		if (delim != '.')
+			return -EINVAL;
+
+		p++;
+	}
+}
+
+struct nvl_path *nvl_path_compile(const char *str)
+{
+	struct nvl_path *path;
+	size_t maxsteps;
+	const char *tmp;
+	int ret;
+
+	/* every step starts with a . or a [, except for the first one */
+	maxsteps = 1;
+	for (tmp = str; *tmp; tmp++)
+		if ((*tmp == '.') || (*tmp == '['))
+			maxsteps++;
+
+	path = malloc(sizeof(struct nvl_path) +
+		      maxsteps * sizeof(struct nvl_path_step));
+	if (!path)
+		return ERR_PTR(-ENOMEM);
+
+	path->names = strdup(str);
+	path->nsteps = 0;
+	if (!path->names) {
+		free(path);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	ret = parse(path);
+	if (ret) {
+		nvl_path_free(path);
+		return ERR_PTR(ret);
+	}
+
+	ASSERT3U(path->nsteps, <=, maxsteps);
+
+	return path;
+}
+
+void nvl_path_free(struct nvl_path *path)
+{
+	if (!path)
+		return;
+
+	free(path->names);
+	free(path);
+}
+
+/*
+ * Path evaluation
+ */
+
+struct val *nvl_path_lookup(struct nvlist *nvl, const struct nvl_path *path)
+{
+	struct val *cur = nvl_cast_to_val(nvl);
+	size_t i;
+
+	for (i = 0; i < path->nsteps; i++) {
+		const struct nvl_path_step *step = &path->steps[i];
+
+		if (step->is_idx) {
+			if (cur->type != VT_ARRAY)
+				return ERR_PTR(-ERANGE);
+
+			if (step->idx >= cur->array.nelem)
+				return ERR_PTR(-ENOENT);
+
+			cur = cur->array.vals[step->idx];
+		} else {
+			const struct nvpair *pair;
+
+			if (cur->type != VT_NVL)
+				return ERR_PTR(-ERANGE);
+
+			pair = nvl_lookup_key(val_cast_to_nvl(cur), &step->key);
+			if (IS_ERR(pair))
+				return ERR_CAST(pair);
+
+			cur = pair->value;
+		}
+	}
+
+	return cur;
+}
+
+#define LOOKUP_INT(fxn, ctype, valtype, valmember)			\
+int fxn(struct nvlist *nvl, const struct nvl_path *path, ctype *out)	\
+{									\
+	struct val *val;						\
+									\
+	val = nvl_path_lookup(nvl, path);				\
+	if (IS_ERR(val))						\
+		return PTR_ERR(val);					\
+									\
+	if (val->type != valtype)					\
+		return -ERANGE;						\
+									\
+	*out = val->valmember;						\
+									\
+	return 0;							\
+}
+
+#define LOOKUP_PTR(fxn, ctype, valtype, cast)				\
+ctype fxn(struct nvlist *nvl, const struct nvl_path *path)		\
+{									\
+	struct val *val;						\
+									\
+	val = nvl_path_lookup(nvl, path);				\
+	if (IS_ERR(val))						\
+		return ERR_CAST(val);					\
+									\
+	if (val->type != valtype)					\
+		return ERR_PTR(-ERANGE);				\
+									\
+	return cast(val);						\
+}
+
+LOOKUP_INT(nvl_path_lookup_bool, bool, VT_BOOL, b);
+LOOKUP_INT(nvl_path_lookup_int, uint64_t, VT_INT, i);
+LOOKUP_PTR(nvl_path_lookup_nvl_noref, struct nvlist *, VT_NVL,
+	   val_cast_to_nvl);
+LOOKUP_PTR(nvl_path_lookup_str_noref, struct str *, VT_STR,
+	   val_cast_to_str);
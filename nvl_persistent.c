@@ -0,0 +1,463 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <jeffpc/error.h>
+#include <jeffpc/mem.h>
+#include <jeffpc/nvl.h>
+#include <jeffpc/rand.h>
+
+#include "val_impl.h"
+
+/*
+ * Persistent nvlists
+ *
+ * A persistent nvlist is a treap of reference counted nodes.  Once a node
+ * is reachable from an nvlist, it is never modified, so any number of
+ * nvlists can share it.  Changing a persistent nvlist copies the nodes on
+ * the path from the root to the key being changed (O(log n) of them) and
+ * shares everything else with the original.
+ *
+ * Node priorities are random (from a per-thread generator seeded from the
+ * system's random number source).  Deriving them from the names would
+ * let anyone picking the names build a degenerate, linear-depth tree.
+ * A node keeps its priority when it gets copied or replaced.
+ *
+ * All the functions below that build trees are free to modify the nodes
+ * they allocate until they return them.
+ */
+
+struct nvl_pnode {
+	struct nvpair pair;
+	struct nvl_pnode *child[2];
+	refcnt_t refcnt;
+	uint32_t prio;
+};
+
+static struct mem_cache *pnode_cache;
+
+static void __attribute__((constructor)) init_nvl_persistent_subsys(void)
+{
+	pnode_cache = mem_cache_create("nvl-pnode-cache",
+				       sizeof(struct nvl_pnode), 0);
+	ASSERT(!IS_ERR(pnode_cache));
+}
+
+static void pnode_free(struct nvl_pnode *node, struct val **todo);
+
+static void pnode_free_all(struct nvl_pnode *node)
+{
+	struct val *todo = NULL;
+
+	pnode_free(node, &todo);
+
+	__val_free_todo(todo);
+}
+
+REFCNT_INLINE_FXNS(struct nvl_pnode, pnode, refcnt, pnode_free_all, NULL);
+
+/* like pnode_putref, but dead values are added to the todo list */
+static void pnode_putref_todo(struct nvl_pnode *node, struct val **todo)
+{
+	if (!node)
+		return;
+
+	if (__refcnt_dead(&node->refcnt))
+		panic("%s(%p) called with zero refcount", __func__, node);
+
+	if (__refcnt_dec(&node->refcnt, node, pnode__refcnt_free))
+		pnode_free(node, todo);
+}
+
+/*
+ * Recursion depth is bounded by the height of the tree, which is
+ * logarithmic with high probability thanks to the random priorities.
+ */
+static void pnode_free(struct nvl_pnode *node, struct val **todo)
+{
+	__val_putref_todo(str_cast_to_val(node->pair.name), todo);
+	__val_putref_todo(node->pair.value, todo);
+
+	pnode_putref_todo(node->child[0], todo);
+	pnode_putref_todo(node->child[1], todo);
+
+	mem_cache_free(pnode_cache, node);
+}
+
+/* always consumes the name and the value */
+static struct nvl_pnode *pnode_alloc(struct str *name, struct val *value,
+				     uint32_t prio)
+{
+	struct nvl_pnode *node;
+
+	node = mem_cache_alloc(pnode_cache);
+	if (!node) {
+		str_putref(name);
+		val_putref(value);
+		return NULL;
+	}
+
+	node->pair.name = name;
+	node->pair.value = value;
+	node->child[0] = NULL;
+	node->child[1] = NULL;
+	node->prio = prio;
+
+	refcnt_init(&node->refcnt, 1);
+
+	return node;
+}
+
+/* xorshift64* - we need something fast, not cryptographically strong */
+static uint32_t random_prio(void)
+{
+	static __thread uint64_t state;
+
+	if (!state)
+		state = rand64() | 1;
+
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+
+	return (state * 0x2545f4914f6cdd1dull) >> 32;
+}
+
+/* copy a node, replacing one of its children; always consumes the child */
+static struct nvl_pnode *pnode_copy(struct nvl_pnode *node, int dir,
+				    struct nvl_pnode *child)
+{
+	struct nvl_pnode *copy;
+
+	copy = pnode_alloc(str_getref(node->pair.name),
+			   val_getref(node->pair.value), node->prio);
+	if (!copy) {
+		pnode_putref(child);
+		return NULL;
+	}
+
+	copy->child[dir] = child;
+	copy->child[!dir] = pnode_getref(node->child[!dir]);
+
+	return copy;
+}
+
+/* should a be above b? */
+static inline bool higher(const struct nvl_pnode *a, const struct nvl_pnode *b)
+{
+	if (a->prio != b->prio)
+		return a->prio > b->prio;
+
+	return str_cmp(a->pair.name, b->pair.name) < 0;
+}
+
+/*
+ * Return a new tree with the new node added to (or replacing a node in)
+ * the given tree.  Always consumes the new node.
+ */
+static struct nvl_pnode *tree_insert(struct nvl_pnode *node,
+				struct nvl_pnode *newnode, bool *replaced)
+{
+	struct nvl_pnode *child;
+	struct nvl_pnode *copy;
+	int cmp;
+	int dir;
+
+	if (!node)
+		return newnode;
+
+	cmp = str_cmp(newnode->pair.name, node->pair.name);
+	if (!cmp) {
+		/* take over the priority and the children */
+		newnode->prio = node->prio;
+		newnode->child[0] = pnode_getref(node->child[0]);
+		newnode->child[1] = pnode_getref(node->child[1]);
+		*replaced = true;
+		return newnode;
+	}
+
+	dir = cmp > 0;
+
+	child = tree_insert(node->child[dir], newnode, replaced);
+	if (IS_ERR(child))
+		return child;
+
+	if (!higher(child, node)) {
+		copy = pnode_copy(node, dir, child);
+		return copy ? copy : ERR_PTR(-ENOMEM);
+	}
+
+	/* the (new) child has to be rotated above this node */
+	copy = pnode_copy(node, dir, child->child[!dir]);
+	child->child[!dir] = copy;
+	if (!copy) {
+		pnode_putref(child);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	return child;
+}
+
+/* return a new tree with all the nodes of the two given trees */
+static struct nvl_pnode *tree_join(struct nvl_pnode *left,
+				   struct nvl_pnode *right)
+{
+	struct nvl_pnode *child;
+	struct nvl_pnode *copy;
+
+	if (!left)
+		return pnode_getref(right);
+	if (!right)
+		return pnode_getref(left);
+
+	if (higher(left, right)) {
+		child = tree_join(left->child[1], right);
+		if (IS_ERR(child))
+			return child;
+
+		copy = pnode_copy(left, 1, child);
+	} else {
+		child = tree_join(left, right->child[0]);
+		if (IS_ERR(child))
+			return child;
+
+		copy = pnode_copy(right, 0, child);
+	}
+
+	return copy ? copy : ERR_PTR(-ENOMEM);
+}
+
+/* return a new tree without the named node */
+static struct nvl_pnode *tree_remove(struct nvl_pnode *node,
+				     const struct str *name)
+{
+	struct nvl_pnode *child;
+	struct nvl_pnode *copy;
+	int cmp;
+	int dir;
+
+	if (!node)
+		return ERR_PTR(-ENOENT);
+
+	cmp = str_cmp(name, node->pair.name);
+	if (!cmp)
+		return tree_join(node->child[0], node->child[1]);
+
+	dir = cmp > 0;
+
+	child = tree_remove(node->child[dir], name);
+	if (IS_ERR(child))
+		return child;
+
+	copy = pnode_copy(node, dir, child);
+
+	return copy ? copy : ERR_PTR(-ENOMEM);
+}
+
+/* always consumes the root */
+static struct nvlist *alloc_pnvl(struct nvl_pnode *root, size_t npairs)
+{
+	struct val *val;
+
+	val = __val_alloc(VT_NVL);
+	if (IS_ERR(val)) {
+		pnode_putref(root);
+		return ERR_CAST(val);
+	}
+
+	val->persistent = true;
+	val->_set_nvl.root = root;
+	val->_set_nvl.npairs = npairs;
+
+	return val_cast_to_nvl(val);
+}
+
+/*
+ * Build a treap out of the pairs of a regular nvlist.  Since the pairs
+ * come out sorted, we only need to keep track of the right spine of the
+ * tree built so far.
+ */
+static struct nvlist *persist(struct nvlist *nvl)
+{
+	const struct nvpair *pair;
+	struct nvl_pnode **spine;
+	struct nvl_pnode *root;
+	size_t npairs;
+	size_t depth;
+
+	npairs = __nvl_numpairs(&nvl->val);
+	if (!npairs)
+		return alloc_pnvl(NULL, 0);
+
+	spine = mem_reallocarray(NULL, npairs, sizeof(struct nvl_pnode *));
+	if (!spine)
+		return ERR_PTR(-ENOMEM);
+
+	depth = 0;
+
+	nvl_for_each(pair, nvl) {
+		struct nvl_pnode *node;
+		struct nvl_pnode *last;
+
+		node = pnode_alloc(nvpair_name_str(pair), nvpair_value(pair),
+				   random_prio());
+		if (!node) {
+			if (depth)
+				pnode_putref(spine[0]);
+			free(spine);
+			return ERR_PTR(-ENOMEM);
+		}
+
+		last = NULL;
+		while (depth && higher(node, spine[depth - 1]))
+			last = spine[--depth];
+
+		node->child[0] = last;
+
+		if (depth)
+			spine[depth - 1]->child[1] = node;
+
+		spine[depth++] = node;
+	}
+
+	root = spine[0];
+
+	free(spine);
+
+	return alloc_pnvl(root, npairs);
+}
+
+struct nvlist *nvl_persist(struct nvlist *nvl)
+{
+	if (nvl->val.persistent)
+		return nvl_getref(nvl);
+
+	return persist(nvl);
+}
+
+struct nvlist *nvl_pset(struct nvlist *nvl, const char *name, struct val *val)
+{
+	struct nvl_pnode *newnode;
+	struct nvl_pnode *root;
+	bool replaced;
+	struct str *str;
+
+	if (!nvl->val.persistent) {
+		val_putref(val);
+		return ERR_PTR(-EINVAL);
+	}
+
+	str = str_dup(name);
+	if (IS_ERR(str)) {
+		val_putref(val);
+		return ERR_CAST(str);
+	}
+
+	newnode = pnode_alloc(str, val, random_prio());
+	if (!newnode)
+		return ERR_PTR(-ENOMEM);
+
+	replaced = false;
+
+	root = tree_insert(nvl->val.nvl.root, newnode, &replaced);
+	if (IS_ERR(root))
+		return ERR_CAST(root);
+
+	return alloc_pnvl(root, nvl->val.nvl.npairs + (replaced ? 0 : 1));
+}
+
+struct nvlist *nvl_punset(struct nvlist *nvl, const char *name)
+{
+	struct str name_str = STR_STATIC_INITIALIZER(name);
+	struct nvl_pnode *root;
+
+	if (!nvl->val.persistent)
+		return ERR_PTR(-EINVAL);
+
+	root = tree_remove(nvl->val.nvl.root, &name_str);
+	if (IS_ERR(root))
+		return ERR_CAST(root);
+
+	return alloc_pnvl(root, nvl->val.nvl.npairs - 1);
+}
+
+/*
+ * Hooks for the generic nvlist code
+ */
+
+struct nvpair *__nvl_pfind(struct val *val, const struct str *name)
+{
+	struct nvl_pnode *node;
+
+	node = val->nvl.root;
+	while (node) {
+		int cmp;
+
+		cmp = str_cmp(name, node->pair.name);
+		if (!cmp)
+			return &node->pair;
+
+		node = node->child[cmp > 0];
+	}
+
+	return NULL;
+}
+
+struct nvpair *__nvl_pfirst(struct val *val)
+{
+	struct nvl_pnode *node;
+
+	node = val->nvl.root;
+	if (!node)
+		return NULL;
+
+	while (node->child[0])
+		node = node->child[0];
+
+	return &node->pair;
+}
+
+/* there are no parent pointers, so we search for the successor */
+struct nvpair *__nvl_pnext(struct val *val, const struct nvpair *prev)
+{
+	struct nvl_pnode *succ;
+	struct nvl_pnode *node;
+
+	succ = NULL;
+
+	node = val->nvl.root;
+	while (node) {
+		if (str_cmp(prev->name, node->pair.name) < 0) {
+			succ = node;
+			node = node->child[0];
+		} else {
+			node = node->child[1];
+		}
+	}
+
+	return succ ? &succ->pair : NULL;
+}
+
+/* the reference count is already reused by val_free */
+void __nvl_pfree(struct val *val, struct val **todo)
+{
+	pnode_putref_todo(val->_set_nvl.root, todo);
+}
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <jeffpc/error.h>
+#include <jeffpc/mem.h>
+#include <jeffpc/nvl.h>
+
+#include "val_impl.h"
+
+/*
+ * Small nvlists
+ *
+ * The pairs stay in whichever slot they were added to - only the order
+ * array (which keeps the used slots sorted by name) gets shuffled around.
+ * That way, pointers to the pairs remain valid when other pairs are added
+ * or removed - until the nvlist switches to a tree, which moves all the
+ * pairs.  With so few pairs, a linear search beats the tree.
+ *
+ * The array is allocated when the first pair is added.  Until then, the
+ * pointer is NULL and the nvlist has no pairs.
+ */
+
+static struct mem_cache *nvl_small_cache;
+
+static void __attribute__((constructor)) init_nvl_small_subsys(void)
+{
+	nvl_small_cache = mem_cache_create("nvl-small-cache",
+					   sizeof(struct nvl_small), 0);
+	ASSERT(!IS_ERR(nvl_small_cache));
+}
+
+/* NULL if no pair was ever added */
+static inline struct nvl_small *get_small(struct val *val)
+{
+	ASSERT(val->small);
+
+	return val->_set_nvl.small;
+}
+
+struct nvl_small *__nvl_salloc(struct mem_arena *arena)
+{
+	struct nvl_small *small;
+	size_t i;
+
+	if (arena)
+		small = mem_arena_alloc(arena, sizeof(struct nvl_small));
+	else
+		small = mem_cache_alloc(nvl_small_cache);
+	if (!small)
+		return NULL;
+
+	for (i = 0; i < NVL_SMALL_PAIRS; i++)
+		small->pairs[i].name = NULL;
+
+	return small;
+}
+
+/* the array must be empty */
+void __nvl_sfree_empty(struct nvl_small *small)
+{
+	if (small)
+		mem_cache_free(nvl_small_cache, small);
+}
+
+/* the reference count is already reused by val_free */
+void __nvl_sfree(struct val *val, struct val **todo)
+{
+	struct nvl_small *small = get_small(val);
+	size_t i;
+
+	for (i = 0; i < val->_set_nvl.npairs; i++) {
+		struct nvpair *pair = &small->pairs[small->order[i]];
+
+		__val_putref_todo(str_cast_to_val(pair->name), todo);
+		__val_putref_todo(pair->value, todo);
+	}
+
+	__nvl_sfree_empty(small);
+}
+
+struct nvpair *__nvl_sfind(struct val *val, const struct nvl_key *key)
+{
+	struct nvl_small *small = get_small(val);
+	size_t i;
+
+	for (i = 0; i < val->_set_nvl.npairs; i++) {
+		struct nvpair *pair = &small->pairs[small->order[i]];
+		const struct val *name = str_cast_to_val(pair->name);
+
+		/* most names have their hash cached */
+		if (name->hash_valid && (name->hash != key->hash))
+			continue;
+
+		if ((str_len(pair->name) == key->len) &&
+		    !memcmp(str_cstr(pair->name), key->name, key->len))
+			return pair;
+	}
+
+	return NULL;
+}
+
+const struct nvpair *__nvl_sfirst(struct val *val)
+{
+	struct nvl_small *small = get_small(val);
+
+	if (!val->_set_nvl.npairs)
+		return NULL;
+
+	return &small->pairs[small->order[0]];
+}
+
+static size_t order_idx(struct val *val, const struct nvpair *pair)
+{
+	struct nvl_small *small = get_small(val);
+	size_t slot = pair - small->pairs;
+	size_t i;
+
+	for (i = 0; i < val->_set_nvl.npairs; i++)
+		if (small->order[i] == slot)
+			return i;
+
+	panic("%s: pair %p is not in nvlist %p", __func__, pair, val);
+}
+
+const struct nvpair *__nvl_snext(struct val *val, const struct nvpair *prev)
+{
+	struct nvl_small *small = get_small(val);
+	size_t i;
+
+	i = order_idx(val, prev) + 1;
+	if (i >= val->_set_nvl.npairs)
+		return NULL;
+
+	return &small->pairs[small->order[i]];
+}
+
+/* there must be a free slot; consumes the name */
+struct nvpair *__nvl_sadd(struct mem_arena *arena, struct val *val,
+			  struct str *name)
+{
+	struct nvl_small *small = get_small(val);
+	size_t npairs = val->_set_nvl.npairs;
+	struct nvpair *pair;
+	size_t slot;
+	size_t i;
+
+	ASSERT3U(npairs, <, NVL_SMALL_PAIRS);
+
+	if (!small) {
+		small = __nvl_salloc(arena);
+		if (!small) {
+			str_putref(name);
+			return ERR_PTR(-ENOMEM);
+		}
+
+		val->_set_nvl.small = small;
+	}
+
+	for (slot = 0; small->pairs[slot].name; slot++)
+		;
+
+	/* find where in the order the new pair goes */
+	for (i = 0; i < npairs; i++)
+		if (str_cmp(small->pairs[small->order[i]].name, name) > 0)
+			break;
+
+	memmove(&small->order[i + 1], &small->order[i], npairs - i);
+	small->order[i] = slot;
+
+	pair = &small->pairs[slot];
+	pair->name = name;
+	pair->value = VAL_ALLOC_NULL(); /* see __nvpair_alloc */
+
+	val->_set_nvl.npairs++;
+
+	return pair;
+}
+
+void __nvl_sremove(struct val *val, struct nvpair *pair)
+{
+	struct nvl_small *small = get_small(val);
+	size_t i;
+
+	i = order_idx(val, pair);
+
+	memmove(&small->order[i], &small->order[i + 1],
+		val->_set_nvl.npairs - i - 1);
+
+	val->_set_nvl.npairs--;
+
+	str_putref(pair->name);
+	val_putref(pair->value);
+
+	pair->name = NULL;
+}
+
+/* switch to a tree */
+int __nvl_sconvert(struct mem_arena *arena, struct val *val)
+{
+	struct nvl_small *small = get_small(val);
+	size_t npairs = val->_set_nvl.npairs;
+	struct nvpair *pairs[NVL_SMALL_PAIRS];
+	struct rb_tree *tree;
+	size_t i;
+
+	/* allocate everything up front so that we can back out */
+	tree = __nvl_alloc_tree(arena);
+	if (!tree)
+		return -ENOMEM;
+
+	for (i = 0; i < npairs; i++) {
+		pairs[i] = __nvpair_alloc(arena, NULL);
+		if (pairs[i])
+			continue;
+
+		/* arena allocations go away with the arena */
+		if (!arena) {
+			while (i--)
+				__nvpair_free(pairs[i]);
+
+			__nvl_free_tree(tree);
+		}
+
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < npairs; i++) {
+		struct nvpair *spair = &small->pairs[small->order[i]];
+
+		pairs[i]->name = spair->name;
+		pairs[i]->value = spair->value;
+
+		rb_add(tree, pairs[i]);
+	}
+
+	if (!__nvl_in_arena(val))
+		__nvl_sfree_empty(small);
+
+	val->small = false;
+	val->_set_nvl.values = tree;
+
+	return 0;
+}
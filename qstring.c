@@ -24,6 +24,8 @@
 #include <jeffpc/urldecode.h>
 #include <jeffpc/error.h>
 
+#include "val_impl.h"
+
 /*
  * The query string is a sequence of name-value pairs.  Each name is
  * separated from the value with a '=', and each pair is separated by '&'.
@@ -34,43 +36,67 @@
  *	foo=		->	{ "foo" : "" }
  *	foo		->	{ "foo" : null }
  *	=bar		->	{ "" : "bar" }
+ *
+ * Instead of allocating each name and value separately, we decode all of
+ * them into a single copy of the query string.  Since decoding never makes
+ * the input longer, each decoded name and value fits where it was in the
+ * input and there is always room for a nul terminator (where the following
+ * '=' or '&' was).  The strings in the nvlist are slices of this copy.
  */
 
+struct qs_buf {
+	const char *qs;		/* the input */
+	char *data;		/* the decoded copy */
+	struct val *val;	/* blob owning the copy */
+};
+
 enum qs_state {
 	QS_STATE_NAME,
 	QS_STATE_VAL,
 };
 
-static int insert(struct nvlist *nvl, const char *namestart, size_t namelen,
-		  const char *valstart, size_t vallen)
+static struct str *decode(struct qs_buf *buf, const char *start, size_t len)
 {
-	char name[namelen + 1];
+	size_t off = start - buf->qs;
 	ssize_t newlen;
 
-	/* decode & nul-terminate the name */
-	newlen = urldecode(namestart, namelen, name);
+	newlen = urldecode(start, len, &buf->data[off]);
 	if (newlen < 0)
-		return newlen;
+		return ERR_PTR(newlen);
 
-	name[newlen] = '\0';
+	buf->data[off + newlen] = '\0';
+
+	return str_slice(val_getref(buf->val), off, newlen);
+}
+
+static int insert(struct nvlist *nvl, struct qs_buf *buf,
+		  const char *namestart, size_t namelen,
+		  const char *valstart, size_t vallen)
+{
+	struct str *name;
+	struct val *val;
+
+	name = decode(buf, namestart, namelen);
+	if (IS_ERR(name))
+		return PTR_ERR(name);
 
 	if (!valstart) {
 		/* we want a null value */
-		return nvl_set_null(nvl, name);
+		val = val_alloc_null();
 	} else {
 		/* we want a string value (possibly empty string) */
-		struct str *val;
+		struct str *str;
 
-		if (!vallen)
-			val = str_empty_string();
-		else
-			val = urldecode_str(valstart, vallen);
-
-		if (IS_ERR(val))
-			return PTR_ERR(val);
+		str = decode(buf, valstart, vallen);
+		if (IS_ERR(str)) {
+			str_putref(name);
+			return PTR_ERR(str);
+		}
 
-		return nvl_set_str(nvl, name, val);
+		val = str_cast_to_val(str);
 	}
+
+	return __nvl_set_arena(NULL, nvl, name, val);
 }
 
 int qstring_parse_len(struct nvlist *nvl, const char *qs, size_t len)
@@ -80,16 +106,26 @@ int qstring_parse_len(struct nvlist *nvl, const char *qs, size_t len)
 	const char *val;
 	size_t name_len;
 	enum qs_state state;
+	struct qs_buf buf;
 
 	if (!nvl)
 		return -EINVAL;
 
-	if (!len && !qs)
+	if (!len)
 		return 0;
 
 	if (!qs)
 		return -EINVAL;
 
+	buf.qs = qs;
+	buf.data = malloc(len + 1);
+	if (!buf.data)
+		return -ENOMEM;
+
+	buf.val = val_alloc_blob(buf.data, len + 1);
+	if (IS_ERR(buf.val))
+		return PTR_ERR(buf.val);
+
 	end = qs + len;
 	cur = qs;
 
@@ -110,7 +146,7 @@ int qstring_parse_len(struct nvlist *nvl, const char *qs, size_t len)
 				state = QS_STATE_VAL;
 			} else if (c == '&') {
 				/* end of name; no value */
-				insert(nvl, name, cur - name, NULL, 0);
+				insert(nvl, &buf, name, cur - name, NULL, 0);
 
 				name = cur + 1;
 				state = QS_STATE_NAME; /* no change */
@@ -118,12 +154,13 @@ int qstring_parse_len(struct nvlist *nvl, const char *qs, size_t len)
 		} else if (state == QS_STATE_VAL) {
 			if (c == '&') {
 				/* end of value */
-				insert(nvl, name, name_len, val, cur - val);
+				insert(nvl, &buf, name, name_len, val, cur - val);
 
 				name = cur + 1;
 				state = QS_STATE_NAME;
 			} else if (c == '=') {
 				/* value contains = */
+				val_putref(buf.val);
 				return -EILSEQ;
 			}
 		}
@@ -131,13 +168,15 @@ int qstring_parse_len(struct nvlist *nvl, const char *qs, size_t len)
 
 	/* qs ends with a name without a '=' (e.g., abc=def&ghi) */
 	if ((state == QS_STATE_NAME) && (name < end))
-		insert(nvl, name, end - name, NULL, 0);
+		insert(nvl, &buf, name, end - name, NULL, 0);
 	/* qs ends with an empty value (e.g., abc=def&ghi=) */
 	if ((state == QS_STATE_VAL) && (val == end))
-		insert(nvl, name, name_len, val, 0);
+		insert(nvl, &buf, name, name_len, val, 0);
 	/* qs ends with a value (e.g., abc=def&ghi=jkl) */
 	if ((state == QS_STATE_VAL) && (val < end))
-		insert(nvl, name, name_len, val, end - val);
+		insert(nvl, &buf, name, name_len, val, end - val);
+
+	val_putref(buf.val);
 
 	return 0;
 }
@@ -68,29 +68,56 @@ void rb_add(struct rb_tree *tree, void *item)
 		      __func__, tree, item);
 }
 
-static void rb_rotate(struct tree_tree *tree, struct tree_node *node,
-		      enum tree_dir left)
+/*
+ * Splitting at the median at every level fills all levels but the deepest,
+ * so coloring just the deepest level red keeps the black height the same
+ * along every path.
+ */
+static struct tree_node *build(struct tree_tree *tree, void **items,
+			       size_t nitems, size_t depth, size_t red_depth)
 {
-	const enum tree_dir right = 1 - left;
-	struct tree_node *tmp;
+	struct tree_node *node;
+	struct tree_node *left;
+	struct tree_node *right;
+	size_t mid;
 
-	ASSERT3P(node->children[right], !=, NULL);
+	if (!nitems)
+		return NULL;
 
-	tmp = node->children[right];
-	node->children[right] = tmp->children[left];
+	mid = nitems / 2;
 
-	if (tmp->children[left])
-		set_parent(tmp->children[left], node);
+	left = build(tree, items, mid, depth + 1, red_depth);
+	right = build(tree, items + mid + 1, nitems - mid - 1, depth + 1,
+		      red_depth);
 
-	set_parent(tmp, get_parent(node));
-	if (!get_parent(node)) {
-		tree->root = tmp;
-	} else {
-		get_parent(node)->children[which_dir(get_parent(node), node)] = tmp;
-	}
+	node = obj2node(tree, items[mid]);
+	node->children[TREE_LEFT] = left;
+	node->children[TREE_RIGHT] = right;
+	set_parent(node, NULL);
+	set_red(node, depth == red_depth);
+
+	if (left)
+		set_parent(left, node);
+	if (right)
+		set_parent(right, node);
+
+	return node;
+}
+
+void rb_build(struct rb_tree *_tree, void **items, size_t nitems)
+{
+	struct tree_tree *tree = &_tree->tree;
+	size_t depth;
+
+	ASSERT(tree_is_empty(tree));
+
+	/* the depth of the deepest level */
+	for (depth = 0; nitems >> (depth + 1); depth++)
+		;
 
-	tmp->children[left] = node;
-	set_parent(node, tmp);
+	/* a lone root must stay black */
+	tree->root = build(tree, items, nitems, 0, depth ? depth : SIZE_MAX);
+	tree->num_nodes = nitems;
 }
 
 void *rb_insert_here(struct rb_tree *tree, void *newitem,
@@ -147,8 +174,8 @@ void *rb_insert_here(struct rb_tree *tree, void *newitem,
 				 * This doesn't fix anything, but it sets up
 				 * the tree for the rotation that follows.
 				 */
-				rb_rotate(&tree->tree, parent,
-					  1 - which_dir(parent, node));
+				tree_rotate(&tree->tree, parent,
+					    1 - which_dir(parent, node));
 
 				node = parent;
 				parent  = get_parent(node);
@@ -165,8 +192,8 @@ void *rb_insert_here(struct rb_tree *tree, void *newitem,
 				 *   /                       \
 				 *  N                         U
 				 */
-				rb_rotate(&tree->tree, gparent,
-					  1 - which_dir(parent, node));
+				tree_rotate(&tree->tree, gparent,
+					    1 - which_dir(parent, node));
 			}
 
 			set_red(parent, false);
@@ -210,7 +237,7 @@ void rb_remove(struct rb_tree *_tree, void *item)
 		if (is_red(sibling)) {
 			set_red(sibling, false);
 			set_red(parent, true);
-			rb_rotate(tree, parent, left);
+			tree_rotate(tree, parent, left);
 			sibling = parent->children[right];
 		}
 
@@ -222,14 +249,14 @@ void rb_remove(struct rb_tree *_tree, void *item)
 			if (!is_red(sibling->children[right])) {
 				set_red(sibling->children[left], false);
 				set_red(sibling, true);
-				rb_rotate(tree, sibling, right);
+				tree_rotate(tree, sibling, right);
 				sibling = parent->children[right];
 			}
 
 			set_red(sibling, is_red(parent));
 			set_red(parent, false);
 			set_red(sibling->children[right], false);
-			rb_rotate(tree, parent, left);
+			tree_rotate(tree, parent, left);
 			node = tree->root;
 		}
 
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+
+#include <jeffpc/refcnt.h>
+#include <jeffpc/error.h>
+
+/*
+ * The slow paths of the biased reference counting.  See refcnt.h.
+ *
+ * Thread ids get reused.  An object can outlive its owner, in which case
+ * it is still biased towards the owner's id.  While the id is unused,
+ * threads releasing such an object merge the counters themselves.  Once a
+ * new thread picks up the id, it simply becomes the new owner of all those
+ * objects - it is the only thread touching their biased counters.
+ *
+ * The global lock protects the thread table and the free ids, and it
+ * orders the hand-off of an id from the exiting thread to the next one.
+ * Each thread's queue has its own lock.
+ *
+ * Like the slab allocator, we use plain pthread mutexes - objects get
+ * released with all sorts of locks held and we don't want lockdep to
+ * record a dependency on every one of them.
+ */
+
+#define MAX_THREADS	4096
+
+struct queued {
+	struct queued *next;
+	refcnt_t *refcnt;
+	void *obj;
+	void (*freefxn)(void *);
+};
+
+struct refcnt_thread {
+	pthread_mutex_t lock;
+	struct queued *queue;
+	struct __refcnt_tls *tls;
+	uint16_t tid;
+};
+
+__thread struct __refcnt_tls __refcnt_tls
+	__attribute__((tls_model("initial-exec"))) = {
+	.tid = __REFCNT_TID_UNSET,
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct refcnt_thread *threads[MAX_THREADS]; /* NULL if id unused */
+static uint16_t free_tids[MAX_THREADS];
+static size_t nfree_tids;
+static uint32_t next_tid = 1; /* id 0 means that the object isn't owned */
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+
+/*
+ * Merge the counters of a queued object.  Must be called by the owner (or
+ * with the global lock held if the owner's id is unused).  Returns true if
+ * the object should be freed.
+ */
+static bool merge(refcnt_t *x)
+{
+	uint32_t delta;
+	uint32_t v;
+
+	delta = -__REFCNT_QUEUED;
+
+	/* it might have been merged after it got queued */
+	if (x->owner) {
+		delta += (x->biased * __REFCNT_ONE) + __REFCNT_MERGED;
+
+		__atomic_store_n(&x->biased, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&x->owner, 0, __ATOMIC_RELAXED);
+	}
+
+	v = atomic_add(&x->shared, delta);
+
+	return !__REFCNT_COUNT(v);
+}
+
+static void drain(struct queued *cur)
+{
+	struct queued *next;
+
+	for (; cur; cur = next) {
+		next = cur->next;
+
+		if (merge(cur->refcnt))
+			cur->freefxn(cur->obj);
+
+		free(cur);
+	}
+}
+
+static struct queued *take_queue(struct refcnt_thread *thread)
+{
+	struct queued *queue;
+
+	VERIFY0(pthread_mutex_lock(&thread->lock));
+	queue = thread->queue;
+	thread->queue = NULL;
+	__atomic_store_n(&__refcnt_tls.pending.v, 0, __ATOMIC_RELAXED);
+	VERIFY0(pthread_mutex_unlock(&thread->lock));
+
+	return queue;
+}
+
+void __refcnt_drain(void)
+{
+	/* our own entry can't go away from under us */
+	drain(take_queue(threads[__refcnt_tls.tid]));
+}
+
+static void thread_fini(void *arg)
+{
+	struct refcnt_thread *thread = arg;
+	struct queued *queue;
+
+	/*
+	 * Once our entry is gone, threads releasing objects we own merge
+	 * them themselves.
+	 */
+	VERIFY0(pthread_mutex_lock(&lock));
+	threads[thread->tid] = NULL;
+	queue = take_queue(thread);
+	VERIFY0(pthread_mutex_unlock(&lock));
+
+	/* from now on, anything we allocate or release isn't biased */
+	__refcnt_tls.tid = __REFCNT_TID_NONE;
+
+	drain(queue);
+
+	/* only now can another thread take over the objects we own */
+	VERIFY0(pthread_mutex_lock(&lock));
+	free_tids[nfree_tids++] = thread->tid;
+	VERIFY0(pthread_mutex_unlock(&lock));
+
+	VERIFY0(pthread_mutex_destroy(&thread->lock));
+	free(thread);
+}
+
+static void key_init(void)
+{
+	VERIFY0(pthread_key_create(&key, thread_fini));
+}
+
+uint16_t __refcnt_thread_init(void)
+{
+	struct refcnt_thread *thread;
+	uint32_t tid;
+
+	__refcnt_tls.tid = __REFCNT_TID_NONE;
+
+	VERIFY0(pthread_once(&key_once, key_init));
+
+	thread = malloc(sizeof(struct refcnt_thread));
+	if (!thread)
+		return __REFCNT_TID_NONE;
+
+	VERIFY0(pthread_mutex_init(&thread->lock, NULL));
+	thread->queue = NULL;
+	thread->tls = &__refcnt_tls;
+
+	if (pthread_setspecific(key, thread))
+		goto err;
+
+	VERIFY0(pthread_mutex_lock(&lock));
+	if (nfree_tids)
+		tid = free_tids[--nfree_tids];
+	else if (next_tid < MAX_THREADS)
+		tid = next_tid++;
+	else
+		tid = 0;
+
+	if (tid) {
+		thread->tid = tid;
+		threads[tid] = thread;
+	}
+	VERIFY0(pthread_mutex_unlock(&lock));
+
+	if (!tid) {
+		VERIFY0(pthread_setspecific(key, NULL));
+		goto err;
+	}
+
+	__refcnt_tls.tid = tid;
+
+	return tid;
+
+err:
+	VERIFY0(pthread_mutex_destroy(&thread->lock));
+	free(thread);
+
+	return __REFCNT_TID_NONE;
+}
+
+bool __refcnt_queue(refcnt_t *x, void *obj, void (*freefxn)(void *))
+{
+	struct refcnt_thread *thread;
+	struct queued *q;
+	bool ret;
+
+	/* only the first thread to get here queues the object */
+	if (__atomic_fetch_or(&x->shared.v, __REFCNT_QUEUED,
+			      __ATOMIC_SEQ_CST) & __REFCNT_QUEUED)
+		return false;
+
+	q = malloc(sizeof(struct queued));
+
+	VERIFY0(pthread_mutex_lock(&lock));
+
+	thread = threads[__refcnt_owner(x)];
+	if (!thread) {
+		/* the owner is gone, merge the counters ourselves */
+		ret = merge(x);
+
+		VERIFY0(pthread_mutex_unlock(&lock));
+
+		free(q);
+
+		return ret;
+	}
+
+	VERIFY0(pthread_mutex_lock(&thread->lock));
+	VERIFY0(pthread_mutex_unlock(&lock));
+
+	if (!q) {
+		/*
+		 * We can't tell the owner about the object.  Leaking it is
+		 * better than freeing it while it might still be in use.
+		 */
+		ret = false;
+	} else {
+		q->next = thread->queue;
+		q->refcnt = x;
+		q->obj = obj;
+		q->freefxn = freefxn;
+
+		thread->queue = q;
+		__atomic_store_n(&thread->tls->pending.v, 1, __ATOMIC_RELAXED);
+
+		q = NULL;
+		ret = false;
+	}
+
+	VERIFY0(pthread_mutex_unlock(&thread->lock));
+
+	free(q);
+
+	return ret;
+}
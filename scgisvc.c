@@ -30,6 +30,8 @@
 #include <jeffpc/scgi.h>
 #include <jeffpc/qstring.h>
 
+#include "val_impl.h"
+
 struct scgiargs {
 	const struct scgiops *ops;
 	void *private;
@@ -38,6 +40,12 @@ struct scgiargs {
 static struct mem_cache *scgisvc_cache;
 static atomic_t scgi_request_ids;
 
+/* headers looked up for every request */
+static struct nvl_key key_scgi;
+static struct nvl_key key_content_length;
+static struct nvl_key key_request_method;
+static struct nvl_key key_query_string;
+
 static void scgi_free(struct scgi *req, bool init_failed);
 
 static void __attribute__((constructor)) init_scgisvc_subsys(void)
@@ -45,6 +53,11 @@ static void __attribute__((constructor)) init_scgisvc_subsys(void)
 	scgisvc_cache = mem_cache_create("scgisvc-cache",
 					 sizeof(struct scgi), 0);
 	ASSERT(!IS_ERR(scgisvc_cache));
+
+	nvl_key_init(&key_scgi, "SCGI");
+	nvl_key_init(&key_content_length, SCGI_CONTENT_LENGTH);
+	nvl_key_init(&key_request_method, SCGI_REQUEST_METHOD);
+	nvl_key_init(&key_query_string, SCGI_QUERY_STRING);
 }
 
 /*
@@ -80,27 +93,53 @@ static int read_netstring_length(struct scgi *req, size_t *len)
 	}
 }
 
+static int set_header(struct scgi *req, struct val *bufval, const char *buf,
+		      const char *name, size_t namelen,
+		      const char *val, size_t vallen)
+{
+	struct str *n, *v;
+
+	n = str_slice(val_getref(bufval), name - buf, namelen);
+	if (IS_ERR(n))
+		return PTR_ERR(n);
+
+	v = str_slice(val_getref(bufval), val - buf, vallen);
+	if (IS_ERR(v)) {
+		str_putref(n);
+		return PTR_ERR(v);
+	}
+
+	return __nvl_set_arena(NULL, req->request.headers, n,
+			       str_cast_to_val(v));
+}
+
 static int read_netstring_string(struct scgi *req, size_t len)
 {
+	struct val *bufval;
 	char *cur, *end;
 	char *buf;
 	int ret;
 
 	/*
-	 * Receive the string.
+	 * Receive the string.  The header names and values are slices of
+	 * it, so it is reference counted instead of living in the arena.
 	 */
 
 	buf = malloc(len + 1);
 	if (!buf)
 		return -ENOMEM;
 
+	bufval = val_alloc_blob(buf, len + 1);
+	if (IS_ERR(bufval))
+		return PTR_ERR(bufval);
+
 	ret = xread(req->fd, buf, len + 1);
 	if (ret)
-		goto err;
+		goto out;
 
 	if (buf[len] != ',') {
 		ret = -EINVAL;
-		goto err;
+		goto out;
 	}
 
 	buf[len] = '\0';
@@ -114,21 +153,29 @@ static int read_netstring_string(struct scgi *req, size_t len)
 
 	while (cur < end) {
 		char *name, *val;
-
-		/* TODO: audit this loop for correctness / safety */
+		size_t namelen, vallen;
 
 		name = cur;
-		val = cur + strlen(name) + 1;
+		namelen = strlen(name);
 
-		ret = nvl_set_cstr_dup(req->request.headers, name, val);
+		/* every name must be followed by a value */
+		val = name + namelen + 1;
+		if (val > end) {
+			ret = -EINVAL;
+			break;
+		}
+
+		vallen = strlen(val);
+
+		ret = set_header(req, bufval, buf, name, namelen, val, vallen);
 		if (ret)
 			break;
 
-		cur = val + strlen(val) + 1;
+		cur = val + vallen + 1;
 	}
 
-err:
-	free(buf);
+out:
+	val_putref(bufval);
 
 	return ret;
 }
@@ -167,13 +214,14 @@ static int parse_headers(struct scgi *req)
 	if (ret)
 		return ret;
 
-	ret = nvl_lookup_int(req->request.headers, "SCGI", &i);
+	ret = nvl_lookup_int_key(req->request.headers, &key_scgi, &i);
 	if (ret)
 		return ret;
 	if (i != 1)
 		return -EINVAL;
 
-	ret = nvl_lookup_int(req->request.headers, SCGI_CONTENT_LENGTH, &i);
+	ret = nvl_lookup_int_key(req->request.headers, &key_content_length,
+				 &i);
 	if (ret)
 		return ret;
 	if (i > SIZE_MAX)
@@ -181,7 +229,8 @@ static int parse_headers(struct scgi *req)
 
 	req->request.content_length = i;
 
-	s = nvl_lookup_str(req->request.headers, SCGI_REQUEST_METHOD);
+	s = nvl_lookup_str_noref_key(req->request.headers,
+				     &key_request_method);
 	if (IS_ERR(s))
 		return PTR_ERR(s);
 
@@ -194,8 +243,6 @@ static int parse_headers(struct scgi *req)
 	else
 		req->request.method = SCGI_REQUEST_METHOD_UNKNOWN;
 
-	str_putref(s);
-
 	return 0;
 }
 
@@ -204,18 +251,14 @@ static int parse_qstring(struct scgi *req)
 	struct str *qs;
 	int ret;
 
-	qs = nvl_lookup_str(req->request.headers, SCGI_QUERY_STRING);
+	qs = nvl_lookup_str_noref_key(req->request.headers, &key_query_string);
 	if (IS_ERR(qs)) {
 		ret = PTR_ERR(qs);
 
 		return (ret == -ENOENT) ? 0 : ret;
 	}
 
-	ret = qstring_parse(req->request.query, str_cstr(qs));
-
-	str_putref(qs);
-
-	return ret;
+	return qstring_parse(req->request.query, str_cstr(qs));
 }
 
 static int scgi_read_headers(struct scgi *req)
@@ -241,15 +284,13 @@ static int scgi_read_body(struct scgi *req)
 	if (!req->request.content_length)
 		return 0;
 
-	buf = malloc(req->request.content_length + 1);
+	buf = mem_arena_alloc(req->arena, req->request.content_length + 1);
 	if (!buf)
 		return -ENOMEM;
 
 	ret = xread(req->fd, buf, req->request.content_length);
-	if (ret) {
-		free(buf);
+	if (ret)
 		return ret;
-	}
 
 	buf[req->request.content_length] = '\0';
 
@@ -313,6 +354,13 @@ static struct scgi *scgi_alloc(int fd, struct scgiargs *args)
 	req->fd = fd;
 	req->ops = args->ops;
 
+	req->arena = mem_arena_create();
+	if (IS_ERR(req->arena)) {
+		ret = PTR_ERR(req->arena);
+		req->arena = NULL;
+		goto err;
+	}
+
 	req->request.headers = nvl_alloc();
 	req->request.query = nvl_alloc();
 	req->request.content_length = 0;
@@ -350,6 +398,9 @@ static void scgi_free(struct scgi *req, bool init_failed)
 	nvl_putref(req->request.query);
 	nvl_putref(req->response.headers);
 
+	/* frees the request body & anything else allocated from the arena */
+	mem_arena_destroy(req->arena);
+
 	/* NOTE: Do *not* close the fd, it'll be closed by socksvc */
 
 	mem_cache_free(scgisvc_cache, req);
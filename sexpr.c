@@ -265,7 +265,24 @@ struct val *sexpr_nth(struct val *lv, uint64_t n)
  * So, to check it, we examine the car of the list, if that's not the right
  * key, we recurse on cdr of the list.
  */
-struct val *sexpr_assoc(struct val *lv, const char *name)
+static bool assoc_key_matches(struct val *key, const char *name,
+			      struct sym *sym)
+{
+	switch (key->type) {
+		case VT_STR:
+			return !strcmp(val_cstr(key), name);
+		case VT_SYM:
+			/* interned symbols match only the interned name */
+			if (key->interned)
+				return key == sym_cast_to_val(sym);
+
+			return !strcmp(val_cstr(key), name);
+		default:
+			return false;
+	}
+}
+
+static struct val *assoc(struct val *lv, const char *name, struct sym *sym)
 {
 	struct val *head;
 	struct val *tail;
@@ -290,12 +307,20 @@ struct val *sexpr_assoc(struct val *lv, const char *name)
 	 */
 	if (head && (head->type == VT_CONS) &&
 	    head->cons.head &&
-	    ((head->cons.head->type == VT_STR) ||
-	     (head->cons.head->type == VT_SYM)) &&
-	    !strcmp(val_cstr(head->cons.head), name))
+	    assoc_key_matches(head->cons.head, name, sym))
 		return val_getref(head);
 
-	return sexpr_assoc(tail, name);
+	return assoc(tail, name, sym);
+}
+
+struct val *sexpr_assoc(struct val *lv, const char *name)
+{
+	/*
+	 * Look up the interned symbol once, so that symbol keys can be
+	 * compared by pointer.  If there is no such symbol, no interned
+	 * symbol key can match.
+	 */
+	return assoc(lv, name, sym_lookup(name));
 }
 
 bool sexpr_equal(struct val *lhs, struct val *rhs)
@@ -344,10 +369,13 @@ bool sexpr_equal(struct val *lhs, struct val *rhs)
 			ret = (lhs->i == rhs->i);
 			goto out;
 		case VT_STR:
-		case VT_SYM:
 			ret = str_cmp(val_cast_to_str(lhs),
 				      val_cast_to_str(rhs)) == 0;
 			goto out;
+		case VT_SYM:
+			ret = sym_equal(val_cast_to_sym(lhs),
+					val_cast_to_sym(rhs));
+			goto out;
 		case VT_BOOL:
 			ret = (lhs->b == rhs->b);
 			goto out;
@@ -386,13 +414,13 @@ bool sexpr_equal(struct val *lhs, struct val *rhs)
 			goto out;
 		}
 		case VT_NVL: {
-			struct rb_tree *ltree = &lhs->_set_nvl.values;
-			struct rb_tree *rtree = &rhs->_set_nvl.values;
-			struct nvpair *lcur;
-			struct nvpair *rcur;
+			struct nvlist *lnvl = val_cast_to_nvl(lhs);
+			struct nvlist *rnvl = val_cast_to_nvl(rhs);
+			const struct nvpair *lcur;
+			const struct nvpair *rcur;
 
-			lcur = rb_first(ltree);
-			rcur = rb_first(rtree);
+			lcur = nvl_iter_start(lnvl);
+			rcur = nvl_iter_start(rnvl);
 
 			while (lcur && rcur) {
 				ret = (str_cmp(lcur->name, rcur->name) == 0);
@@ -404,8 +432,8 @@ bool sexpr_equal(struct val *lhs, struct val *rhs)
 				if (!ret)
 					goto out;
 
-				lcur = rb_next(ltree, lcur);
-				rcur = rb_next(rtree, rcur);
+				lcur = nvl_iter_next(lnvl, lcur);
+				rcur = nvl_iter_next(rnvl, rcur);
 			}
 
 			/* if both sides reached the end, then they are equal */
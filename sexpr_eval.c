@@ -28,6 +28,9 @@ struct builtin_fxn {
 
 	/* expected number of arguments; -1 indicates any length is ok */
 	ssize_t arglen;
+
+	/* interned name (set up at startup) */
+	struct sym *sym;
 };
 
 #define __REDUCE(fname, alloc, t, valmember, ctype, ident, op)			\
@@ -155,12 +158,20 @@ static struct builtin_fxn builtins[] = {
 	{ NULL, },
 };
 
+static void __attribute__((constructor)) init_sexpr_eval_subsys(void)
+{
+	size_t i;
+
+	for (i = 0; builtins[i].name; i++)
+		builtins[i].sym = SYM_DUP(builtins[i].name);
+}
+
 static struct builtin_fxn *fxnlookup_builtin(struct sym *name)
 {
 	size_t i;
 
 	for (i = 0; builtins[i].name; i++)
-		if (!strcmp(builtins[i].name, sym_cstr(name)))
+		if (sym_equal(builtins[i].sym, name))
 			return &builtins[i];
 
 	return NULL;
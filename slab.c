@@ -22,61 +22,889 @@
 
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include <jeffpc/error.h>
 #include <jeffpc/mem.h>
+#include <jeffpc/nvl.h>
+#include <jeffpc/atomic.h>
+#include <jeffpc/list.h>
+#include <jeffpc/cstr.h>
+#include <jeffpc/int.h>
+#include <jeffpc/types.h>
 
 /*
- * A slab allocator - well, not really... just use malloc and free directly.
+ * A slab allocator.
+ *
+ * This is a simplified version of the design described by Bonwick in "The
+ * Slab Allocator: An Object-Caching Kernel Memory Allocator" and its
+ * follow-up "Magazines and Vmem: Extending the Slab Allocator to Many CPUs
+ * and Arbitrary Resources".  It is used only when libumem isn't available.
+ *
+ * There are three layers:
+ *
+ * (1) The slab layer carves power-of-two sized, naturally aligned chunks of
+ *     memory (slabs) into objects.  Each slab begins with a header that
+ *     tracks the free objects in it.  Since slabs are aligned to their
+ *     size, an object's slab can be found by masking the object's address.
+ *     Objects that are too large to fit several of them into a reasonably
+ *     sized slab bypass the slab layer and use posix_memalign directly.
+ *
+ * (2) The depot holds magazines - fixed-size stacks of object pointers.
+ *     Full magazines hold free objects, empty magazines hold nothing.
+ *
+ * (3) Each thread has two magazines per cache (the loaded and the previous
+ *     magazine).  Allocations and frees are satisfied from these without
+ *     any locking.  Only when both are empty (on allocation) or full (on
+ *     free) does the thread exchange a magazine with the depot.
+ *
+ * Objects in magazines are constructed, while objects in the slab layer
+ * are not (the slab layer uses the first word of a free object as the
+ * free list linkage).  Therefore, the constructor is called when an object
+ * is allocated from the slab layer and the destructor just before it is
+ * returned to it.
+ *
+ * The depot and the slab layer are protected by two separate mutexes.
+ * They are leaf locks which are never held while calling out of this file.
+ * Therefore, we use plain pthread mutexes instead of struct lock - lockdep
+ * would otherwise record a dependency on every lock class held by any
+ * caller that allocates memory.
+ *
+ * Statistics are kept cheaply: allocation & free counts are per-thread
+ * (and folded into the cache when a thread exits), while the slab layer
+ * counters are protected by the slab lock.  Since objects in magazines
+ * count as in use by the slab layer, the peak is the high-water mark of
+ * objects handed out by the slab layer - an upper bound on the peak number
+ * of live objects.
  */
 
+#define MEM_CACHE_NAME_LEN	32
+
+#define MAGAZINE_ROUNDS		15	/* objects per magazine */
+#define DEPOT_MAX_FULL		64	/* max full magazines in depot */
+
+#define SLAB_MIN_OBJS		8	/* min objects per slab */
+#define SLAB_MAX_SIZE		(64 * 1024)
+
+struct mem_magazine {
+	struct mem_magazine *next;	/* depot list linkage */
+	size_t nrounds;
+	void *rounds[MAGAZINE_ROUNDS];
+};
+
+struct mem_slab {
+	struct list_node node;
+	void *freelist;
+	size_t nused;
+};
+
+/* per-thread, per-cache state */
+struct mem_thread_cache {
+	struct list_node node;
+	struct mem_cache *cache;
+	struct mem_magazine *loaded;
+	struct mem_magazine *prev;
+
+	/* stats */
+	uint64_t allocs;
+	uint64_t frees;
+};
+
 struct mem_cache {
-	size_t size;
+	struct mem_cache *next_cache;	/* list of all caches */
+
+	char name[MEM_CACHE_NAME_LEN];
+	size_t size;		/* object size including padding */
 	size_t align;
+	size_t slab_size;	/* 0 = no slabs, use posix_memalign */
+	size_t slab_objs;	/* objects per slab */
+	size_t slab_off;	/* offset of the first object in a slab */
+
+	int (*ctor)(void *, void *);
+	void (*dtor)(void *, void *);
+	void *priv;
+
+	pthread_key_t key;	/* the thread's struct mem_thread_cache */
+
+	/* depot */
+	pthread_mutex_t depot_lock;
+	struct mem_magazine *depot_full;
+	struct mem_magazine *depot_empty;
+	size_t depot_nfull;
+	struct list threads;	/* all struct mem_thread_caches */
+
+	/* slab layer */
+	pthread_mutex_t slab_lock;
+	struct list slabs_partial; /* slabs with free & used objects */
+	struct list slabs_full;	/* slabs without free objects */
+	struct mem_slab *slab_empty; /* a cached slab without used objects */
+
+	/* stats - protected by the slab lock */
+	size_t nslabs;		/* slabs allocated */
+	size_t nobjs;		/* objects handed out by the slab layer */
+	size_t nobjs_peak;
+
+	/* stats - allocs & frees not accounted for by the thread caches */
+	atomic64_t allocs;
+	atomic64_t frees;
 };
 
-#pragma weak mem_cache_create
-struct mem_cache *mem_cache_create(char *name, size_t size, size_t align)
+/* all caches */
+static pthread_mutex_t caches_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mem_cache *caches;
+
+static void thread_cache_fini(void *arg);
+
+/*
+ * Slab layer
+ */
+
+static inline struct mem_slab *obj2slab(struct mem_cache *cache, void *obj)
+{
+	return (struct mem_slab *) (((uintptr_t) obj) & ~(cache->slab_size - 1));
+}
+
+static struct mem_slab *slab_create(struct mem_cache *cache)
+{
+	struct mem_slab *slab;
+	uint8_t *base;
+	size_t i;
+
+	if (posix_memalign((void **) &slab, cache->slab_size, cache->slab_size))
+		return NULL;
+
+	base = (uint8_t *) slab;
+
+	slab->freelist = NULL;
+	slab->nused = 0;
+
+	/* thread the free list so that it starts with the first object */
+	for (i = cache->slab_objs; i > 0; i--) {
+		void **obj = (void **) (base + cache->slab_off +
+					(i - 1) * cache->size);
+
+		*obj = slab->freelist;
+		slab->freelist = obj;
+	}
+
+	return slab;
+}
+
+/* must be called with the slab lock held */
+static inline void slab_count_alloc(struct mem_cache *cache)
+{
+	cache->nobjs++;
+	cache->nobjs_peak = MAX(cache->nobjs_peak, cache->nobjs);
+}
+
+static void *slab_alloc(struct mem_cache *cache)
+{
+	struct mem_slab *slab;
+	void *obj;
+
+	if (!cache->slab_size) {
+		if (posix_memalign(&obj, cache->align, cache->size))
+			return NULL;
+
+		VERIFY0(pthread_mutex_lock(&cache->slab_lock));
+		slab_count_alloc(cache);
+		VERIFY0(pthread_mutex_unlock(&cache->slab_lock));
+
+		return obj;
+	}
+
+	VERIFY0(pthread_mutex_lock(&cache->slab_lock));
+
+	slab = list_head(&cache->slabs_partial);
+	if (!slab) {
+		slab = cache->slab_empty;
+		cache->slab_empty = NULL;
+
+		if (!slab) {
+			VERIFY0(pthread_mutex_unlock(&cache->slab_lock));
+
+			slab = slab_create(cache);
+			if (!slab)
+				return NULL;
+
+			VERIFY0(pthread_mutex_lock(&cache->slab_lock));
+
+			cache->nslabs++;
+		}
+
+		list_insert_head(&cache->slabs_partial, slab);
+	}
+
+	obj = slab->freelist;
+	slab->freelist = *((void **) obj);
+	slab->nused++;
+
+	slab_count_alloc(cache);
+
+	if (slab->nused == cache->slab_objs) {
+		list_remove(&cache->slabs_partial, slab);
+		list_insert_head(&cache->slabs_full, slab);
+	}
+
+	VERIFY0(pthread_mutex_unlock(&cache->slab_lock));
+
+	return obj;
+}
+
+static void slab_free(struct mem_cache *cache, void *obj)
+{
+	struct mem_slab *slab;
+
+	if (!cache->slab_size) {
+		VERIFY0(pthread_mutex_lock(&cache->slab_lock));
+		cache->nobjs--;
+		VERIFY0(pthread_mutex_unlock(&cache->slab_lock));
+
+		free(obj);
+		return;
+	}
+
+	slab = obj2slab(cache, obj);
+
+	VERIFY0(pthread_mutex_lock(&cache->slab_lock));
+
+	cache->nobjs--;
+
+	ASSERT3U(slab->nused, >, 0);
+
+	*((void **) obj) = slab->freelist;
+	slab->freelist = obj;
+
+	if (slab->nused == cache->slab_objs) {
+		list_remove(&cache->slabs_full, slab);
+		list_insert_head(&cache->slabs_partial, slab);
+	}
+
+	slab->nused--;
+
+	if (slab->nused) {
+		slab = NULL;
+	} else {
+		list_remove(&cache->slabs_partial, slab);
+
+		/* keep one empty slab around to avoid thrashing */
+		if (!cache->slab_empty) {
+			cache->slab_empty = slab;
+			slab = NULL;
+		} else {
+			cache->nslabs--;
+		}
+	}
+
+	VERIFY0(pthread_mutex_unlock(&cache->slab_lock));
+
+	free(slab);
+}
+
+/* allocate a constructed object from the slab layer */
+static void *slab_alloc_constructed(struct mem_cache *cache)
+{
+	void *obj;
+
+	obj = slab_alloc(cache);
+	if (!obj || !cache->ctor)
+		return obj;
+
+	if (cache->ctor(obj, cache->priv)) {
+		slab_free(cache, obj);
+		return NULL;
+	}
+
+	return obj;
+}
+
+/* destruct an object and return it to the slab layer */
+static void slab_free_constructed(struct mem_cache *cache, void *obj)
+{
+	if (cache->dtor)
+		cache->dtor(obj, cache->priv);
+
+	slab_free(cache, obj);
+}
+
+/*
+ * Magazine & depot layer
+ */
+
+static struct mem_magazine *magazine_alloc(void)
+{
+	struct mem_magazine *mag;
+
+	mag = malloc(sizeof(struct mem_magazine));
+	if (!mag)
+		return NULL;
+
+	mag->next = NULL;
+	mag->nrounds = 0;
+
+	return mag;
+}
+
+/* return all the objects in the magazine to the slab layer & free it */
+static void magazine_destroy(struct mem_cache *cache, struct mem_magazine *mag)
+{
+	if (!mag)
+		return;
+
+	while (mag->nrounds)
+		slab_free_constructed(cache, mag->rounds[--mag->nrounds]);
+
+	free(mag);
+}
+
+static inline void magazine_swap(struct mem_thread_cache *tc)
+{
+	struct mem_magazine *tmp;
+
+	tmp = tc->loaded;
+	tc->loaded = tc->prev;
+	tc->prev = tmp;
+}
+
+/* exchange the thread's empty previous magazine for a full one */
+static bool depot_get_full(struct mem_cache *cache, struct mem_thread_cache *tc)
+{
+	struct mem_magazine *full;
+
+	VERIFY0(pthread_mutex_lock(&cache->depot_lock));
+
+	full = cache->depot_full;
+	if (full) {
+		cache->depot_full = full->next;
+		cache->depot_nfull--;
+
+		tc->prev->next = cache->depot_empty;
+		cache->depot_empty = tc->prev;
+
+		tc->prev = tc->loaded;
+		tc->loaded = full;
+	}
+
+	VERIFY0(pthread_mutex_unlock(&cache->depot_lock));
+
+	return full != NULL;
+}
+
+/* exchange the thread's full previous magazine for an empty one */
+static bool depot_get_empty(struct mem_cache *cache,
+			    struct mem_thread_cache *tc)
+{
+	struct mem_magazine *empty;
+
+	VERIFY0(pthread_mutex_lock(&cache->depot_lock));
+
+	if (cache->depot_nfull >= DEPOT_MAX_FULL) {
+		VERIFY0(pthread_mutex_unlock(&cache->depot_lock));
+		return false;
+	}
+
+	empty = cache->depot_empty;
+	if (empty) {
+		cache->depot_empty = empty->next;
+	} else {
+		VERIFY0(pthread_mutex_unlock(&cache->depot_lock));
+
+		empty = magazine_alloc();
+		if (!empty)
+			return false;
+
+		VERIFY0(pthread_mutex_lock(&cache->depot_lock));
+
+		/* the depot may have filled up while we were unlocked */
+		if (cache->depot_nfull >= DEPOT_MAX_FULL) {
+			empty->next = cache->depot_empty;
+			cache->depot_empty = empty;
+			VERIFY0(pthread_mutex_unlock(&cache->depot_lock));
+			return false;
+		}
+	}
+
+	tc->prev->next = cache->depot_full;
+	cache->depot_full = tc->prev;
+	cache->depot_nfull++;
+
+	tc->prev = tc->loaded;
+	tc->loaded = empty;
+
+	VERIFY0(pthread_mutex_unlock(&cache->depot_lock));
+
+	return true;
+}
+
+/*
+ * Per-thread layer
+ */
+
+static struct mem_thread_cache *thread_cache_init(struct mem_cache *cache)
+{
+	struct mem_thread_cache *tc;
+
+	tc = malloc(sizeof(struct mem_thread_cache));
+	if (!tc)
+		return NULL;
+
+	tc->cache = cache;
+	tc->allocs = 0;
+	tc->frees = 0;
+	tc->loaded = magazine_alloc();
+	tc->prev = magazine_alloc();
+
+	if (!tc->loaded || !tc->prev)
+		goto err;
+
+	if (pthread_setspecific(cache->key, tc))
+		goto err;
+
+	VERIFY0(pthread_mutex_lock(&cache->depot_lock));
+	list_insert_tail(&cache->threads, tc);
+	VERIFY0(pthread_mutex_unlock(&cache->depot_lock));
+
+	return tc;
+
+err:
+	free(tc->loaded);
+	free(tc->prev);
+	free(tc);
+
+	return NULL;
+}
+
+/* called on thread exit via the pthread key destructor */
+static void thread_cache_fini(void *arg)
+{
+	struct mem_thread_cache *tc = arg;
+	struct mem_cache *cache = tc->cache;
+
+	VERIFY0(pthread_mutex_lock(&cache->depot_lock));
+	list_remove(&cache->threads, tc);
+	atomic_add(&cache->allocs, tc->allocs);
+	atomic_add(&cache->frees, tc->frees);
+	VERIFY0(pthread_mutex_unlock(&cache->depot_lock));
+
+	magazine_destroy(cache, tc->loaded);
+	magazine_destroy(cache, tc->prev);
+
+	free(tc);
+}
+
+static inline struct mem_thread_cache *get_thread_cache(struct mem_cache *cache)
+{
+	struct mem_thread_cache *tc;
+
+	tc = pthread_getspecific(cache->key);
+	if (tc)
+		return tc;
+
+	return thread_cache_init(cache);
+}
+
+/*
+ * The API
+ */
+
+static void setup_slab_geometry(struct mem_cache *cache)
+{
+	size_t slab_size;
+	long pagesize;
+
+	pagesize = sysconf(_SC_PAGESIZE);
+	if (pagesize <= 0)
+		pagesize = 4096;
+
+	cache->slab_off = p2roundup(sizeof(struct mem_slab), cache->align);
+
+	for (slab_size = pagesize;
+	     slab_size <= SLAB_MAX_SIZE;
+	     slab_size *= 2) {
+		size_t nobjs;
+
+		if (cache->slab_off >= slab_size)
+			continue;
+
+		nobjs = (slab_size - cache->slab_off) / cache->size;
+		if (nobjs < SLAB_MIN_OBJS)
+			continue;
+
+		cache->slab_size = slab_size;
+		cache->slab_objs = nobjs;
+		return;
+	}
+
+	/* too big for slabs */
+	cache->slab_size = 0;
+	cache->slab_objs = 0;
+	cache->slab_off = 0;
+}
+
+#pragma weak mem_cache_create_ext
+struct mem_cache *mem_cache_create_ext(char *name, size_t size, size_t align,
+				       int (*ctor)(void *, void *),
+				       void (*dtor)(void *, void *),
+				       void *priv)
 {
 	struct mem_cache *cache;
+	int ret;
 
 	if (!size)
 		return ERR_PTR(-EINVAL);
 
-	/* FIXME: check that the value is 0, or a power of 2 */
+	if (!is_p2(align))
+		return ERR_PTR(-EINVAL);
 
 	cache = malloc(sizeof(struct mem_cache));
 	if (!cache)
 		return ERR_PTR(-ENOMEM);
 
-	cache->size = size;
-	cache->align = (align < sizeof(void *)) ? sizeof(void *) : align;
+	strcpy_safe(cache->name, name ? name : "", sizeof(cache->name));
+	cache->align = MAX(align, sizeof(void *));
+	cache->size = p2roundup(MAX(size, sizeof(void *)), cache->align);
+
+	cache->ctor = ctor;
+	cache->dtor = dtor;
+	cache->priv = priv;
+
+	setup_slab_geometry(cache);
+
+	ret = -pthread_key_create(&cache->key, thread_cache_fini);
+	if (ret) {
+		free(cache);
+		return ERR_PTR(ret);
+	}
+
+	VERIFY0(pthread_mutex_init(&cache->depot_lock, NULL));
+	cache->depot_full = NULL;
+	cache->depot_empty = NULL;
+	cache->depot_nfull = 0;
+	list_create(&cache->threads, sizeof(struct mem_thread_cache),
+		    offsetof(struct mem_thread_cache, node));
+
+	VERIFY0(pthread_mutex_init(&cache->slab_lock, NULL));
+	list_create(&cache->slabs_partial, sizeof(struct mem_slab),
+		    offsetof(struct mem_slab, node));
+	list_create(&cache->slabs_full, sizeof(struct mem_slab),
+		    offsetof(struct mem_slab, node));
+	cache->slab_empty = NULL;
+
+	cache->nslabs = 0;
+	cache->nobjs = 0;
+	cache->nobjs_peak = 0;
+	atomic_set(&cache->allocs, 0);
+	atomic_set(&cache->frees, 0);
+
+	VERIFY0(pthread_mutex_lock(&caches_lock));
+	cache->next_cache = caches;
+	caches = cache;
+	VERIFY0(pthread_mutex_unlock(&caches_lock));
 
 	return cache;
 }
 
+#pragma weak mem_cache_create
+struct mem_cache *mem_cache_create(char *name, size_t size, size_t align)
+{
+	return mem_cache_create_ext(name, size, align, NULL, NULL, NULL);
+}
+
+static void destroy_slab_list(struct list *list)
+{
+	struct mem_slab *slab;
+
+	while ((slab = list_remove_head(list)))
+		free(slab);
+
+	list_destroy(list);
+}
+
+/*
+ * Destroy the cache.  All objects must have been freed and no other thread
+ * may be using the cache concurrently.
+ */
 #pragma weak mem_cache_destroy
 void mem_cache_destroy(struct mem_cache *cache)
 {
+	struct mem_thread_cache *tc;
+	struct mem_magazine *mag;
+	struct mem_cache **pp;
+
 	if (!cache)
 		return;
 
+	VERIFY0(pthread_mutex_lock(&caches_lock));
+	for (pp = &caches; *pp != cache; pp = &(*pp)->next_cache)
+		VERIFY3P(*pp, !=, NULL);
+	*pp = cache->next_cache;
+	VERIFY0(pthread_mutex_unlock(&caches_lock));
+
+	/* prevent the thread exit destructors from touching the cache */
+	VERIFY0(pthread_key_delete(cache->key));
+
+	while ((tc = list_remove_head(&cache->threads))) {
+		magazine_destroy(cache, tc->loaded);
+		magazine_destroy(cache, tc->prev);
+		free(tc);
+	}
+
+	while ((mag = cache->depot_full)) {
+		cache->depot_full = mag->next;
+		magazine_destroy(cache, mag);
+	}
+
+	while ((mag = cache->depot_empty)) {
+		cache->depot_empty = mag->next;
+		magazine_destroy(cache, mag);
+	}
+
+	/* any slabs still on the lists contain leaked objects */
+	destroy_slab_list(&cache->slabs_partial);
+	destroy_slab_list(&cache->slabs_full);
+	free(cache->slab_empty);
+
+	list_destroy(&cache->threads);
+	VERIFY0(pthread_mutex_destroy(&cache->depot_lock));
+	VERIFY0(pthread_mutex_destroy(&cache->slab_lock));
+
 	free(cache);
 }
 
 #pragma weak mem_cache_alloc
 void *mem_cache_alloc(struct mem_cache *cache)
 {
+	struct mem_thread_cache *tc;
 	void *obj;
-	int ret;
 
-	ret = posix_memalign(&obj, cache->align, cache->size);
+	tc = get_thread_cache(cache);
+	if (!tc) {
+		obj = slab_alloc_constructed(cache);
+		if (obj)
+			atomic_inc(&cache->allocs);
+
+		return obj;
+	}
+
+	for (;;) {
+		if (tc->loaded->nrounds) {
+			obj = tc->loaded->rounds[--tc->loaded->nrounds];
+			break;
+		}
 
-	return ret ? NULL : obj;
+		if (tc->prev->nrounds) {
+			magazine_swap(tc);
+			continue;
+		}
+
+		if (!depot_get_full(cache, tc)) {
+			obj = slab_alloc_constructed(cache);
+			if (!obj)
+				return NULL;
+			break;
+		}
+	}
+
+	tc->allocs++;
+
+	return obj;
 }
 
 #pragma weak mem_cache_free
 void mem_cache_free(struct mem_cache *cache, void *buf)
 {
-	free(buf);
+	struct mem_thread_cache *tc;
+
+	if (!buf)
+		return;
+
+	tc = get_thread_cache(cache);
+	if (!tc) {
+		atomic_inc(&cache->frees);
+		slab_free_constructed(cache, buf);
+		return;
+	}
+
+	tc->frees++;
+
+	for (;;) {
+		if (tc->loaded->nrounds < MAGAZINE_ROUNDS) {
+			tc->loaded->rounds[tc->loaded->nrounds++] = buf;
+			return;
+		}
+
+		if (!tc->prev->nrounds) {
+			magazine_swap(tc);
+			continue;
+		}
+
+		if (!depot_get_empty(cache, tc)) {
+			slab_free_constructed(cache, buf);
+			return;
+		}
+	}
+}
+
+/*
+ * Statistics
+ */
+
+struct mem_cache_stats {
+	const char *name;
+	uint64_t size;
+	uint64_t allocs;
+	uint64_t frees;
+	uint64_t peak;
+	uint64_t bytes;
+	uint64_t slabs;
+	uint64_t slab_objs;
+	uint64_t slab_used;
+};
+
+static void get_stats(struct mem_cache *cache, struct mem_cache_stats *stats)
+{
+	struct mem_thread_cache *tc;
+
+	stats->name = cache->name;
+	stats->size = cache->size;
+
+	/*
+	 * The thread caches' counters are updated without any locking so
+	 * the sums may be slightly stale.
+	 */
+	VERIFY0(pthread_mutex_lock(&cache->depot_lock));
+	stats->allocs = atomic_read(&cache->allocs);
+	stats->frees = atomic_read(&cache->frees);
+	list_for_each(tc, &cache->threads) {
+		stats->allocs += tc->allocs;
+		stats->frees += tc->frees;
+	}
+	VERIFY0(pthread_mutex_unlock(&cache->depot_lock));
+
+	VERIFY0(pthread_mutex_lock(&cache->slab_lock));
+	stats->peak = cache->nobjs_peak;
+	stats->slabs = cache->nslabs;
+	stats->slab_objs = cache->nslabs * cache->slab_objs;
+	stats->slab_used = cache->slab_size ? cache->nobjs : 0;
+	if (cache->slab_size)
+		stats->bytes = cache->nslabs * cache->slab_size;
+	else
+		stats->bytes = cache->nobjs * cache->size;
+	VERIFY0(pthread_mutex_unlock(&cache->slab_lock));
+}
+
+static void merge_stats(struct mem_cache_stats *dst,
+			const struct mem_cache_stats *src)
+{
+	dst->size = MAX(dst->size, src->size);
+	dst->allocs += src->allocs;
+	dst->frees += src->frees;
+	dst->peak += src->peak;
+	dst->bytes += src->bytes;
+	dst->slabs += src->slabs;
+	dst->slab_objs += src->slab_objs;
+	dst->slab_used += src->slab_used;
+}
+
+static int pack_stats(struct nvlist *out, const struct mem_cache_stats *stats)
+{
+	struct nvlist *nvl;
+	int ret;
+
+	nvl = nvl_alloc();
+	if (IS_ERR(nvl))
+		return PTR_ERR(nvl);
+
+	if ((ret = nvl_set_int(nvl, "size", stats->size)) ||
+	    (ret = nvl_set_int(nvl, "allocs", stats->allocs)) ||
+	    (ret = nvl_set_int(nvl, "frees", stats->frees)) ||
+	    (ret = nvl_set_int(nvl, "live",
+			       (stats->allocs > stats->frees) ?
+			       (stats->allocs - stats->frees) : 0)) ||
+	    (ret = nvl_set_int(nvl, "peak", stats->peak)) ||
+	    (ret = nvl_set_int(nvl, "bytes", stats->bytes)) ||
+	    (ret = nvl_set_int(nvl, "slabs", stats->slabs)) ||
+	    (ret = nvl_set_int(nvl, "slab_objs", stats->slab_objs)) ||
+	    (ret = nvl_set_int(nvl, "slab_used", stats->slab_used)) ||
+	    (ret = nvl_set_int(nvl, "slab_util",
+			       stats->slab_objs ?
+			       (100 * stats->slab_used) / stats->slab_objs : 0))) {
+		nvl_putref(nvl);
+		return ret;
+	}
+
+	return nvl_set_nvl(out, stats->name, nvl);
+}
+
+#pragma weak mem_cache_stats
+struct nvlist *mem_cache_stats(void)
+{
+	struct mem_cache_stats *stats;
+	struct mem_cache *cache;
+	struct nvlist *out;
+	size_t nstats;
+	size_t ncaches;
+	size_t i;
+	int ret;
+
+	ret = 0;
+
+	out = nvl_alloc();
+	if (IS_ERR(out))
+		return out;
+
+	/*
+	 * Snapshot all the caches first, and only then build the nvlist.
+	 * Building it allocates from caches - possibly the very ones whose
+	 * locks get_stats takes.
+	 */
+	VERIFY0(pthread_mutex_lock(&caches_lock));
+
+	for (cache = caches, ncaches = 0; cache; cache = cache->next_cache)
+		ncaches++;
+
+	stats = calloc(ncaches, sizeof(struct mem_cache_stats));
+	if (!stats) {
+		VERIFY0(pthread_mutex_unlock(&caches_lock));
+		nvl_putref(out);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	for (cache = caches, nstats = 0; cache; cache = cache->next_cache) {
+		struct mem_cache_stats tmp;
+
+		get_stats(cache, &tmp);
+
+		/* caches with the same name are aggregated */
+		for (i = 0; i < nstats; i++)
+			if (!strcmp(stats[i].name, tmp.name))
+				break;
+
+		if (i == nstats)
+			stats[nstats++] = tmp;
+		else
+			merge_stats(&stats[i], &tmp);
+	}
+
+	/*
+	 * The names point into the caches, so we have to build the nvlist
+	 * with the list lock held.
+	 */
+	for (i = 0; i < nstats; i++) {
+		ret = pack_stats(out, &stats[i]);
+		if (ret)
+			break;
+	}
+
+	VERIFY0(pthread_mutex_unlock(&caches_lock));
+
+	free(stats);
+
+	if (ret) {
+		nvl_putref(out);
+		return ERR_PTR(ret);
+	}
+
+	return out;
 }
@@ -29,32 +29,89 @@
 
 /*
  * A slab allocator - wrapping libumem.
+ *
+ * The constructor & destructor callbacks have a different signature than
+ * the umem ones, so we keep them in a small wrapper structure and pass it
+ * to umem as the private data for the trampolines below.
  */
 
-struct mem_cache *mem_cache_create(char *name, size_t size, size_t align)
+struct mem_cache {
+	umem_cache_t *cache;
+
+	int (*ctor)(void *, void *);
+	void (*dtor)(void *, void *);
+	void *priv;
+};
+
+static int umem_ctor(void *buf, void *arg, int flags)
+{
+	struct mem_cache *cache = arg;
+
+	return cache->ctor(buf, cache->priv) ? -1 : 0;
+}
+
+static void umem_dtor(void *buf, void *arg)
+{
+	struct mem_cache *cache = arg;
+
+	cache->dtor(buf, cache->priv);
+}
+
+struct mem_cache *mem_cache_create_ext(char *name, size_t size, size_t align,
+				       int (*ctor)(void *, void *),
+				       void (*dtor)(void *, void *),
+				       void *priv)
 {
 	struct mem_cache *cache;
 
-	cache = (struct mem_cache *) umem_cache_create(name, size, align,
-						       NULL, NULL, NULL,
-						       NULL, NULL, 0);
+	cache = malloc(sizeof(struct mem_cache));
 	if (!cache)
-		return ERR_PTR(-errno);
+		return ERR_PTR(-ENOMEM);
+
+	cache->ctor = ctor;
+	cache->dtor = dtor;
+	cache->priv = priv;
+
+	cache->cache = umem_cache_create(name, size, align,
+					 ctor ? umem_ctor : NULL,
+					 dtor ? umem_dtor : NULL,
+					 NULL, cache, NULL, 0);
+	if (!cache->cache) {
+		int ret = -errno;
+
+		free(cache);
+		return ERR_PTR(ret);
+	}
 
 	return cache;
 }
 
+struct mem_cache *mem_cache_create(char *name, size_t size, size_t align)
+{
+	return mem_cache_create_ext(name, size, align, NULL, NULL, NULL);
+}
+
 void mem_cache_destroy(struct mem_cache *cache)
 {
-	umem_cache_destroy((umem_cache_t *) cache);
+	if (!cache)
+		return;
+
+	umem_cache_destroy(cache->cache);
+	free(cache);
 }
 
 void *mem_cache_alloc(struct mem_cache *cache)
 {
-	return umem_cache_alloc((umem_cache_t *) cache, 0);
+	return umem_cache_alloc(cache->cache, 0);
 }
 
 void mem_cache_free(struct mem_cache *cache, void *buf)
 {
-	umem_cache_free((umem_cache_t *) cache, buf);
+	umem_cache_free(cache->cache, buf);
+}
+
+/* libumem has its own observability tools (e.g., mdb's ::umastat) */
+struct nvlist *mem_cache_stats(void)
+{
+	return ERR_PTR(-ENOTSUP);
 }
@@ -25,6 +25,7 @@
 
 #include <jeffpc/mem.h>
 #include <jeffpc/jeffpc.h>
+#include <jeffpc/hash.h>
 
 #include "val_impl.h"
 
@@ -45,7 +46,6 @@ STATIC_ASSERT(offsetof(struct sym, val) == 0);
 #define USE_STRLEN	((size_t) ~0ul)
 
 static struct str empty_string = _STATIC_STR_INITIALIZER(VT_STR, "");
-static struct sym empty_symbol = _STATIC_STR_INITIALIZER(VT_SYM, "");
 
 /* one 7-bit ASCII character long strings */
 static struct str one_char[128] = {
@@ -73,27 +73,36 @@ static struct str one_char[128] = {
 	STATIC_CHAR32(96)	/* 96..127 */
 };
 
+/*
+ * Strings allocated by us always have their length cached.  Statically
+ * initialized ones (e.g., STATIC_STR) generally do not.
+ */
 static inline size_t get_len(const struct val *val)
 {
-	return strlen(val_cstr(val));
+	if (!val->len_valid)
+		return strlen(val_cstr(val));
+
+	return val->inline_alloc ? val->inline_len : val->str.len;
 }
 
+/* must be called after inline_alloc is set */
 static inline void set_len(struct val *str, size_t len)
 {
-	/* TODO: stash length in struct val if possible */
+	if (str->inline_alloc)
+		str->inline_len = len;
+	else
+		str->str.len = len;
+
+	str->len_valid = true;
 }
 
-static struct val *__get_preallocated(enum val_type type, const char *s,
-				      size_t len)
+static struct val *__get_preallocated(const char *s, size_t len)
 {
 	unsigned char first_char;
 
 	/* NULL or non-nul terminated & zero length */
 	if (!s || !len)
-		return (type == VT_STR) ? &empty_string.val : &empty_symbol.val;
-
-	if (type != VT_STR)
-		return NULL;
+		return &empty_string.val;
 
 	first_char = s[0];
 
@@ -118,8 +127,9 @@ static inline void __copy(char *dest, const char *s, size_t len)
 	dest[len] = '\0';
 }
 
-static struct val *__alloc(enum val_type type, const char *s, size_t len,
-			   bool heapalloc, bool mustdup)
+static struct val *__alloc(struct mem_arena *arena, enum val_type type,
+			   const char *s, size_t len, bool heapalloc,
+			   bool mustdup)
 {
 	struct val *val;
 	bool copy;
@@ -129,12 +139,20 @@ static struct val *__alloc(enum val_type type, const char *s, size_t len,
 	/* sanity check */
 	if (mustdup)
 		ASSERT(!heapalloc);
+	if (arena)
+		ASSERT(mustdup);
 
 	/* determine the real length of the string */
 	len = s ? strnlen(s, len) : 0;
 
+	/* symbols are interned */
+	if (type == VT_SYM) {
+		val = __sym_intern(s ? s : "", len);
+		goto out;
+	}
+
 	/* check preallocated strings */
-	val = __get_preallocated(type, s, len);
+	val = __get_preallocated(s, len);
 	if (val)
 		goto out;
 
@@ -145,7 +163,10 @@ static struct val *__alloc(enum val_type type, const char *s, size_t len,
 	if (!copy && mustdup) {
 		char *tmp;
 
-		tmp = malloc(len + 1);
+		if (arena)
+			tmp = mem_arena_alloc(arena, len + 1);
+		else
+			tmp = malloc(len + 1);
 		if (!tmp) {
 			val = ERR_PTR(-ENOMEM);
 			goto out;
@@ -153,17 +174,19 @@ static struct val *__alloc(enum val_type type, const char *s, size_t len,
 
 		__copy(tmp, s, len);
 
-		/* we're now using the heap */
-		heapalloc = true;
+		/* we're now using the heap (unless it is the arena) */
+		heapalloc = !arena;
 		s = tmp;
 	}
 
-	val = __val_alloc(type);
+	val = __val_alloc_arena(arena, type);
 	if (IS_ERR(val))
 		goto out;
 
 	val->static_alloc = copy || !heapalloc;
 	val->inline_alloc = copy;
+	val->hash = hash_str(s, len);
+	val->hash_valid = true;
 	set_len(val, len);
 
 	if (copy) {
@@ -186,22 +209,76 @@ out:
 
 struct val *_strsym_dup(const char *s, enum val_type type)
 {
-	return __alloc(type, s, USE_STRLEN, false, true);
+	return __alloc(NULL, type, s, USE_STRLEN, false, true);
 }
 
 struct val *_strsym_dup_len(const char *s, size_t len, enum val_type type)
 {
-	return __alloc(type, s, len, false, true);
+	return __alloc(NULL, type, s, len, false, true);
 }
 
 struct val *_strsym_alloc(char *s, enum val_type type)
 {
-	return __alloc(type, s, USE_STRLEN, true, false);
+	return __alloc(NULL, type, s, USE_STRLEN, true, false);
 }
 
 struct val *_strsym_alloc_static(const char *s, enum val_type type)
 {
-	return __alloc(type, s, USE_STRLEN, false, false);
+	return __alloc(NULL, type, s, USE_STRLEN, false, false);
+}
+
+struct val *__strsym_dup_len_arena(struct mem_arena *arena, const char *s,
+				   size_t len, enum val_type type)
+{
+	return __alloc(arena, type, s, len, false, true);
+}
+
+struct str *str_slice(struct val *parent, size_t off, size_t len)
+{
+	const char *buf;
+	size_t bufsize;
+	struct val *val;
+
+	switch (parent->type) {
+		case VT_STR:
+			buf = val_cstr(parent);
+			bufsize = get_len(parent) + 1;
+			break;
+		case VT_BLOB:
+			buf = parent->blob.ptr;
+			bufsize = parent->blob.size;
+			break;
+		default:
+			val_putref(parent);
+			return ERR_PTR(-EINVAL);
+	}
+
+	if ((off > bufsize) || (len > (bufsize - off))) {
+		val_putref(parent);
+		return ERR_PTR(-EINVAL);
+	}
+
+	buf += off;
+	bufsize -= off;
+
+	/* like everywhere else, the string ends at the first nul */
+	len = strnlen(buf, len);
+
+	/* short or unterminated strings get copied */
+	if (__inlinable(len) || (len == bufsize) || (buf[len] != '\0')) {
+		val = __alloc(NULL, VT_STR, buf, len, false, true);
+		val_putref(parent);
+		return IS_ERR(val) ? ERR_CAST(val) : val_cast_to_str(val);
+	}
+
+	val = __val_alloc_slice(parent);
+	if (IS_ERR(val))
+		return ERR_CAST(val);
+
+	val->_set_str_ptr = buf;
+	set_len(val, len);
+
+	return val_cast_to_str(val);
 }
 
 size_t _strsym_len(const struct val *s)
@@ -211,6 +288,9 @@ size_t _strsym_len(const struct val *s)
 
 int _strsym_cmp(const struct val *a, const struct val *b)
 {
+	if (a == b)
+		return 0;
+
 	return strcmp(val_cstr(a), val_cstr(b));
 }
 
@@ -265,8 +345,6 @@ struct str *str_cat(size_t n, ...)
 	buf = malloc(totallen + 1);
 	ASSERT(buf);
 
-	buf[0] = '\0';
-
 	out = buf;
 
 	for (i = 0; i < n; i++) {
@@ -275,14 +353,17 @@ struct str *str_cat(size_t n, ...)
 		if (!val)
 			continue;
 
-		strcpy(out, val_cstr(val));
+		memcpy(out, val_cstr(val), len[i]);
 
 		out += len[i];
 
 		val_putref(val);
 	}
 
-	return STR_ALLOC(buf);
+	*out = '\0';
+
+	return val_cast_to_str(__alloc(NULL, VT_STR, buf, totallen, true,
+				       false));
 }
 
 struct str *str_vprintf(const char *fmt, va_list args)
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+
+#include <jeffpc/error.h>
+#include <jeffpc/mem.h>
+#include <jeffpc/hash.h>
+
+#include "val_impl.h"
+
+/*
+ * Symbol interning
+ *
+ * All symbols allocated at runtime are interned - there is only one struct
+ * sym for each name.  Interned symbols are immutable and live forever.
+ * They are marked as static so reference counting on them is a no-op, and
+ * their reference count is never initialized.  The table never shrinks.
+ * Two interned symbols are equal if and only if they are the same pointer.
+ *
+ * The table is split into a number of shards (selected by the name's
+ * hash), each with its own lock and its own chained hash table that grows
+ * as symbols are added.  Everything is statically initialized so that
+ * symbols can be used from constructors regardless of their order.
+ *
+ * Like the slab allocator, we use plain pthread mutexes - symbols get
+ * allocated with all sorts of locks held and we don't want lockdep to
+ * record a dependency on every one of them.
+ */
+
+#define NSHARDS			64
+#define SHARD_INIT_BUCKETS	16
+
+struct interned_sym {
+	struct interned_sym *next;
+	struct sym sym;
+	char name[];		/* only if the name can't be inlined */
+};
+
+struct shard {
+	pthread_mutex_t lock;
+	struct interned_sym **buckets;
+	size_t nbuckets;	/* always a power of 2 */
+	size_t nsyms;
+};
+
+static struct shard shards[NSHARDS] = {
+	[0 ... NSHARDS - 1] = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+	},
+};
+
+static inline struct shard *get_shard(uint32_t hash)
+{
+	/* the low bits pick the bucket, so use the high bits here */
+	return &shards[(hash >> 24) % NSHARDS];
+}
+
+static struct interned_sym *find(struct shard *shard, const char *s,
+				 size_t len, uint32_t hash)
+{
+	struct interned_sym *cur;
+
+	if (!shard->buckets)
+		return NULL;
+
+	for (cur = shard->buckets[hash & (shard->nbuckets - 1)];
+	     cur;
+	     cur = cur->next) {
+		const struct val *val = sym_cast_to_val(&cur->sym);
+
+		if ((val->hash == hash) && (sym_len(&cur->sym) == len) &&
+		    !memcmp(val_cstr(val), s, len))
+			return cur;
+	}
+
+	return NULL;
+}
+
+static int grow(struct shard *shard)
+{
+	struct interned_sym **buckets;
+	size_t nbuckets;
+	size_t i;
+
+	nbuckets = shard->nbuckets ? (shard->nbuckets * 2) : SHARD_INIT_BUCKETS;
+
+	buckets = mem_recallocarray(NULL, 0, nbuckets,
+				    sizeof(struct interned_sym *));
+	if (!buckets)
+		return -ENOMEM;
+
+	for (i = 0; i < shard->nbuckets; i++) {
+		struct interned_sym *cur, *next;
+
+		for (cur = shard->buckets[i]; cur; cur = next) {
+			size_t idx = cur->sym.val.hash & (nbuckets - 1);
+
+			next = cur->next;
+
+			cur->next = buckets[idx];
+			buckets[idx] = cur;
+		}
+	}
+
+	free(shard->buckets);
+
+	shard->buckets = buckets;
+	shard->nbuckets = nbuckets;
+
+	return 0;
+}
+
+static struct interned_sym *insert(struct shard *shard, const char *s,
+				   size_t len, uint32_t hash)
+{
+	struct interned_sym *isym;
+	struct val *val;
+	bool inl;
+	size_t idx;
+
+	if (shard->nsyms >= shard->nbuckets) {
+		int ret;
+
+		ret = grow(shard);
+		if (ret && !shard->buckets)
+			return ERR_PTR(ret);
+
+		/* if we failed to grow, just use longer chains */
+	}
+
+	inl = (len <= STR_INLINE_LEN);
+
+	isym = malloc(sizeof(struct interned_sym) + (inl ? 0 : (len + 1)));
+	if (!isym)
+		return ERR_PTR(-ENOMEM);
+
+	val = sym_cast_to_val(&isym->sym);
+
+	__val_init(val, VT_SYM, true);
+	val->static_alloc = true;
+	val->inline_alloc = inl;
+	val->interned = true;
+	val->len_valid = true;
+	val->hash_valid = true;
+	val->hash = hash;
+
+	if (inl) {
+		memcpy(val->_set_str_inline, s, len);
+		val->_set_str_inline[len] = '\0';
+		val->inline_len = len;
+	} else {
+		memcpy(isym->name, s, len);
+		isym->name[len] = '\0';
+		val->_set_str_ptr = isym->name;
+		val->str.len = len;
+	}
+
+	idx = hash & (shard->nbuckets - 1);
+
+	isym->next = shard->buckets[idx];
+	shard->buckets[idx] = isym;
+	shard->nsyms++;
+
+	return isym;
+}
+
+/* len must be the real length of the string (i.e., no embedded nuls) */
+struct val *__sym_intern(const char *s, size_t len)
+{
+	struct interned_sym *isym;
+	struct shard *shard;
+	uint32_t hash;
+
+	hash = hash_str(s, len);
+	shard = get_shard(hash);
+
+	VERIFY0(pthread_mutex_lock(&shard->lock));
+
+	isym = find(shard, s, len, hash);
+	if (!isym)
+		isym = insert(shard, s, len, hash);
+
+	VERIFY0(pthread_mutex_unlock(&shard->lock));
+
+	if (IS_ERR(isym))
+		return ERR_CAST(isym);
+
+	return sym_cast_to_val(&isym->sym);
+}
+
+struct sym *sym_lookup(const char *name)
+{
+	struct interned_sym *isym;
+	struct shard *shard;
+	uint32_t hash;
+	size_t len;
+
+	len = strlen(name);
+	hash = hash_str(name, len);
+	shard = get_shard(hash);
+
+	VERIFY0(pthread_mutex_lock(&shard->lock));
+	isym = find(shard, name, len, hash);
+	VERIFY0(pthread_mutex_unlock(&shard->lock));
+
+	return isym ? &isym->sym : NULL;
+}
@@ -32,9 +32,33 @@ static LOCK_CLASS(taskq_lc);
 static struct mem_cache *taskq_cache;
 static struct mem_cache *taskq_item_cache;
 
+static int taskq_ctor(void *obj, void *priv)
+{
+	struct taskq *tq = obj;
+
+	list_create(&tq->queue, sizeof(struct taskq_item),
+		    offsetof(struct taskq_item, node));
+	MXINIT(&tq->lock, &taskq_lc);
+	CONDINIT(&tq->cond_worker2parent);
+	CONDINIT(&tq->cond_parent2worker);
+
+	return 0;
+}
+
+static void taskq_dtor(void *obj, void *priv)
+{
+	struct taskq *tq = obj;
+
+	CONDDESTROY(&tq->cond_parent2worker);
+	CONDDESTROY(&tq->cond_worker2parent);
+	MXDESTROY(&tq->lock);
+	list_destroy(&tq->queue);
+}
+
 static void __attribute__((constructor)) init_taskq_subsys(void)
 {
-	taskq_cache = mem_cache_create("taskq-cache", sizeof(struct taskq), 0);
+	taskq_cache = mem_cache_create_ext("taskq-cache", sizeof(struct taskq),
+					   0, taskq_ctor, taskq_dtor, NULL);
 	ASSERT(!IS_ERR(taskq_cache));
 	taskq_item_cache = mem_cache_create("taskq-item-cache",
 					    sizeof(struct taskq_item), 0);
@@ -160,12 +184,6 @@ struct taskq *taskq_create_fixed(const char *name, long nthreads)
 	tq->shutdown = false;
 	tq->processed = 0;
 
-	list_create(&tq->queue, sizeof(struct taskq_item),
-		    offsetof(struct taskq_item, node));
-	MXINIT(&tq->lock, &taskq_lc);
-	CONDINIT(&tq->cond_worker2parent);
-	CONDINIT(&tq->cond_parent2worker);
-
 	ret = start_threads(tq);
 	if (ret) {
 		taskq_destroy(tq);
@@ -240,11 +258,7 @@ void taskq_destroy(struct taskq *tq)
 	for (i = 0; i < tq->nstarted_threads; i++)
 		xthr_join(tq->threads[i], NULL);
 
-	/* free */
-	CONDDESTROY(&tq->cond_parent2worker);
-	CONDDESTROY(&tq->cond_worker2parent);
-	MXDESTROY(&tq->lock);
-	list_destroy(&tq->queue);
+	/* free (the lock, conds, and queue stay constructed in the cache) */
 	free(tq->threads);
 	mem_cache_free(taskq_cache, tq);
 }
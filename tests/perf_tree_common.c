@@ -22,16 +22,28 @@
 
 #include <jeffpc/jeffpc.h>
 #include <jeffpc/error.h>
+#include <jeffpc/avl.h>
 #include <jeffpc/bst.h>
+#include <jeffpc/btree.h>
 #include <jeffpc/rbtree.h>
 #include <jeffpc/rand.h>
 #include <jeffpc/time.h>
 
 #define NITERS		1000000
 
-#define PERF_TREE_RB
-
-#if defined(PERF_TREE_BST)
+#if defined(PERF_TREE_AVL)
+#define TREE_TREE		avl_tree
+#define TREE_NODE		avl_node
+#define TREE_COOKIE		avl_cookie
+#define TREE_CREATE		avl_create
+#define TREE_DESTROY		avl_destroy
+#define TREE_FIND		avl_find
+#define TREE_INSERT		avl_insert
+#define TREE_REMOVE		avl_remove
+#define TREE_FOR_EACH		avl_for_each
+#define TREE_NUMNODES		avl_numnodes
+#define TREE_DESTROY_NODES	avl_destroy_nodes
+#elif defined(PERF_TREE_BST)
 /*
  * Use fewer iterations to avoid pathological behavior with sequential
  * insertions taking O(n^2) with a large n.
@@ -61,12 +73,26 @@
 #define TREE_FOR_EACH		rb_for_each
 #define TREE_NUMNODES		rb_numnodes
 #define TREE_DESTROY_NODES	rb_destroy_nodes
+#elif defined(PERF_TREE_BTREE)
+#define TREE_TREE		btree
+#define TREE_COOKIE		btree_cookie
+#define TREE_CREATE(tree, cmp, size, off) \
+				btree_create((tree), (cmp), prefix)
+#define TREE_DESTROY		btree_destroy
+#define TREE_FIND		btree_find
+#define TREE_INSERT		btree_insert
+#define TREE_REMOVE		btree_remove
+#define TREE_FOR_EACH		btree_for_each
+#define TREE_NUMNODES		btree_numnodes
+#define TREE_DESTROY_NODES	btree_destroy_nodes
 #else
 #error "Unspecified test type"
 #endif
 
 struct node {
+#ifdef TREE_NODE
 	struct TREE_NODE node;
+#endif
 	uint32_t v;
 };
 
@@ -84,6 +110,15 @@ static int cmp(const void *va, const void *vb)
 	return 0;
 }
 
+#ifdef PERF_TREE_BTREE
+static uint64_t prefix(const void *item)
+{
+	const struct node *node = item;
+
+	return node->v;
+}
+#endif
+
 static uint32_t myrand(void)
 {
 	return rand32() % (NITERS * 10);
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <jeffpc/val.h>
+#include <jeffpc/error.h>
+
+#include "test.c"
+
+struct release_state {
+	void *ptr;
+	size_t size;
+	int calls;
+};
+
+static void release(void *ptr, size_t size, void *cookie)
+{
+	struct release_state *state = cookie;
+
+	if (ptr != state->ptr)
+		fail("release got wrong pointer (%p, expected %p)", ptr,
+		     state->ptr);
+	if (size != state->size)
+		fail("release got wrong size (%zu, expected %zu)", size,
+		     state->size);
+
+	state->calls++;
+}
+
+static void check_calls(struct release_state *state, int exp)
+{
+	if (state->calls != exp)
+		fail("release called %d times, expected %d", state->calls, exp);
+}
+
+static void test_release(void)
+{
+	char data[] = "some data owned by someone else";
+	struct release_state state = {
+		.ptr = data,
+		.size = sizeof(data),
+	};
+	struct val *blob;
+	struct val *copy;
+
+	fprintf(stderr, "release callback...");
+
+	blob = val_alloc_blob_ext(data, sizeof(data), release, &state);
+	if (IS_ERR(blob))
+		fail("failed to allocate blob: %s", xstrerror(PTR_ERR(blob)));
+
+	if ((blob->type != VT_BLOB) || (blob->blob.ptr != data) ||
+	    (blob->blob.size != sizeof(data)))
+		fail("blob doesn't describe the passed in buffer");
+
+	copy = val_alloc_blob_dup(data, sizeof(data));
+	if (IS_ERR(copy))
+		fail("failed to allocate blob copy");
+
+	if (!val_equal(blob, copy))
+		fail("external blob not equal to a copy of it");
+
+	val_putref(copy);
+
+	val_getref(blob);
+	val_putref(blob);
+	check_calls(&state, 0);
+
+	val_putref(blob);
+	check_calls(&state, 1);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_slice(void)
+{
+	char data[] = "a string living in an external buffer";
+	struct release_state state = {
+		.ptr = data,
+		.size = sizeof(data),
+	};
+	struct val *blob;
+	struct str *str;
+
+	fprintf(stderr, "slice of an external blob...");
+
+	blob = val_alloc_blob_ext(data, sizeof(data), release, &state);
+	if (IS_ERR(blob))
+		fail("failed to allocate blob: %s", xstrerror(PTR_ERR(blob)));
+
+	str = str_slice(blob, 2, sizeof(data) - 3);
+	if (IS_ERR(str))
+		fail("failed to slice blob: %s", xstrerror(PTR_ERR(str)));
+
+	/* the slice holds the only reference now */
+	check_calls(&state, 0);
+
+	if (str_cstr(str) != &data[2])
+		fail("slice doesn't point into the external buffer");
+
+	str_putref(str);
+	check_calls(&state, 1);
+
+	fprintf(stderr, "ok.\n");
+}
+
+void test(void)
+{
+	test_release();
+	test_slice();
+}
@@ -75,7 +75,7 @@ static inline void dumpbuf(struct buffer *buf)
 		fprintf(stderr, "ok.\n");				\
 	} while (0)
 
-#define RUN_ONE_VAL(in, _exp)						\
+#define RUN_ONE_VAL(fxn, in, _exp)					\
 	do {								\
 		struct val *exp = (_exp);				\
 		struct buffer tmp;					\
@@ -85,10 +85,10 @@ static inline void dumpbuf(struct buffer *buf)
 				   buffer_size(in), buffer_size(in),	\
 				   false);				\
 									\
-		fprintf(stderr, "unpack via cbor_unpack_val (should %s)...",\
-			IS_ERR(exp) ? "fail" : "succeed");		\
+		fprintf(stderr, "unpack via %s (should %s)...",		\
+			#fxn, IS_ERR(exp) ? "fail" : "succeed");	\
 									\
-		ret = cbor_unpack_val(&tmp);				\
+		ret = fxn(&tmp);					\
 									\
 		check_rets(IS_ERR(exp) ? PTR_ERR(exp) : 0,		\
 			   IS_ERR(ret) ? PTR_ERR(ret) : 0,		\
@@ -380,7 +380,8 @@ static void onefile(struct buffer *in, struct val *expected)
 	}
 
 	/* test generic unpacking */
-	RUN_ONE_VAL(in, expected);
+	RUN_ONE_VAL(cbor_unpack_val, in, expected);
+	RUN_ONE_VAL(cbor_unpack_val_arena, in, expected);
 
 	/* test specific unpacking */
 	switch (expected->type) {
@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include <jeffpc/chashtab.h>
+#include <jeffpc/hash.h>
+#include <jeffpc/rand.h>
+#include <jeffpc/thread.h>
+
+#include "test.c"
+
+#define NITEMS		5000
+
+#define NREADERS	4
+#define NWRITERS	2
+#define NKEYS		1000
+#define NITERS		20000
+
+struct item {
+	uint32_t key;
+};
+
+static size_t nreleased;
+
+static uint32_t hash(const void *ptr)
+{
+	const struct item *item = ptr;
+
+	return hash_u64(item->key);
+}
+
+static int cmp(const void *va, const void *vb)
+{
+	const struct item *a = va;
+	const struct item *b = vb;
+
+	return (a->key == b->key) ? 0 : 1;
+}
+
+/* items are individually allocated so that ASAN catches early frees */
+static void release(void *ptr)
+{
+	__atomic_add_fetch(&nreleased, 1, __ATOMIC_SEQ_CST);
+
+	free(ptr);
+}
+
+static struct item *alloc_item(uint32_t key)
+{
+	struct item *item;
+
+	item = malloc(sizeof(struct item));
+	if (!item)
+		fail("malloc failed");
+
+	item->key = key;
+
+	return item;
+}
+
+static struct chashtab *alloc_tab(void)
+{
+	struct chashtab *tab;
+
+	tab = chashtab_alloc(hash, cmp, release);
+	if (IS_ERR(tab))
+		fail("chashtab_alloc failed: %s", xstrerror(PTR_ERR(tab)));
+
+	nreleased = 0;
+
+	return tab;
+}
+
+static void check_find(struct chashtab *tab, uint32_t key, bool present)
+{
+	struct item *item;
+	struct item k = {
+		.key = key,
+	};
+
+	epoch_enter();
+
+	item = chashtab_find(tab, &k);
+	if (!present && item)
+		fail("found absent key %u", key);
+	if (present && !item)
+		fail("failed to find key %u", key);
+	if (present && (item->key != key))
+		fail("found wrong key %u, expected %u", item->key, key);
+
+	epoch_exit();
+}
+
+static void test_basic(void)
+{
+	struct item *items[NITEMS];
+	struct chashtab *tab;
+	uint32_t i;
+
+	fprintf(stderr, "basic...");
+
+	tab = alloc_tab();
+
+	for (i = 0; i < NITEMS; i++) {
+		void *ret;
+
+		items[i] = alloc_item(i);
+
+		ret = chashtab_insert(tab, items[i]);
+		if (ret)
+			fail("insert of %u returned %p", i, ret);
+	}
+
+	for (i = 0; i < NITEMS; i++) {
+		struct item dup = {
+			.key = i,
+		};
+		void *ret;
+
+		ret = chashtab_insert(tab, &dup);
+		if (ret != items[i])
+			fail("duplicate insert of %u returned %p, expected %p",
+			     i, ret, items[i]);
+	}
+
+	if (chashtab_numnodes(tab) != NITEMS)
+		fail("numnodes %zu, expected %u", chashtab_numnodes(tab),
+		     NITEMS);
+
+	for (i = 0; i < NITEMS; i++)
+		check_find(tab, i, true);
+	check_find(tab, NITEMS, false);
+
+	/* remove the even keys */
+	for (i = 0; i < NITEMS; i += 2) {
+		struct item k = {
+			.key = i,
+		};
+
+		check_rets(0, chashtab_remove(tab, &k), "remove of %u", i);
+		check_rets(-ENOENT, chashtab_remove(tab, &k),
+			   "second remove of %u", i);
+	}
+
+	for (i = 0; i < NITEMS; i++)
+		check_find(tab, i, i % 2);
+
+	if (chashtab_numnodes(tab) != NITEMS / 2)
+		fail("numnodes %zu, expected %u", chashtab_numnodes(tab),
+		     NITEMS / 2);
+
+	epoch_synchronize();
+
+	if (nreleased != NITEMS / 2)
+		fail("released %zu items, expected %u", nreleased,
+		     NITEMS / 2);
+
+	chashtab_free(tab);
+
+	if (nreleased != NITEMS)
+		fail("released %zu items, expected %u", nreleased, NITEMS);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static struct chashtab *mt_tab;
+static bool mt_done;
+
+static void *mt_reader(void *arg)
+{
+	while (!__atomic_load_n(&mt_done, __ATOMIC_ACQUIRE)) {
+		struct item k = {
+			.key = rand32() % NKEYS,
+		};
+		struct item *item;
+
+		epoch_enter();
+
+		item = chashtab_find(mt_tab, &k);
+		if (item && (item->key != k.key))
+			fail("found wrong key %u, expected %u", item->key,
+			     k.key);
+
+		epoch_exit();
+	}
+
+	return NULL;
+}
+
+/* each writer owns the keys congruent to its id */
+static void *mt_writer(void *arg)
+{
+	const uintptr_t id = (uintptr_t) arg;
+	size_t i;
+
+	for (i = 0; i < NITERS; i++) {
+		uint32_t key = (rand32() % (NKEYS / NWRITERS)) * NWRITERS + id;
+		struct item k = {
+			.key = key,
+		};
+		int ret;
+
+		ret = chashtab_remove(mt_tab, &k);
+		if (ret == -ENOENT) {
+			void *old;
+
+			old = chashtab_insert(mt_tab, alloc_item(key));
+			if (old)
+				fail("insert of %u returned %p", key, old);
+		} else if (ret) {
+			fail("remove of %u failed: %s", key, xstrerror(ret));
+		}
+	}
+
+	return NULL;
+}
+
+static void test_threads(void)
+{
+	pthread_t readers[NREADERS];
+	pthread_t writers[NWRITERS];
+	uintptr_t i;
+	int ret;
+
+	fprintf(stderr, "multi-threaded...");
+
+	mt_tab = alloc_tab();
+	mt_done = false;
+
+	for (i = 0; i < NREADERS; i++) {
+		ret = xthr_create(&readers[i], mt_reader, NULL);
+		if (ret)
+			fail("xthr_create failed: %s", xstrerror(ret));
+	}
+
+	for (i = 0; i < NWRITERS; i++) {
+		ret = xthr_create(&writers[i], mt_writer, (void *) i);
+		if (ret)
+			fail("xthr_create failed: %s", xstrerror(ret));
+	}
+
+	for (i = 0; i < NWRITERS; i++) {
+		ret = xthr_join(writers[i], NULL);
+		if (ret)
+			fail("xthr_join failed: %s", xstrerror(ret));
+	}
+
+	__atomic_store_n(&mt_done, true, __ATOMIC_RELEASE);
+
+	for (i = 0; i < NREADERS; i++) {
+		ret = xthr_join(readers[i], NULL);
+		if (ret)
+			fail("xthr_join failed: %s", xstrerror(ret));
+	}
+
+	chashtab_free(mt_tab);
+
+	fprintf(stderr, "ok.\n");
+}
+
+void test(void)
+{
+	test_basic();
+	test_threads();
+}
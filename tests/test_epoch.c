@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <sched.h>
+
+#include <jeffpc/epoch.h>
+#include <jeffpc/thread.h>
+
+#include "test.c"
+
+/* more than a batch, so deferring tries to advance the epoch */
+#define NENTRIES	200
+
+static struct epoch_entry entries[NENTRIES];
+static bool freed[NENTRIES];
+
+static int reader_state; /* 0 = starting, 1 = in section, 2 = leave */
+
+static void cb(struct epoch_entry *entry)
+{
+	size_t idx = entry - entries;
+
+	if (freed[idx])
+		fail("entry %zu freed twice", idx);
+
+	freed[idx] = true;
+}
+
+static void wait_for(int state)
+{
+	while (__atomic_load_n(&reader_state, __ATOMIC_SEQ_CST) != state)
+		sched_yield();
+}
+
+static void *reader(void *arg)
+{
+	epoch_enter();
+
+	__atomic_store_n(&reader_state, 1, __ATOMIC_SEQ_CST);
+
+	wait_for(2);
+
+	epoch_exit();
+
+	return NULL;
+}
+
+static void check_freed(size_t n, bool expected)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		if (freed[i] != expected)
+			fail("entry %zu %sfreed", i, expected ? "not " : "");
+}
+
+static void test_single(void)
+{
+	size_t i;
+
+	fprintf(stderr, "single thread...");
+
+	for (i = 0; i < NENTRIES; i++)
+		freed[i] = false;
+
+	/* nested sections */
+	epoch_enter();
+	epoch_enter();
+	epoch_defer(&entries[0], cb);
+	epoch_exit();
+	epoch_defer(&entries[1], cb);
+	epoch_exit();
+
+	epoch_synchronize();
+
+	check_freed(2, true);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_reader(void)
+{
+	pthread_t tid;
+	size_t i;
+	int ret;
+
+	fprintf(stderr, "blocked by a reader...");
+
+	for (i = 0; i < NENTRIES; i++)
+		freed[i] = false;
+
+	ret = xthr_create(&tid, reader, NULL);
+	if (ret)
+		fail("xthr_create failed: %s", xstrerror(ret));
+
+	wait_for(1);
+
+	for (i = 0; i < NENTRIES; i++)
+		epoch_defer(&entries[i], cb);
+
+	check_freed(NENTRIES, false);
+
+	__atomic_store_n(&reader_state, 2, __ATOMIC_SEQ_CST);
+
+	ret = xthr_join(tid, NULL);
+	if (ret)
+		fail("xthr_join failed: %s", xstrerror(ret));
+
+	epoch_synchronize();
+
+	check_freed(NENTRIES, true);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void *deferrer(void *arg)
+{
+	size_t i;
+
+	for (i = 0; i < NENTRIES; i++)
+		epoch_defer(&entries[i], cb);
+
+	return NULL;
+}
+
+static void test_exit(void)
+{
+	pthread_t tid;
+	size_t i;
+	int ret;
+
+	fprintf(stderr, "deferred by an exited thread...");
+
+	for (i = 0; i < NENTRIES; i++)
+		freed[i] = false;
+
+	ret = xthr_create(&tid, deferrer, NULL);
+	if (ret)
+		fail("xthr_create failed: %s", xstrerror(ret));
+
+	ret = xthr_join(tid, NULL);
+	if (ret)
+		fail("xthr_join failed: %s", xstrerror(ret));
+
+	epoch_synchronize();
+
+	check_freed(NENTRIES, true);
+
+	fprintf(stderr, "ok.\n");
+}
+
+void test(void)
+{
+	test_single();
+	test_reader();
+	test_exit();
+}
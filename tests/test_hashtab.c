@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <jeffpc/hash.h>
+#include <jeffpc/hashtab.h>
+#include <jeffpc/types.h>
+
+#include "test.c"
+
+#define NNODES		5000
+
+struct node {
+	struct hashtab_node node;
+	uint32_t v;
+	bool present;
+	bool seen;
+};
+
+static struct node nodes[NNODES];
+
+static uint32_t good_hash(const void *item)
+{
+	const struct node *node = item;
+
+	return hash_u64(node->v);
+}
+
+/* everything collides, exercising the chains */
+static uint32_t bad_hash(const void *item)
+{
+	return 42;
+}
+
+static int cmp(const void *va, const void *vb)
+{
+	const struct node *a = va;
+	const struct node *b = vb;
+
+	return (a->v == b->v) ? 0 : 1;
+}
+
+static void init(struct hashtab *tab, uint32_t (*hash)(const void *))
+{
+	size_t i;
+	int ret;
+
+	ret = hashtab_create(tab, hash, cmp, sizeof(struct node),
+			     offsetof(struct node, node));
+	if (ret)
+		fail("hashtab_create failed: %s", xstrerror(ret));
+
+	for (i = 0; i < NNODES; i++) {
+		nodes[i].v = i * 3;
+		nodes[i].present = false;
+	}
+}
+
+static void add(struct hashtab *tab, size_t i)
+{
+	hashtab_add(tab, &nodes[i]);
+	nodes[i].present = true;
+}
+
+static void del(struct hashtab *tab, size_t i)
+{
+	hashtab_remove(tab, &nodes[i]);
+	nodes[i].present = false;
+}
+
+static void verify(struct hashtab *tab, size_t nnodes, size_t nlookups)
+{
+	struct hashtab_cookie cookie;
+	struct hashtab_stats stats;
+	struct node *node;
+	size_t count;
+	size_t i;
+
+	if (hashtab_numnodes(tab) != nnodes)
+		fail("table has %zu nodes, expected %zu",
+		     hashtab_numnodes(tab), nnodes);
+	if (hashtab_is_empty(tab) != !nnodes)
+		fail("is_empty mismatch");
+
+	/* lookups (including keys that were never inserted) */
+	for (i = 0; i < nlookups; i++) {
+		struct node key = {
+			.v = i,
+		};
+		struct node *exp;
+
+		if ((i % 3) || ((i / 3) >= NNODES) || !nodes[i / 3].present)
+			exp = NULL;
+		else
+			exp = &nodes[i / 3];
+
+		node = hashtab_find(tab, &key);
+		if (node != exp)
+			fail("find of %zu returned %p, expected %p", i, node,
+			     exp);
+	}
+
+	/* iteration */
+	for (i = 0; i < NNODES; i++)
+		nodes[i].seen = false;
+
+	count = 0;
+	hashtab_for_each(tab, &cookie, node) {
+		if (!node->present)
+			fail("iteration returned %u which is not in the table",
+			     node->v);
+		if (node->seen)
+			fail("iteration returned %u twice", node->v);
+
+		node->seen = true;
+		count++;
+	}
+
+	if (count != nnodes)
+		fail("iterated over %zu nodes, expected %zu", count, nnodes);
+
+	/* statistics */
+	hashtab_stats(tab, &stats);
+
+	if (stats.num_nodes != nnodes)
+		fail("stats have %zu nodes, expected %zu", stats.num_nodes,
+		     nnodes);
+	if (stats.used_buckets > MIN(nnodes, stats.nbuckets +
+				     stats.old_nbuckets))
+		fail("stats have %zu used buckets with %zu nodes",
+		     stats.used_buckets, nnodes);
+	if (nnodes && !stats.max_chain)
+		fail("stats have an empty max chain with %zu nodes", nnodes);
+}
+
+static void destroy(struct hashtab *tab, size_t nnodes)
+{
+	struct hashtab_cookie cookie;
+	struct node *node;
+	size_t count;
+
+	memset(&cookie, 0, sizeof(cookie));
+
+	count = 0;
+	while ((node = hashtab_destroy_nodes(tab, &cookie))) {
+		if (!node->present)
+			fail("destroy returned %u which is not in the table",
+			     node->v);
+
+		node->present = false;
+		count++;
+	}
+
+	if (count != nnodes)
+		fail("destroy returned %zu nodes, expected %zu", count,
+		     nnodes);
+
+	verify(tab, 0, 0);
+
+	hashtab_destroy(tab);
+}
+
+static void test_basic(uint32_t (*hash)(const void *), size_t nnodes)
+{
+	struct hashtab tab;
+	size_t i;
+
+	fprintf(stderr, "basic (%zu nodes, %s hash)...", nnodes,
+		(hash == good_hash) ? "good" : "bad");
+
+	init(&tab, hash);
+	verify(&tab, 0, 10);
+
+	for (i = 0; i < nnodes; i++) {
+		add(&tab, i);
+
+		/* check a few times, including mid-rehash */
+		if (!(i % 97))
+			verify(&tab, i + 1, 100);
+	}
+
+	verify(&tab, nnodes, nnodes * 3 + 3);
+
+	/* duplicate inserts return the existing item */
+	for (i = 0; i < nnodes; i++) {
+		struct node dup = {
+			.v = nodes[i].v,
+		};
+
+		if (hashtab_insert(&tab, &dup) != &nodes[i])
+			fail("duplicate insert of %u did not return existing",
+			     dup.v);
+	}
+
+	verify(&tab, nnodes, nnodes * 3 + 3);
+
+	for (i = 0; i < nnodes; i += 2)
+		del(&tab, i);
+
+	verify(&tab, nnodes / 2, nnodes * 3 + 3);
+
+	destroy(&tab, nnodes / 2);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_remove_iter(void)
+{
+	struct hashtab_cookie cookie;
+	struct hashtab tab;
+	struct node *node;
+	size_t removed;
+	size_t i;
+
+	fprintf(stderr, "remove during iteration...");
+
+	init(&tab, good_hash);
+
+	for (i = 0; i < NNODES; i++)
+		add(&tab, i);
+
+	/* remove every other node as we go */
+	removed = 0;
+	hashtab_for_each(&tab, &cookie, node) {
+		if (node->v % 2)
+			continue;
+
+		hashtab_remove(&tab, node);
+		node->present = false;
+		removed++;
+	}
+
+	verify(&tab, NNODES - removed, NNODES * 3);
+
+	for (i = 0; i < NNODES; i++)
+		if (!(nodes[i].v % 2) && nodes[i].present)
+			fail("node %u was not removed", nodes[i].v);
+
+	/* now remove the rest */
+	hashtab_for_each(&tab, &cookie, node) {
+		hashtab_remove(&tab, node);
+		node->present = false;
+	}
+
+	verify(&tab, 0, NNODES * 3);
+
+	hashtab_destroy(&tab);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_resize(void)
+{
+	struct hashtab_stats stats;
+	struct hashtab tab;
+	size_t nbuckets;
+	bool rehashing;
+	size_t i;
+
+	fprintf(stderr, "resize...");
+
+	init(&tab, good_hash);
+
+	hashtab_stats(&tab, &stats);
+	nbuckets = stats.nbuckets;
+
+	rehashing = false;
+	for (i = 0; i < NNODES; i++) {
+		add(&tab, i);
+
+		hashtab_stats(&tab, &stats);
+
+		if (stats.nbuckets < stats.num_nodes / 2)
+			fail("%zu buckets with %zu nodes", stats.nbuckets,
+			     stats.num_nodes);
+
+		if (stats.old_nbuckets) {
+			if (stats.old_nbuckets * 2 != stats.nbuckets)
+				fail("rehashing from %zu to %zu buckets",
+				     stats.old_nbuckets, stats.nbuckets);
+			rehashing = true;
+		}
+	}
+
+	if (!rehashing)
+		fail("never caught the table rehashing");
+	if (stats.nbuckets <= nbuckets)
+		fail("table did not grow");
+	if (1ul << stats.nresizes != stats.nbuckets / nbuckets)
+		fail("%zu resizes to get from %zu to %zu buckets",
+		     stats.nresizes, nbuckets, stats.nbuckets);
+
+	destroy(&tab, NNODES);
+
+	fprintf(stderr, "ok.\n");
+}
+
+void test(void)
+{
+	test_basic(good_hash, 0);
+	test_basic(good_hash, 1);
+	test_basic(good_hash, 16);
+	test_basic(good_hash, 17);
+	test_basic(good_hash, NNODES);
+	test_basic(bad_hash, 300);
+	test_remove_iter();
+	test_resize();
+}
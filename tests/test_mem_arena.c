@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <jeffpc/mem.h>
+#include <jeffpc/error.h>
+
+#include "test.c"
+
+#define NALLOCS		2000
+
+struct alloc {
+	uint8_t *ptr;
+	size_t size;
+};
+
+static void check_fill(struct alloc *a, uint8_t pattern)
+{
+	size_t i;
+
+	for (i = 0; i < a->size; i++)
+		if (a->ptr[i] != pattern)
+			fail("allocation %p byte %zu corrupted: expected %#x, "
+			     "got %#x", a->ptr, i, pattern, a->ptr[i]);
+}
+
+static void test_allocs(struct mem_arena *arena, size_t size, size_t align)
+{
+	struct alloc *allocs;
+	size_t i;
+
+	fprintf(stderr, "size %zu, align %zu...", size, align);
+
+	allocs = calloc(NALLOCS, sizeof(struct alloc));
+	if (!allocs)
+		fail("failed to allocate allocation array");
+
+	for (i = 0; i < NALLOCS; i++) {
+		/* vary the size a little to exercise the bump pointer */
+		allocs[i].size = size + (i % 7);
+		allocs[i].ptr = mem_arena_alloc_aligned(arena, allocs[i].size,
+							align);
+		if (!allocs[i].ptr)
+			fail("allocation %zu failed", i);
+
+		if (align && ((uintptr_t) allocs[i].ptr) % align)
+			fail("allocation %p is not aligned to %zu",
+			     allocs[i].ptr, align);
+
+		memset(allocs[i].ptr, i & 0xff, allocs[i].size);
+	}
+
+	/* no allocation may have overwritten another */
+	for (i = 0; i < NALLOCS; i++)
+		check_fill(&allocs[i], i & 0xff);
+
+	free(allocs);
+
+	mem_arena_reset(arena);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_default_align(struct mem_arena *arena)
+{
+	size_t i;
+
+	fprintf(stderr, "default alignment...");
+
+	for (i = 0; i < NALLOCS; i++) {
+		void *ptr;
+
+		ptr = mem_arena_alloc(arena, i % 33);
+		if (!ptr)
+			fail("allocation %zu failed", i);
+
+		if (((uintptr_t) ptr) % sizeof(uint64_t))
+			fail("allocation %p is not naturally aligned", ptr);
+	}
+
+	mem_arena_reset(arena);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_zero_size(struct mem_arena *arena)
+{
+	void *a, *b;
+
+	fprintf(stderr, "zero-sized allocations...");
+
+	a = mem_arena_alloc(arena, 0);
+	b = mem_arena_alloc(arena, 0);
+
+	if (!a || !b)
+		fail("zero-sized allocation failed");
+	if (a == b)
+		fail("zero-sized allocations returned the same address");
+
+	mem_arena_reset(arena);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_reuse(void)
+{
+	struct mem_arena *arena;
+	void *first, *again;
+	int i;
+
+	fprintf(stderr, "reset reuse...");
+
+	arena = mem_arena_create();
+	if (IS_ERR(arena))
+		fail("mem_arena_create() failed: %s",
+		     xstrerror(PTR_ERR(arena)));
+
+	first = mem_arena_alloc(arena, 64);
+	if (!first)
+		fail("allocation failed");
+
+	for (i = 0; i < 10; i++) {
+		if (!mem_arena_alloc(arena, 1000))
+			fail("allocation failed");
+		if (!mem_arena_alloc(arena, 100000))
+			fail("large allocation failed");
+
+		mem_arena_reset(arena);
+
+		again = mem_arena_alloc(arena, 64);
+		if (again != first)
+			fail("reset arena did not reuse its first chunk "
+			     "(%p != %p)", again, first);
+	}
+
+	mem_arena_destroy(arena);
+
+	/* many short-lived arenas */
+	for (i = 0; i < 10000; i++) {
+		arena = mem_arena_create();
+		if (IS_ERR(arena))
+			fail("mem_arena_create() failed: %s",
+			     xstrerror(PTR_ERR(arena)));
+
+		if (!mem_arena_alloc(arena, 100))
+			fail("allocation failed");
+
+		mem_arena_destroy(arena);
+	}
+
+	fprintf(stderr, "ok.\n");
+}
+
+void test(void)
+{
+	struct mem_arena *arena;
+
+	arena = mem_arena_create();
+	if (IS_ERR(arena))
+		fail("mem_arena_create() failed: %s",
+		     xstrerror(PTR_ERR(arena)));
+
+	if (mem_arena_alloc_aligned(arena, 8, 3))
+		fail("non-power-of-2 aligned allocation succeeded");
+
+	test_allocs(arena, 1, 0);
+	test_allocs(arena, 8, 8);
+	test_allocs(arena, 24, 0);
+	test_allocs(arena, 40, 16);
+	test_allocs(arena, 100, 64);
+	test_allocs(arena, 1000, 0);
+	test_allocs(arena, 3000, 4096);
+	test_allocs(arena, 5000, 0);
+	test_allocs(arena, 100000, 8192);
+	test_default_align(arena);
+	test_zero_size(arena);
+
+	mem_arena_destroy(arena);
+
+	test_reuse();
+}
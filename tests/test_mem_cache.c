@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+
+#include <jeffpc/mem.h>
+#include <jeffpc/nvl.h>
+#include <jeffpc/thread.h>
+#include <jeffpc/error.h>
+
+#include "test.c"
+
+#define NOBJS		10000
+#define NTHREADS	4
+
+static void fill(void *obj, size_t size, uint8_t pattern)
+{
+	memset(obj, pattern, size);
+}
+
+static void check_fill(void *obj, size_t size, uint8_t pattern)
+{
+	uint8_t *ptr = obj;
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		if (ptr[i] != pattern)
+			fail("object %p byte %zu corrupted: expected %#x, "
+			     "got %#x", obj, i, pattern, ptr[i]);
+}
+
+static void test_cache(size_t size, size_t align)
+{
+	struct mem_cache *cache;
+	void **objs;
+	size_t i;
+
+	fprintf(stderr, "size %zu, align %zu...", size, align);
+
+	cache = mem_cache_create("test-cache", size, align);
+	if (IS_ERR(cache))
+		fail("mem_cache_create failed: %s",
+		     xstrerror(PTR_ERR(cache)));
+
+	objs = calloc(NOBJS, sizeof(void *));
+	if (!objs)
+		fail("calloc failed");
+
+	/* allocate twice to exercise reuse of freed objects */
+	for (i = 0; i < NOBJS * 2; i++) {
+		size_t idx = i % NOBJS;
+
+		if (objs[idx]) {
+			check_fill(objs[idx], size, idx & 0xff);
+			mem_cache_free(cache, objs[idx]);
+		}
+
+		objs[idx] = mem_cache_alloc(cache);
+		if (!objs[idx])
+			fail("mem_cache_alloc failed");
+
+		if (align && ((uintptr_t) objs[idx] % align))
+			fail("object %p is not %zu-byte aligned", objs[idx],
+			     align);
+
+		fill(objs[idx], size, idx & 0xff);
+	}
+
+	for (i = 0; i < NOBJS; i++) {
+		check_fill(objs[i], size, i & 0xff);
+		mem_cache_free(cache, objs[i]);
+	}
+
+	free(objs);
+
+	mem_cache_destroy(cache);
+
+	fprintf(stderr, "ok\n");
+}
+
+#define CTOR_MAGIC	0x1234567890abcdefull
+
+static size_t nctor;
+static size_t ndtor;
+static bool ctor_fail;
+
+static int test_ctor(void *obj, void *priv)
+{
+	if (priv != &nctor)
+		fail("ctor got wrong private pointer %p", priv);
+
+	if (ctor_fail)
+		return -ENOMEM;
+
+	*((uint64_t *) obj) = CTOR_MAGIC;
+	nctor++;
+
+	return 0;
+}
+
+static void test_dtor(void *obj, void *priv)
+{
+	if (priv != &nctor)
+		fail("dtor got wrong private pointer %p", priv);
+
+	if (*((uint64_t *) obj) != CTOR_MAGIC)
+		fail("dtor got unconstructed object %p", obj);
+
+	ndtor++;
+}
+
+static void test_ctor_dtor(void)
+{
+	struct mem_cache *cache;
+	uint64_t *objs[NOBJS];
+	size_t i;
+
+	fprintf(stderr, "ctor/dtor...");
+
+	nctor = 0;
+	ndtor = 0;
+	ctor_fail = false;
+
+	cache = mem_cache_create_ext("test-ctor-cache", sizeof(uint64_t), 0,
+				     test_ctor, test_dtor, &nctor);
+	if (IS_ERR(cache))
+		fail("mem_cache_create_ext failed: %s",
+		     xstrerror(PTR_ERR(cache)));
+
+	for (i = 0; i < NOBJS; i++) {
+		objs[i] = mem_cache_alloc(cache);
+		if (!objs[i])
+			fail("mem_cache_alloc failed");
+
+		if (*objs[i] != CTOR_MAGIC)
+			fail("allocated object %p is not constructed", objs[i]);
+	}
+
+	if (nctor != NOBJS)
+		fail("expected %u ctor calls, got %zu", NOBJS, nctor);
+
+	for (i = 0; i < NOBJS; i++)
+		mem_cache_free(cache, objs[i]);
+
+	/* cached objects are returned without another ctor call */
+	objs[0] = mem_cache_alloc(cache);
+	if (!objs[0] || (*objs[0] != CTOR_MAGIC))
+		fail("reallocated object is not constructed");
+	mem_cache_free(cache, objs[0]);
+
+	if (nctor != NOBJS)
+		fail("expected %u ctor calls, got %zu", NOBJS, nctor);
+
+	mem_cache_destroy(cache);
+
+	if (nctor != ndtor)
+		fail("ctor/dtor call mismatch: %zu vs. %zu", nctor, ndtor);
+
+	/* a failing ctor fails the allocation */
+	cache = mem_cache_create_ext("test-ctor-cache", sizeof(uint64_t), 0,
+				     test_ctor, test_dtor, &nctor);
+	if (IS_ERR(cache))
+		fail("mem_cache_create_ext failed: %s",
+		     xstrerror(PTR_ERR(cache)));
+
+	ctor_fail = true;
+
+	if (mem_cache_alloc(cache))
+		fail("mem_cache_alloc succeeded despite ctor failure");
+
+	mem_cache_destroy(cache);
+
+	fprintf(stderr, "ok\n");
+}
+
+static void check_stat(struct nvlist *stats, const char *name,
+		       uint64_t expected, bool atleast)
+{
+	uint64_t got;
+	int ret;
+
+	ret = nvl_lookup_int(stats, name, &got);
+	if (ret)
+		fail("failed to look up '%s': %s", name, xstrerror(ret));
+
+	if (atleast ? (got < expected) : (got != expected))
+		fail("'%s' mismatch: expected %s%"PRIu64", got %"PRIu64,
+		     name, atleast ? ">= " : "", expected, got);
+}
+
+static void check_stats(uint64_t allocs, uint64_t frees)
+{
+	struct nvlist *all, *stats;
+
+	all = mem_cache_stats();
+	if (IS_ERR(all))
+		fail("mem_cache_stats failed: %s", xstrerror(PTR_ERR(all)));
+
+	stats = nvl_lookup_nvl(all, "test-stats-cache");
+	if (IS_ERR(stats))
+		fail("failed to look up cache stats: %s",
+		     xstrerror(PTR_ERR(stats)));
+
+	check_stat(stats, "size", sizeof(uint64_t), false);
+	check_stat(stats, "allocs", allocs, false);
+	check_stat(stats, "frees", frees, false);
+	check_stat(stats, "live", allocs - frees, false);
+	check_stat(stats, "peak", allocs - frees, true);
+	check_stat(stats, "slab_used", allocs - frees, true);
+
+	nvl_putref(stats);
+	nvl_putref(all);
+}
+
+static void test_stats(void)
+{
+	struct mem_cache *cache;
+	void *objs[NOBJS];
+	size_t i;
+
+	fprintf(stderr, "stats...");
+
+	cache = mem_cache_create("test-stats-cache", sizeof(uint64_t), 0);
+	if (IS_ERR(cache))
+		fail("mem_cache_create failed: %s",
+		     xstrerror(PTR_ERR(cache)));
+
+	check_stats(0, 0);
+
+	for (i = 0; i < NOBJS; i++) {
+		objs[i] = mem_cache_alloc(cache);
+		if (!objs[i])
+			fail("mem_cache_alloc failed");
+	}
+
+	check_stats(NOBJS, 0);
+
+	for (i = 0; i < NOBJS / 2; i++)
+		mem_cache_free(cache, objs[i]);
+
+	check_stats(NOBJS, NOBJS / 2);
+
+	for (i = NOBJS / 2; i < NOBJS; i++)
+		mem_cache_free(cache, objs[i]);
+
+	check_stats(NOBJS, NOBJS);
+
+	mem_cache_destroy(cache);
+
+	fprintf(stderr, "ok\n");
+}
+
+static struct mem_cache *mt_cache;
+static void **mt_objs;
+
+static void *mt_alloc(void *arg)
+{
+	uintptr_t tid = (uintptr_t) arg;
+	size_t i;
+
+	for (i = tid; i < NOBJS; i += NTHREADS) {
+		mt_objs[i] = mem_cache_alloc(mt_cache);
+		if (!mt_objs[i])
+			fail("mem_cache_alloc failed");
+
+		fill(mt_objs[i], sizeof(uint64_t), i & 0xff);
+	}
+
+	return NULL;
+}
+
+static void *mt_free(void *arg)
+{
+	uintptr_t tid = (uintptr_t) arg;
+	size_t i;
+
+	/* free objects allocated by a different thread */
+	for (i = (tid + 1) % NTHREADS; i < NOBJS; i += NTHREADS) {
+		check_fill(mt_objs[i], sizeof(uint64_t), i & 0xff);
+		mem_cache_free(mt_cache, mt_objs[i]);
+	}
+
+	return NULL;
+}
+
+static void run_threads(void *(*fxn)(void *))
+{
+	pthread_t threads[NTHREADS];
+	uintptr_t i;
+	int ret;
+
+	for (i = 0; i < NTHREADS; i++) {
+		ret = xthr_create(&threads[i], fxn, (void *) i);
+		if (ret)
+			fail("xthr_create failed: %s", xstrerror(ret));
+	}
+
+	for (i = 0; i < NTHREADS; i++) {
+		ret = xthr_join(threads[i], NULL);
+		if (ret)
+			fail("xthr_join failed: %s", xstrerror(ret));
+	}
+}
+
+static void test_threads(void)
+{
+	fprintf(stderr, "multi-threaded...");
+
+	mt_cache = mem_cache_create("test-mt-cache", sizeof(uint64_t), 0);
+	if (IS_ERR(mt_cache))
+		fail("mem_cache_create failed: %s",
+		     xstrerror(PTR_ERR(mt_cache)));
+
+	mt_objs = calloc(NOBJS, sizeof(void *));
+	if (!mt_objs)
+		fail("calloc failed");
+
+	run_threads(mt_alloc);
+	run_threads(mt_free);
+
+	free(mt_objs);
+
+	mem_cache_destroy(mt_cache);
+
+	fprintf(stderr, "ok\n");
+}
+
+void test(void)
+{
+	struct mem_cache *cache;
+
+	cache = mem_cache_create("test-bad-cache", 0, 0);
+	if (!IS_ERR(cache))
+		fail("zero-sized cache creation succeeded");
+
+	cache = mem_cache_create("test-bad-cache", 8, 3);
+	if (!IS_ERR(cache))
+		fail("non-power-of-2 aligned cache creation succeeded");
+
+	test_cache(1, 0);
+	test_cache(8, 0);
+	test_cache(24, 0);
+	test_cache(40, 16);
+	test_cache(100, 64);
+	test_cache(1000, 0);
+	test_cache(4096, 4096);
+	test_cache(100000, 0);
+
+	test_ctor_dtor();
+	test_stats();
+	test_threads();
+}
@@ -21,6 +21,7 @@
  */
 
 #include <jeffpc/nvl.h>
+#include <jeffpc/cbor.h>
 
 #include "test.c"
 
@@ -121,6 +122,14 @@ static void check_key_not_exists(struct nvlist *nvl, const char *key)
 	str = nvl_lookup_str(nvl, key);
 	__check_lookup_err(IS_ERR(str), true, PTR_ERR(str), -ENOENT,
 			   "nvl_lookup_str", key);
+
+	cnvl = nvl_lookup_nvl_noref(nvl, key);
+	__check_lookup_err(IS_ERR(cnvl), true, PTR_ERR(cnvl), -ENOENT,
+			   "nvl_lookup_nvl_noref", key);
+
+	str = nvl_lookup_str_noref(nvl, key);
+	__check_lookup_err(IS_ERR(str), true, PTR_ERR(str), -ENOENT,
+			   "nvl_lookup_str_noref", key);
 }
 
 static void check_key_exists(struct nvlist *nvl, const char *key,
@@ -171,6 +180,20 @@ static void check_key_exists(struct nvlist *nvl, const char *key,
 	str = nvl_lookup_str(nvl, key);
 	__check_lookup_err(IS_ERR(str), type != VT_STR, PTR_ERR(str),
 			   -ERANGE, "nvl_lookup_str", key);
+
+	cnvl = nvl_lookup_nvl_noref(nvl, key);
+	__check_lookup_err(IS_ERR(cnvl), type != VT_NVL, PTR_ERR(cnvl),
+			   -ERANGE, "nvl_lookup_nvl_noref", key);
+	if (!IS_ERR(cnvl) && (cnvl != val_cast_to_nvl(pair->value)))
+		fail("nvl_lookup_nvl_noref(..., '%s') returned wrong nvlist",
+		     key);
+
+	str = nvl_lookup_str_noref(nvl, key);
+	__check_lookup_err(IS_ERR(str), type != VT_STR, PTR_ERR(str),
+			   -ERANGE, "nvl_lookup_str_noref", key);
+	if (!IS_ERR(str) && (str != val_cast_to_str(pair->value)))
+		fail("nvl_lookup_str_noref(..., '%s') returned wrong string",
+		     key);
 }
 
 static inline void check_empty(struct nvlist *nvl)
@@ -350,6 +373,371 @@ static void test_merge(void)
 	fprintf(stderr, "ok.\n");
 }
 
+#define HASHED_NKEYS	1000
+
+static void check_sorted(struct nvlist *nvl, size_t exp)
+{
+	const struct nvpair *pair, *prev;
+	size_t n;
+
+	n = 0;
+	prev = NULL;
+
+	nvl_for_each(pair, nvl) {
+		if (prev && (strcmp(nvpair_name(prev), nvpair_name(pair)) >= 0))
+			fail("iteration out of order: '%s' before '%s'",
+			     nvpair_name(prev), nvpair_name(pair));
+
+		prev = pair;
+		n++;
+	}
+
+	if (n != exp)
+		fail("iteration returned %zu pairs, expected %zu", n, exp);
+}
+
+static void __test_hashed(struct nvlist *nvl)
+{
+	char key[32];
+	size_t i;
+
+	/* insert in a scrambled order */
+	for (i = 0; i < HASHED_NKEYS; i++) {
+		snprintf(key, sizeof(key), "key-%zu", (i * 7919) % HASHED_NKEYS);
+		set_int(nvl, key, i);
+	}
+
+	check_sorted(nvl, HASHED_NKEYS);
+
+	/* remove every third key */
+	for (i = 0; i < HASHED_NKEYS; i += 3) {
+		snprintf(key, sizeof(key), "key-%zu", i);
+
+		if (nvl_unset(nvl, key))
+			fail("nvl_unset(..., '%s') failed", key);
+	}
+
+	for (i = 0; i < HASHED_NKEYS; i++) {
+		snprintf(key, sizeof(key), "key-%zu", i);
+
+		if (i % 3)
+			check_key_exists(nvl, key, VT_INT);
+		else
+			check_key_not_exists(nvl, key);
+	}
+
+	check_sorted(nvl, HASHED_NKEYS - (HASHED_NKEYS + 2) / 3);
+
+	/* replacing a value doesn't add a pair */
+	set_bool(nvl, "key-1", true);
+	check_key_exists(nvl, "key-1", VT_BOOL);
+	check_sorted(nvl, HASHED_NKEYS - (HASHED_NKEYS + 2) / 3);
+
+	nvl_putref(nvl);
+}
+
+static void test_hashed(void)
+{
+	struct nvlist *nvl;
+
+	fprintf(stderr, "%s...", __func__);
+
+	fprintf(stderr, "regular...");
+	__test_hashed(alloc());
+
+	fprintf(stderr, "hashed...");
+	nvl = nvl_alloc_hashed();
+	if (IS_ERR(nvl))
+		fail("nvl_alloc_hashed() failed");
+	check_empty(nvl);
+	check_key_not_exists(nvl, "non-existent");
+	__test_hashed(nvl);
+
+	fprintf(stderr, "ok.\n");
+}
+
+/* exercise the small nvlist array & the switch away from it */
+static void test_small(void)
+{
+	const struct nvpair *pair;
+	struct nvlist *nvl;
+	char key[32];
+	int i;
+
+	fprintf(stderr, "%s...", __func__);
+
+	nvl = alloc();
+
+	/* fill it up in reverse order */
+	for (i = 7; i >= 0; i--) {
+		snprintf(key, sizeof(key), "key-%d", i);
+		set_int(nvl, key, i);
+	}
+
+	check_sorted(nvl, 8);
+
+	/* pairs stay put when others are added or removed */
+	pair = nvl_lookup(nvl, "key-5");
+	if (IS_ERR(pair))
+		fail("nvl_lookup(..., 'key-5') failed");
+
+	/* punch a couple of holes & fill them back in */
+	if (nvl_unset(nvl, "key-2") || nvl_unset(nvl, "key-6"))
+		fail("nvl_unset() failed");
+
+	check_key_not_exists(nvl, "key-2");
+	check_key_not_exists(nvl, "key-6");
+	check_sorted(nvl, 6);
+
+	set_null(nvl, "key-a");
+	set_bool(nvl, "key-00", true);
+
+	if (strcmp(nvpair_name(pair), "key-5"))
+		fail("pair name changed to '%s'", nvpair_name(pair));
+
+	check_key_exists(nvl, "key-a", VT_NULL);
+	check_key_exists(nvl, "key-00", VT_BOOL);
+	check_key_exists(nvl, "key-5", VT_INT);
+	check_sorted(nvl, 8);
+
+	/* replacing a value in a full array doesn't add a pair */
+	set_bool(nvl, "key-1", false);
+	check_key_exists(nvl, "key-1", VT_BOOL);
+	check_sorted(nvl, 8);
+
+	/* outgrow the array */
+	for (i = 10; i < 30; i++) {
+		snprintf(key, sizeof(key), "key-%d", i);
+		set_int(nvl, key, i);
+
+		check_sorted(nvl, 8 + i - 9);
+	}
+
+	check_key_exists(nvl, "key-00", VT_BOOL);
+	check_key_exists(nvl, "key-a", VT_NULL);
+	check_key_exists(nvl, "key-7", VT_INT);
+	check_key_exists(nvl, "key-29", VT_INT);
+	check_key_not_exists(nvl, "key-2");
+
+	nvl_putref(nvl);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void check_keys(struct nvlist *nvl, size_t npairs)
+{
+	struct nvl_key key;
+	char name[32];
+	size_t i;
+
+	for (i = 0; i < npairs + 2; i++) {
+		const struct nvpair *pair;
+		uint64_t got;
+		int ret;
+
+		snprintf(name, sizeof(name), "key-%zu", i);
+		nvl_key_init(&key, name);
+
+		ret = nvl_lookup_int_key(nvl, &key, &got);
+		check_rets((i < npairs) ? 0 : -ENOENT, ret,
+			   "nvl_lookup_int_key(..., '%s')", name);
+		if (!ret && (got != i))
+			fail("nvl_lookup_int_key(..., '%s') returned %"PRIu64,
+			     name, got);
+
+		ret = nvl_lookup_null_key(nvl, &key);
+		check_rets((i < npairs) ? -ERANGE : -ENOENT, ret,
+			   "nvl_lookup_null_key(..., '%s')", name);
+
+		pair = nvl_lookup_key(nvl, &key);
+		if ((i < npairs) ? IS_ERR(pair) : !IS_ERR(pair))
+			fail("nvl_lookup_key(..., '%s') returned %p", name,
+			     pair);
+	}
+}
+
+static void test_key(void)
+{
+	struct nvlist *nvl, *pnvl;
+	char name[32];
+	size_t i;
+
+	fprintf(stderr, "%s...", __func__);
+
+	nvl = alloc();
+
+	/* cover all the in-place representations as the nvlist grows */
+	for (i = 0; i < 40; i++) {
+		snprintf(name, sizeof(name), "key-%zu", i);
+		set_int(nvl, name, i);
+
+		check_keys(nvl, i + 1);
+	}
+
+	pnvl = nvl_persist(nvl);
+	if (IS_ERR(pnvl))
+		fail("nvl_persist() failed: %s", xstrerror(PTR_ERR(pnvl)));
+
+	check_keys(pnvl, 40);
+
+	nvl_putref(pnvl);
+	nvl_putref(nvl);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_noref(void)
+{
+	struct nvlist *nvl, *inner, *got_nvl;
+	struct nvl_key key;
+	struct str *got_str;
+
+	fprintf(stderr, "%s...", __func__);
+
+	nvl = alloc();
+	inner = alloc();
+
+	if (nvl_set_str(nvl, "str", STR_DUP("abc")))
+		fail("nvl_set_str() failed");
+	if (nvl_set_nvl(nvl, "nvl", inner))
+		fail("nvl_set_nvl() failed");
+
+	got_str = nvl_lookup_str_noref(nvl, "str");
+	if (IS_ERR(got_str) || strcmp(str_cstr(got_str), "abc"))
+		fail("nvl_lookup_str_noref() returned wrong string");
+
+	nvl_key_init(&key, "str");
+	if (nvl_lookup_str_noref_key(nvl, &key) != got_str)
+		fail("nvl_lookup_str_noref_key() returned wrong string");
+
+	got_nvl = nvl_lookup_nvl_noref(nvl, "nvl");
+	if (got_nvl != inner)
+		fail("nvl_lookup_nvl_noref() returned wrong nvlist");
+
+	check_rets(-ERANGE, PTR_ERR(nvl_lookup_nvl_noref(nvl, "str")),
+		   "nvl_lookup_nvl_noref(..., 'str')");
+	check_rets(-ERANGE, PTR_ERR(nvl_lookup_str_noref(nvl, "nvl")),
+		   "nvl_lookup_str_noref(..., 'nvl')");
+
+	/* no references were taken, so this frees everything */
+	nvl_putref(nvl);
+
+	fprintf(stderr, "ok.\n");
+}
+
+#define BULK_NKEYS	100
+
+static void bulk_set(struct nvlist *nvl, size_t npairs, size_t mult)
+{
+	struct str *names[BULK_NKEYS];
+	struct val *vals[BULK_NKEYS];
+	char key[32];
+	size_t i;
+	int ret;
+
+	for (i = 0; i < npairs; i++) {
+		snprintf(key, sizeof(key), "key-%03zu", (i * mult) % npairs);
+
+		names[i] = STR_DUP(key);
+		vals[i] = VAL_ALLOC_INT(i);
+	}
+
+	ret = nvl_set_bulk(nvl, names, vals, npairs);
+	check_rets(0, ret, "nvl_set_bulk(..., %zu)", npairs);
+}
+
+static void check_bulk(struct nvlist *nvl, size_t npairs, size_t mult)
+{
+	char key[32];
+	size_t i;
+
+	for (i = 0; i < npairs; i++) {
+		uint64_t got;
+		int ret;
+
+		snprintf(key, sizeof(key), "key-%03zu", (i * mult) % npairs);
+
+		ret = nvl_lookup_int(nvl, key, &got);
+		check_rets(0, ret, "nvl_lookup_int(..., '%s')", key);
+		if (got != i)
+			fail("nvl_lookup_int(..., '%s') returned %"PRIu64
+			     ", expected %zu", key, got, i);
+	}
+}
+
+static void check_bulk_copies(struct nvlist *nvl)
+{
+	struct nvlist *copy;
+	struct buffer *buf;
+	struct val *val;
+
+	/* nvl_merge into an empty nvlist */
+	copy = alloc();
+	merge(copy, nvl);
+	if (!val_equal(nvl_cast_to_val(nvl), nvl_cast_to_val(copy)))
+		fail("merged nvlist differs");
+	nvl_putref(copy);
+
+	/* cbor maps */
+	buf = nvl_pack(nvl, VF_CBOR);
+	if (IS_ERR(buf))
+		fail("nvl_pack() failed: %s", xstrerror(PTR_ERR(buf)));
+
+	copy = nvl_unpack(buffer_data(buf), buffer_size(buf), VF_CBOR);
+	if (IS_ERR(copy))
+		fail("nvl_unpack() failed: %s", xstrerror(PTR_ERR(copy)));
+	if (!val_equal(nvl_cast_to_val(nvl), nvl_cast_to_val(copy)))
+		fail("unpacked nvlist differs");
+	nvl_putref(copy);
+
+	val = cbor_unpack_val_arena(buf);
+	if (IS_ERR(val))
+		fail("cbor_unpack_val_arena() failed: %s",
+		     xstrerror(PTR_ERR(val)));
+	if (!val_equal(nvl_cast_to_val(nvl), val))
+		fail("arena unpacked nvlist differs");
+	val_putref(val);
+
+	buffer_free(buf);
+}
+
+static void test_bulk(void)
+{
+	static const size_t sizes[] = { 0, 5, 8, 9, 15, 16, BULK_NKEYS };
+	struct nvlist *nvl;
+	size_t i;
+
+	fprintf(stderr, "%s...", __func__);
+
+	for (i = 0; i < ARRAY_LEN(sizes); i++) {
+		/* sorted into an empty nvlist */
+		nvl = alloc();
+		bulk_set(nvl, sizes[i], 1);
+		check_bulk(nvl, sizes[i], 1);
+		check_sorted(nvl, sizes[i]);
+		check_bulk_copies(nvl);
+		nvl_putref(nvl);
+
+		/* unsorted */
+		nvl = alloc();
+		bulk_set(nvl, sizes[i], 7);
+		check_bulk(nvl, sizes[i], 7);
+		check_sorted(nvl, sizes[i]);
+		nvl_putref(nvl);
+	}
+
+	/* sorted into a non-empty nvlist */
+	nvl = alloc();
+	set_bool(nvl, "abc", true);
+	bulk_set(nvl, BULK_NKEYS, 1);
+	check_bulk(nvl, BULK_NKEYS, 1);
+	check_sorted(nvl, BULK_NKEYS + 1);
+	check_key_exists(nvl, "abc", VT_BOOL);
+	nvl_putref(nvl);
+
+	fprintf(stderr, "ok.\n");
+}
+
 void test(void)
 {
 	test_alloc_free();
@@ -357,4 +745,9 @@ void test(void)
 	test_lookup_empty();
 	test_lookup_simple();
 	test_merge();
+	test_hashed();
+	test_small();
+	test_key();
+	test_noref();
+	test_bulk();
 }
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <jeffpc/mem.h>
+#include <jeffpc/nvl.h>
+
+#include "test.c"
+
+static struct nvl_path *compile(const char *str)
+{
+	struct nvl_path *path;
+
+	path = nvl_path_compile(str);
+	if (IS_ERR(path))
+		fail("nvl_path_compile('%s') failed: %s", str,
+		     xstrerror(PTR_ERR(path)));
+
+	return path;
+}
+
+static void test_compile_bad(void)
+{
+	static const char *bad[] = {
+		"",
+		".",
+		"a.",
+		".a",
+		"a..b",
+		"a[",
+		"a[]",
+		"a[x]",
+		"a[-1]",
+		"a[0",
+		"a]",
+		"a[0]b",
+		"[0]",
+		"a.[0]",
+		"a[99999999999999999999999]",
+	};
+	size_t i;
+
+	fprintf(stderr, "%s...", __func__);
+
+	for (i = 0; i < ARRAY_LEN(bad); i++) {
+		struct nvl_path *path;
+
+		path = nvl_path_compile(bad[i]);
+		check_rets(-EINVAL, IS_ERR(path) ? PTR_ERR(path) : 0,
+			   "nvl_path_compile('%s')", bad[i]);
+	}
+
+	fprintf(stderr, "ok.\n");
+}
+
+/*
+ * {
+ *   "name": "foo",
+ *   "server": {
+ *     "listen": { "port": 8080, "tls": true },
+ *     "backends": [ { "port": 1 }, 5, [ "x", "y" ] ],
+ *   },
+ * }
+ */
+static struct nvlist *build(void)
+{
+	struct nvlist *root, *server, *listen, *backend;
+	struct val **inner, **backends;
+
+	root = nvl_alloc();
+	server = nvl_alloc();
+	listen = nvl_alloc();
+	backend = nvl_alloc();
+	inner = mem_reallocarray(NULL, 2, sizeof(struct val *));
+	backends = mem_reallocarray(NULL, 3, sizeof(struct val *));
+	if (!root || !server || !listen || !backend || !inner || !backends)
+		fail("allocation failed");
+
+	inner[0] = VAL_DUP_STR("x");
+	inner[1] = VAL_DUP_STR("y");
+
+	if (nvl_set_int(backend, "port", 1))
+		fail("failed to set backend port");
+
+	backends[0] = nvl_cast_to_val(backend);
+	backends[1] = VAL_ALLOC_INT(5);
+	backends[2] = VAL_ALLOC_ARRAY(inner, 2);
+
+	if (nvl_set_int(listen, "port", 8080) ||
+	    nvl_set_bool(listen, "tls", true) ||
+	    nvl_set_nvl(server, "listen", listen) ||
+	    nvl_set_array(server, "backends", backends, 3) ||
+	    nvl_set_nvl(root, "server", server) ||
+	    nvl_set_cstr_dup(root, "name", "foo"))
+		fail("failed to build nvlist");
+
+	return root;
+}
+
+static void check_int(struct nvlist *nvl, const char *str, int exp_ret,
+		      uint64_t exp)
+{
+	struct nvl_path *path;
+	uint64_t got;
+	int ret;
+
+	path = compile(str);
+
+	ret = nvl_path_lookup_int(nvl, path, &got);
+	check_rets(exp_ret, ret, "nvl_path_lookup_int(..., '%s')", str);
+
+	if (!ret && (got != exp))
+		fail("nvl_path_lookup_int(..., '%s') returned %"PRIu64
+		     ", expected %"PRIu64, str, got, exp);
+
+	nvl_path_free(path);
+}
+
+static void check_str(struct nvlist *nvl, const char *str, const char *exp)
+{
+	struct nvl_path *path;
+	struct str *got;
+
+	path = compile(str);
+
+	got = nvl_path_lookup_str_noref(nvl, path);
+	if (IS_ERR(got))
+		fail("nvl_path_lookup_str_noref(..., '%s') failed: %s", str,
+		     xstrerror(PTR_ERR(got)));
+
+	if (strcmp(str_cstr(got), exp))
+		fail("nvl_path_lookup_str_noref(..., '%s') returned '%s', "
+		     "expected '%s'", str, str_cstr(got), exp);
+
+	nvl_path_free(path);
+}
+
+static void test_lookup(void)
+{
+	struct nvl_path *path;
+	struct nvlist *nvl;
+	struct nvlist *got;
+	bool b;
+	int ret;
+
+	fprintf(stderr, "%s...", __func__);
+
+	nvl = build();
+
+	check_int(nvl, "server.listen.port", 0, 8080);
+	check_int(nvl, "server.backends[0].port", 0, 1);
+	check_int(nvl, "server.backends[1]", 0, 5);
+	check_str(nvl, "server.backends[2][1]", "y");
+	check_str(nvl, "name", "foo");
+
+	/* missing */
+	check_int(nvl, "server.listen.addr", -ENOENT, 0);
+	check_int(nvl, "server.backends[3]", -ENOENT, 0);
+	check_int(nvl, "client.port", -ENOENT, 0);
+
+	/* wrong types along the way & at the end */
+	check_int(nvl, "name.port", -ERANGE, 0);
+	check_int(nvl, "server[0]", -ERANGE, 0);
+	check_int(nvl, "server.backends.port", -ERANGE, 0);
+	check_int(nvl, "server.listen.tls", -ERANGE, 0);
+
+	path = compile("server.listen.tls");
+	ret = nvl_path_lookup_bool(nvl, path, &b);
+	check_rets(0, ret, "nvl_path_lookup_bool(..., 'server.listen.tls')");
+	if (!b)
+		fail("nvl_path_lookup_bool() returned false");
+	nvl_path_free(path);
+
+	/* the returned nvlist is the one in the tree */
+	path = compile("server.listen");
+	got = nvl_path_lookup_nvl_noref(nvl, path);
+	if (IS_ERR(got))
+		fail("nvl_path_lookup_nvl_noref() failed: %s",
+		     xstrerror(PTR_ERR(got)));
+	if (nvl_path_lookup(nvl, path) != nvl_cast_to_val(got))
+		fail("nvl_path_lookup() and nvl_path_lookup_nvl_noref() "
+		     "disagree");
+	nvl_path_free(path);
+
+	/* no references were taken, so this frees everything */
+	nvl_putref(nvl);
+
+	fprintf(stderr, "ok.\n");
+}
+
+/* one compiled path works with any number of nvlists */
+static void test_reuse(void)
+{
+	struct nvl_path *path;
+	int i;
+
+	fprintf(stderr, "%s...", __func__);
+
+	path = compile("a.b");
+
+	for (i = 0; i < 10; i++) {
+		struct nvlist *outer, *inner;
+		uint64_t got;
+		int ret;
+
+		outer = nvl_alloc();
+		inner = nvl_alloc();
+		if (!outer || !inner)
+			fail("nvl_alloc() failed");
+
+		if (nvl_set_int(inner, "b", i) ||
+		    nvl_set_nvl(outer, "a", inner))
+			fail("failed to build nvlist");
+
+		ret = nvl_path_lookup_int(outer, path, &got);
+		check_rets(0, ret, "nvl_path_lookup_int()");
+		if (got != i)
+			fail("nvl_path_lookup_int() returned %"PRIu64
+			     ", expected %d", got, i);
+
+		nvl_putref(outer);
+	}
+
+	nvl_path_free(path);
+
+	fprintf(stderr, "ok.\n");
+}
+
+void test(void)
+{
+	test_compile_bad();
+	test_lookup();
+	test_reuse();
+}
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <jeffpc/nvl.h>
+#include <jeffpc/rand.h>
+
+#include "test.c"
+
+#define NKEYS		1000
+#define NRANDOM		10000
+
+static void keyname(char *buf, size_t len, uint64_t i)
+{
+	snprintf(buf, len, "key-%04"PRIu64, i);
+}
+
+static void check_equal(struct nvlist *a, struct nvlist *b, const char *what)
+{
+	struct buffer *abuf, *bbuf;
+
+	if (!val_equal(nvl_cast_to_val(a), nvl_cast_to_val(b)))
+		fail("%s: nvlists differ", what);
+
+	if (val_hash(nvl_cast_to_val(a)) != val_hash(nvl_cast_to_val(b)))
+		fail("%s: hashes differ", what);
+
+	abuf = nvl_pack(a, VF_CBOR);
+	if (IS_ERR(abuf))
+		fail("%s: failed to pack: %s", what, xstrerror(PTR_ERR(abuf)));
+
+	bbuf = nvl_pack(b, VF_CBOR);
+	if (IS_ERR(bbuf))
+		fail("%s: failed to pack: %s", what, xstrerror(PTR_ERR(bbuf)));
+
+	if ((buffer_size(abuf) != buffer_size(bbuf)) ||
+	    memcmp(buffer_data(abuf), buffer_data(bbuf), buffer_size(abuf)))
+		fail("%s: packed nvlists differ", what);
+
+	buffer_free(abuf);
+	buffer_free(bbuf);
+}
+
+static void check_int(struct nvlist *nvl, const char *key, int exp_ret,
+		      uint64_t exp)
+{
+	uint64_t got;
+	int ret;
+
+	ret = nvl_lookup_int(nvl, key, &got);
+	check_rets(exp_ret, ret, "nvl_lookup_int(..., '%s')", key);
+
+	if (!ret && (got != exp))
+		fail("nvl_lookup_int(..., '%s') returned %"PRIu64", expected "
+		     "%"PRIu64, key, got, exp);
+}
+
+static struct nvlist *pset_int(struct nvlist *nvl, const char *key,
+			       uint64_t i)
+{
+	struct nvlist *out;
+
+	out = nvl_pset(nvl, key, VAL_ALLOC_INT(i));
+	if (IS_ERR(out))
+		fail("nvl_pset(..., '%s') failed: %s", key,
+		     xstrerror(PTR_ERR(out)));
+
+	return out;
+}
+
+static void test_basic(void)
+{
+	struct nvlist *base, *pbase, *v1, *v2, *v3, *tmp;
+	const struct nvpair *pair;
+	char key[32];
+	uint64_t i;
+	int ret;
+
+	fprintf(stderr, "basic...");
+
+	base = nvl_alloc();
+	if (IS_ERR(base))
+		fail("nvl_alloc() failed");
+
+	for (i = 0; i < NKEYS; i++) {
+		keyname(key, sizeof(key), i * 2);
+
+		if (nvl_set_int(base, key, i))
+			fail("nvl_set_int(..., '%s') failed", key);
+	}
+
+	pbase = nvl_persist(base);
+	if (IS_ERR(pbase))
+		fail("nvl_persist() failed: %s", xstrerror(PTR_ERR(pbase)));
+
+	if (!nvl_is_persistent(pbase) || nvl_is_persistent(base))
+		fail("wrong persistence");
+
+	check_equal(base, pbase, "persist");
+
+	/* persisting a persistent nvlist is just a getref */
+	tmp = nvl_persist(pbase);
+	if (tmp != pbase)
+		fail("nvl_persist() of a persistent nvlist made a copy");
+	nvl_putref(tmp);
+
+	/* iteration is sorted */
+	i = 0;
+	nvl_for_each(pair, pbase) {
+		keyname(key, sizeof(key), i * 2);
+
+		if (strcmp(nvpair_name(pair), key))
+			fail("iteration returned '%s', expected '%s'",
+			     nvpair_name(pair), key);
+
+		i++;
+	}
+
+	if (i != NKEYS)
+		fail("iteration returned %"PRIu64" pairs, expected %d", i,
+		     NKEYS);
+
+	/* new key, replaced key, removed key */
+	v1 = pset_int(pbase, "key-0001", 12345);
+	v2 = pset_int(v1, "key-0000", 54321);
+	v3 = nvl_punset(v2, "key-0004");
+	if (IS_ERR(v3))
+		fail("nvl_punset() failed: %s", xstrerror(PTR_ERR(v3)));
+
+	check_int(pbase, "key-0000", 0, 0);
+	check_int(pbase, "key-0001", -ENOENT, 0);
+	check_int(pbase, "key-0004", 0, 2);
+	check_int(v1, "key-0000", 0, 0);
+	check_int(v1, "key-0001", 0, 12345);
+	check_int(v2, "key-0000", 0, 54321);
+	check_int(v2, "key-0004", 0, 2);
+	check_int(v3, "key-0000", 0, 54321);
+	check_int(v3, "key-0001", 0, 12345);
+	check_int(v3, "key-0004", -ENOENT, 0);
+	check_int(v3, "key-0006", 0, 3);
+
+	/* the base didn't change */
+	check_equal(base, pbase, "after changes");
+
+	/* persistent nvlists can't be modified in place */
+	ret = nvl_set_int(pbase, "abc", 5);
+	check_rets(-EROFS, ret, "nvl_set_int() on a persistent nvlist");
+
+	ret = nvl_unset(pbase, "key-0000");
+	check_rets(-EROFS, ret, "nvl_unset() on a persistent nvlist");
+
+	tmp = nvl_punset(pbase, "missing");
+	check_rets(-ENOENT, IS_ERR(tmp) ? PTR_ERR(tmp) : 0, "nvl_punset()");
+
+	tmp = nvl_pset(base, "abc", VAL_ALLOC_INT(5));
+	check_rets(-EINVAL, IS_ERR(tmp) ? PTR_ERR(tmp) : 0,
+		   "nvl_pset() on a regular nvlist");
+
+	/* make the same changes to the regular nvlist */
+	if (nvl_set_int(base, "key-0001", 12345) ||
+	    nvl_set_int(base, "key-0000", 54321) ||
+	    nvl_unset(base, "key-0004"))
+		fail("failed to modify regular nvlist");
+
+	check_equal(base, v3, "after same changes");
+
+	nvl_putref(pbase);
+	nvl_putref(v1);
+	nvl_putref(v2);
+	nvl_putref(v3);
+	nvl_putref(base);
+
+	fprintf(stderr, "ok.\n");
+}
+
+/*
+ * Apply random changes to both a persistent and a regular nvlist while
+ * holding on to one old version and its regular copy.
+ */
+static void test_random(void)
+{
+	struct nvlist *model, *pnvl;
+	struct nvlist *old_model, *old_pnvl;
+	size_t i;
+
+	fprintf(stderr, "random...");
+
+	model = nvl_alloc();
+	if (IS_ERR(model))
+		fail("nvl_alloc() failed");
+
+	pnvl = nvl_persist(model);
+	if (IS_ERR(pnvl))
+		fail("nvl_persist() failed: %s", xstrerror(PTR_ERR(pnvl)));
+
+	old_model = NULL;
+	old_pnvl = NULL;
+
+	for (i = 0; i < NRANDOM; i++) {
+		uint64_t k = rand32() % (NKEYS / 4);
+		struct nvlist *tmp;
+		char key[32];
+		int ret;
+
+		keyname(key, sizeof(key), k);
+
+		if (rand32() % 3) {
+			tmp = pset_int(pnvl, key, i);
+
+			if (nvl_set_int(model, key, i))
+				fail("nvl_set_int(..., '%s') failed", key);
+		} else {
+			tmp = nvl_punset(pnvl, key);
+			ret = nvl_unset(model, key);
+
+			check_rets(ret, IS_ERR(tmp) ? PTR_ERR(tmp) : 0,
+				   "nvl_punset(..., '%s')", key);
+
+			if (IS_ERR(tmp))
+				continue;
+		}
+
+		if (!old_pnvl || !(i % 1000)) {
+			/* remember this version */
+			nvl_putref(old_model);
+			nvl_putref(old_pnvl);
+
+			old_pnvl = nvl_getref(tmp);
+			old_model = nvl_alloc();
+			if (IS_ERR(old_model) || nvl_merge(old_model, model))
+				fail("failed to copy model");
+		}
+
+		nvl_putref(pnvl);
+		pnvl = tmp;
+	}
+
+	check_equal(model, pnvl, "random changes");
+	check_equal(old_model, old_pnvl, "old version");
+
+	nvl_putref(model);
+	nvl_putref(pnvl);
+	nvl_putref(old_model);
+	nvl_putref(old_pnvl);
+
+	fprintf(stderr, "ok.\n");
+}
+
+/* the order of changes doesn't affect the result */
+static void test_order(void)
+{
+	struct nvlist *empty, *fwd, *rev, *tmp;
+	char key[32];
+	int i;
+
+	fprintf(stderr, "order independence...");
+
+	empty = nvl_alloc();
+	if (IS_ERR(empty))
+		fail("nvl_alloc() failed");
+
+	fwd = nvl_persist(empty);
+	rev = nvl_persist(empty);
+	if (IS_ERR(fwd) || IS_ERR(rev))
+		fail("nvl_persist() failed");
+
+	for (i = 0; i < NKEYS; i++) {
+		keyname(key, sizeof(key), i);
+		tmp = pset_int(fwd, key, i);
+		nvl_putref(fwd);
+		fwd = tmp;
+
+		keyname(key, sizeof(key), NKEYS - 1 - i);
+		tmp = pset_int(rev, key, NKEYS - 1 - i);
+		nvl_putref(rev);
+		rev = tmp;
+	}
+
+	check_equal(fwd, rev, "forward vs. reverse");
+
+	nvl_putref(empty);
+	nvl_putref(fwd);
+	nvl_putref(rev);
+
+	fprintf(stderr, "ok.\n");
+}
+
+void test(void)
+{
+	test_basic();
+	test_random();
+	test_order();
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <jeffpc/refcnt.h>
+#include <jeffpc/thread.h>
+#include <jeffpc/error.h>
+
+#include "test.c"
+
+#define NTHREADS	4
+#define NOBJS		1000
+#define NITERS		100000
+#define NTIDTHREADS	5000
+
+struct obj {
+	refcnt_t refcnt;
+	bool freed;
+};
+
+static atomic_t nfreed;
+
+static void obj_free(struct obj *obj)
+{
+	if (obj->freed)
+		fail("object %p freed twice", obj);
+
+	if (refcnt_read(&obj->refcnt))
+		fail("object %p freed with non-zero refcount", obj);
+
+	obj->freed = true;
+	atomic_inc(&nfreed);
+}
+
+REFCNT_INLINE_FXNS(struct obj, obj, refcnt, obj_free, NULL)
+
+static struct obj objs[NOBJS];
+
+static void init_objs(void)
+{
+	size_t i;
+
+	atomic_set(&nfreed, 0);
+
+	for (i = 0; i < NOBJS; i++) {
+		refcnt_init(&objs[i].refcnt, 1);
+		objs[i].freed = false;
+	}
+}
+
+static void check_freed(size_t exp)
+{
+	if (atomic_read(&nfreed) != exp)
+		fail("%u objects freed, expected %zu", atomic_read(&nfreed),
+		     exp);
+}
+
+/* poke the reference counting code so that it merges queued objects */
+static void drain(void)
+{
+	struct obj tmp;
+
+	refcnt_init(&tmp.refcnt, 2);
+	obj_putref(&tmp);
+}
+
+static void run_thread(void *(*fxn)(void *), void *arg)
+{
+	pthread_t thread;
+	int ret;
+
+	ret = xthr_create(&thread, fxn, arg);
+	if (ret)
+		fail("xthr_create failed: %s", xstrerror(ret));
+
+	ret = xthr_join(thread, NULL);
+	if (ret)
+		fail("xthr_join failed: %s", xstrerror(ret));
+}
+
+static void *putref_all(void *arg)
+{
+	size_t i;
+
+	for (i = 0; i < NOBJS; i++)
+		obj_putref(&objs[i]);
+
+	return NULL;
+}
+
+static void *getref_all(void *arg)
+{
+	size_t i;
+
+	for (i = 0; i < NOBJS; i++)
+		obj_getref(&objs[i]);
+
+	return NULL;
+}
+
+static void *init_all(void *arg)
+{
+	init_objs();
+
+	return NULL;
+}
+
+static void test_single(void)
+{
+	fprintf(stderr, "single thread...");
+
+	init_objs();
+
+	getref_all(NULL);
+	getref_all(NULL);
+	putref_all(NULL);
+	putref_all(NULL);
+	check_freed(0);
+
+	putref_all(NULL);
+	check_freed(NOBJS);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_shared(void)
+{
+	fprintf(stderr, "references taken by another thread...");
+
+	init_objs();
+
+	/* another thread gets & puts its own references */
+	run_thread(getref_all, NULL);
+	run_thread(putref_all, NULL);
+	check_freed(0);
+
+	/* another thread holds a reference while we drop ours */
+	run_thread(getref_all, NULL);
+	putref_all(NULL);
+	check_freed(0);
+
+	run_thread(putref_all, NULL);
+	check_freed(NOBJS);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_handoff(void)
+{
+	fprintf(stderr, "references handed off to another thread...");
+
+	init_objs();
+
+	/* the last references get released by another thread */
+	getref_all(NULL);
+	run_thread(putref_all, NULL);
+	check_freed(0);
+
+	run_thread(putref_all, NULL);
+	check_freed(0);
+
+	/* we still own them and have to merge them */
+	drain();
+	check_freed(NOBJS);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_owner_exit(void)
+{
+	fprintf(stderr, "owner exited...");
+
+	/* owned by a thread that's gone by the time they're released */
+	run_thread(init_all, NULL);
+	check_freed(0);
+
+	putref_all(NULL);
+	check_freed(NOBJS);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void *hammer(void *arg)
+{
+	struct obj *obj = arg;
+	size_t i;
+
+	for (i = 0; i < NITERS; i++) {
+		obj_getref(obj);
+		obj_putref(obj);
+	}
+
+	obj_putref(obj);
+
+	return NULL;
+}
+
+static void test_concurrent(void)
+{
+	pthread_t threads[NTHREADS];
+	struct obj *obj;
+	int ret;
+	int i;
+
+	fprintf(stderr, "concurrent getref/putref...");
+
+	init_objs();
+
+	obj = &objs[0];
+
+	for (i = 0; i < NTHREADS; i++) {
+		ret = xthr_create(&threads[i], hammer, obj_getref(obj));
+		if (ret)
+			fail("xthr_create failed: %s", xstrerror(ret));
+	}
+
+	hammer(obj_getref(obj));
+
+	for (i = 0; i < NTHREADS; i++) {
+		ret = xthr_join(threads[i], NULL);
+		if (ret)
+			fail("xthr_join failed: %s", xstrerror(ret));
+	}
+
+	check_freed(0);
+
+	obj_putref(obj);
+	drain();
+	check_freed(1);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void *check_tid(void *arg)
+{
+	struct obj obj;
+
+	refcnt_init(&obj.refcnt, 1);
+
+	if (__refcnt_tls.tid == __REFCNT_TID_NONE)
+		fail("thread didn't get an id");
+
+	return NULL;
+}
+
+static void test_tid_reuse(void)
+{
+	size_t i;
+
+	fprintf(stderr, "thread id reuse...");
+
+	/* more threads than there are ids */
+	for (i = 0; i < NTIDTHREADS; i++)
+		run_thread(check_tid, NULL);
+
+	fprintf(stderr, "ok.\n");
+}
+
+void test(void)
+{
+	test_single();
+	test_shared();
+	test_handoff();
+	test_owner_exit();
+	test_concurrent();
+	test_tid_reuse();
+}
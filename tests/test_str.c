@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <jeffpc/val.h>
+#include <jeffpc/buffer.h>
+#include <jeffpc/error.h>
+
+#include "test.c"
+
+static void check_str(struct str *str, const char *exp)
+{
+	if (IS_ERR(str))
+		fail("failed to allocate string: %s", xstrerror(PTR_ERR(str)));
+
+	if (strcmp(str_cstr(str), exp))
+		fail("string mismatch: expected '%s', got '%s'", exp,
+		     str_cstr(str));
+
+	if (str_len(str) != strlen(exp))
+		fail("length mismatch for '%s': expected %zu, got %zu", exp,
+		     strlen(exp), str_len(str));
+
+	str_putref(str);
+}
+
+static void test_len(const char *s)
+{
+	fprintf(stderr, "length of '%s'...", s);
+
+	check_str(str_dup(s), s);
+	check_str(str_alloc(strdup(s)), s);
+	check_str(str_alloc_static(s), s);
+	check_str(str_dup_len(s, strlen(s)), s);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_dup_len(void)
+{
+	const char *s = "abcdefghijklmnopqrstuvwxyz";
+
+	fprintf(stderr, "str_dup_len...");
+
+	check_str(str_dup_len(s, 3), "abc");
+	check_str(str_dup_len(s, 20), "abcdefghijklmnopqrst");
+	check_str(str_dup_len("ab\0cd", 5), "ab");
+	check_str(STATIC_STR("not allocated by us"), "not allocated by us");
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_cat(void)
+{
+	fprintf(stderr, "str_cat...");
+
+	check_str(str_cat(3, STR_DUP("abc"), NULL,
+			  STR_DUP("defghijklmnopqrstuvwxyz")),
+		  "abcdefghijklmnopqrstuvwxyz");
+	check_str(str_cat(2, STR_DUP("a"), STR_DUP("b")), "ab");
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_slice(void)
+{
+	static const char data[] = "first string\0a second longer string\0unterminated";
+	struct val *blob;
+	struct str *parent;
+	struct str *str;
+
+	fprintf(stderr, "str_slice...");
+
+	blob = val_alloc_blob_dup(data, sizeof(data) - 1);
+	if (IS_ERR(blob))
+		fail("failed to allocate blob");
+
+	parent = STR_DUP("a long string containing other strings");
+
+	/* nul-terminated range - must point into the parent */
+	str = str_slice(val_getref(blob), 13, 22);
+	if (IS_ERR(str))
+		fail("failed to slice blob: %s", xstrerror(PTR_ERR(str)));
+	if (str_cstr(str) != ((const char *) blob->blob.ptr) + 13)
+		fail("slice of a blob was copied");
+	check_str(str, "a second longer string");
+
+	/* range ending at the end of the parent string */
+	str = str_slice(str_getref_val(parent), 7, 31);
+	if (IS_ERR(str))
+		fail("failed to slice str: %s", xstrerror(PTR_ERR(str)));
+	if (str_cstr(str) != str_cstr(parent) + 7)
+		fail("slice of a str was copied");
+	check_str(str, "string containing other strings");
+
+	/* the string ends at the first nul */
+	check_str(str_slice(val_getref(blob), 0, 20), "first string");
+
+	/* not nul-terminated or short - copied */
+	check_str(str_slice(val_getref(blob), 36, 12), "unterminated");
+	check_str(str_slice(val_getref(blob), 0, 5), "first");
+	check_str(str_slice(str_getref_val(parent), 2, 4), "long");
+	check_str(str_slice(val_getref(blob), 0, 0), "");
+
+	/* out of range */
+	str = str_slice(val_getref(blob), 36, 13);
+	if (!IS_ERR(str))
+		fail("slice past the end of the parent succeeded");
+
+	/* the slices hold references, so dropping ours must be safe */
+	str = str_slice(blob, 13, 22);
+	str_putref(parent);
+	check_str(str, "a second longer string");
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_buffer_append(void)
+{
+	struct buffer *buf;
+	struct str *str;
+
+	fprintf(stderr, "buffer_append_str...");
+
+	buf = buffer_alloc(0);
+	if (IS_ERR(buf))
+		fail("failed to allocate buffer");
+
+	str = STR_DUP("some long string that isn't inline");
+
+	if (buffer_append_str(buf, str))
+		fail("failed to append string");
+
+	if (buffer_size(buf) != str_len(str))
+		fail("buffer size mismatch: expected %zu, got %zu",
+		     str_len(str), buffer_size(buf));
+
+	if (memcmp(buffer_data(buf), str_cstr(str), str_len(str)))
+		fail("buffer contents mismatch");
+
+	str_putref(str);
+	buffer_free(buf);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_sym_intern(void)
+{
+	struct sym *a, *b, *c;
+
+	fprintf(stderr, "symbol interning...");
+
+	if (sym_lookup("test-symbol-never-allocated"))
+		fail("sym_lookup found a symbol that was never allocated");
+
+	a = SYM_DUP("test-symbol-interned");
+	b = sym_alloc(strdup("test-symbol-interned"));
+	c = SYM_DUP_LEN("test-symbol-interned-and-longer", 20);
+
+	if (IS_ERR(b))
+		fail("sym_alloc failed: %s", xstrerror(PTR_ERR(b)));
+
+	if ((a != b) || (a != c))
+		fail("equal symbols not interned (%p, %p, %p)", a, b, c);
+
+	if (sym_lookup("test-symbol-interned") != a)
+		fail("sym_lookup didn't return the interned symbol");
+
+	if (sym_len(a) != strlen("test-symbol-interned"))
+		fail("interned symbol length mismatch");
+
+	if (!sym_equal(a, STATIC_SYM("test-symbol-interned")))
+		fail("interned symbol not equal to static symbol");
+
+	if (sym_equal(a, SYM_DUP("test-symbol-other")))
+		fail("different symbols are equal");
+
+	if (SYM_DUP("x") != SYM_DUP("x"))
+		fail("short symbols not interned");
+
+	if (SYM_DUP("") != SYM_DUP_LEN("abc", 0))
+		fail("empty symbols not interned");
+
+	sym_putref(a);
+	sym_putref(b);
+	sym_putref(c);
+
+	fprintf(stderr, "ok.\n");
+}
+
+void test(void)
+{
+	test_len("");
+	test_len("a");
+	test_len("abc");
+	test_len("fifteen chars..");
+	test_len("sixteen chars...");
+	test_len("a much longer string that is definitely not inline");
+	test_dup_len();
+	test_cat();
+	test_slice();
+	test_buffer_append();
+	test_sym_intern();
+}
@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define TEST_TREE_AVL
+
+#include "test_tree_common.c"
+
+static struct test2 checks2[2] = {
+	[true]  = {
+		"ascending",
+		{ &a, NULL, &b },
+		{
+			{ &a, { &b } },
+			{ &b, { &a } },
+		},
+	},
+	[false] = {
+		"descending",
+		{ &b, &a, NULL },
+		{
+			{ &a, { &b } },
+			{ &b, { &a } },
+		},
+	},
+};
+
+/*
+ * Since all permutations create the same tree, we test removal only for one
+ * of them
+ */
+static struct test3 checks3[6] = {
+	[0] = {
+		.pre = { &b, &a, &c },
+		.sub = {
+			[0] = { &a, { &b, NULL, &c }, },
+			[1] = { &b, { &c, &a, NULL }, },
+			[2] = { &c, { &b, &a, NULL }, },
+		},
+	},
+	[1] = {
+		.pre = { &b, &a, &c },
+	},
+	[2] = {
+		.pre = { &b, &a, &c },
+	},
+	[3] = {
+		.pre = { &b, &a, &c },
+	},
+	[4] = {
+		.pre = { &b, &a, &c },
+	},
+	[5] = {
+		.pre = { &b, &a, &c },
+	},
+};
+
+/*
+ * Since all permutations create only four different trees, we test removal
+ * only once for each of them.
+ */
+static struct test4 checks4[24] = {
+	[0]  = {
+		.pre = TEST4_BACD,
+		.sub = {
+			[0] = { &a, { &c, &b, &d }, },
+			[1] = { &b, { &c, &a, &d }, },
+			[2] = { &c, { &b, &a, &d }, },
+			[3] = { &d, { &b, &a, &c }, },
+		},
+	},
+	[1]  = {
+		.pre = TEST4_BACD,
+	},
+	[2]  = {
+		.pre = TEST4_BACD,
+	},
+	[3]  = {
+		.pre = TEST4_BACD,
+	},
+	[4]  = {
+		.pre = TEST4_BACD,
+	},
+	[5]  = {
+		.pre = TEST4_BACD,
+	},
+
+	[6]  = {
+		.pre = TEST4_BADC,
+		.sub = {
+			[0] = { &a, { &c, &b, &d }, },
+			[1] = { &b, { &c, &a, &d }, },
+			[2] = { &c, { &b, &a, &d }, },
+			[3] = { &d, { &b, &a, &c }, },
+		},
+	},
+	[7]  = {
+		.pre = TEST4_CADB,
+		.sub = {
+			[0] = { &a, { &c, &b, &d }, },
+			[1] = { &b, { &c, &a, &d }, },
+			[2] = { &c, { &b, &a, &d }, },
+			[3] = { &d, { &b, &a, &c }, },
+		},
+	},
+	[8]  = {
+		.pre = TEST4_BADC,
+	},
+	[9]  = {
+		.pre = TEST4_CBDA,
+		.sub = {
+			[0] = { &a, { &c, &b, &d }, },
+			[1] = { &b, { &c, &a, &d }, },
+			[2] = { &c, { &b, &a, &d }, },
+			[3] = { &d, { &b, &a, &c }, },
+		},
+	},
+	[10] = {
+		.pre = TEST4_CADB,
+	},
+	[11] = {
+		.pre = TEST4_CBDA,
+	},
+
+	[12] = {
+		.pre = TEST4_BADC,
+	},
+	[13] = {
+		.pre = TEST4_CADB,
+	},
+	[14] = {
+		.pre = TEST4_BADC,
+	},
+	[15] = {
+		.pre = TEST4_CBDA,
+	},
+	[16] = {
+		.pre = TEST4_CADB,
+	},
+	[17] = {
+		.pre = TEST4_CBDA,
+	},
+
+	[18] = {
+		.pre = TEST4_BADC,
+	},
+	[19] = {
+		.pre = TEST4_CADB,
+	},
+	[20] = {
+		.pre = TEST4_BADC,
+	},
+	[21] = {
+		.pre = TEST4_CBDA,
+	},
+	[22] = {
+		.pre = TEST4_CADB,
+	},
+	[23] = {
+		.pre = TEST4_CBDA,
+	},
+};
+
+/*
+ * AVL invariants
+ */
+
+#define BALANCE_MAX_NODES	1000
+
+static struct tree_node *node_parent(struct tree_node *node)
+{
+#ifdef JEFFPC_TREE_COMPACT
+	return (struct tree_node *) (node->_parent_and_extra & ~0x3ul);
+#else
+	return node->_parent;
+#endif
+}
+
+static unsigned int node_balance(struct tree_node *node)
+{
+#ifdef JEFFPC_TREE_COMPACT
+	return node->_parent_and_extra & 0x3;
+#else
+	return node->_extra;
+#endif
+}
+
+/* returns the height */
+static size_t check_invariants(struct tree_node *node,
+			       struct tree_node *parent)
+{
+	size_t left, right;
+	unsigned int exp;
+
+	if (!node)
+		return 0;
+
+	if (node_parent(node) != parent)
+		fail("node %p has parent %p, expected %p", node,
+		     node_parent(node), parent);
+
+	left = check_invariants(node->children[TREE_LEFT], node);
+	right = check_invariants(node->children[TREE_RIGHT], node);
+
+	if (left == right)
+		exp = 0;
+	else if (left == right + 1)
+		exp = 1 + TREE_LEFT;
+	else if (left + 1 == right)
+		exp = 1 + TREE_RIGHT;
+	else
+		fail("node %p has subtree heights %zu and %zu", node, left,
+		     right);
+
+	if (node_balance(node) != exp)
+		fail("node %p has balance %u, expected %u (heights %zu and %zu)",
+		     node, node_balance(node), exp, left, right);
+
+	return 1 + MAX(left, right);
+}
+
+static void check_balance(struct avl_tree *tree, size_t numnodes)
+{
+	size_t height;
+	size_t limit;
+
+	height = check_invariants(tree->tree.root, NULL);
+
+	/* an AVL tree is at most ~1.44 * log2(n + 2) tall */
+	for (limit = 0; (numnodes + 2) >> limit; limit++)
+		;
+	limit = (limit * 144 + 99) / 100;
+
+	if (height > limit)
+		fail("tree with %zu nodes is %zu tall", numnodes, height);
+}
+
+static void __test_balance(struct node *nodes, size_t numnodes, size_t step)
+{
+	struct avl_tree tree;
+	size_t i;
+
+	fprintf(stderr, "%zu nodes, step %zu: balance...", numnodes, step);
+
+	avl_create(&tree, cmp, sizeof(struct node),
+		   offsetof(struct node, node));
+
+	/* step is coprime with numnodes, so this visits every node once */
+	for (i = 0; i < numnodes; i++) {
+		avl_add(&tree, &nodes[(i * step) % numnodes]);
+		check_balance(&tree, i + 1);
+	}
+	verify_iter(&tree, numnodes);
+
+	for (i = 0; i < numnodes; i += 2) {
+		avl_remove(&tree, &nodes[(i * step) % numnodes]);
+		check_balance(&tree, numnodes - (i / 2) - 1);
+	}
+	verify_iter(&tree, numnodes / 2);
+
+	for (i = 0; i < numnodes; i += 2)
+		avl_add(&tree, &nodes[(i * step) % numnodes]);
+	check_balance(&tree, numnodes);
+	verify_iter(&tree, numnodes);
+
+	for (i = 0; i < numnodes; i++) {
+		avl_remove(&tree, &nodes[(i * step) % numnodes]);
+		check_balance(&tree, numnodes - i - 1);
+	}
+	verify_iter(&tree, 0);
+
+	destroy(&tree, 0, true);
+}
+
+static void test_balance(void)
+{
+	static struct node nodes[BALANCE_MAX_NODES];
+	size_t i;
+
+	for (i = 0; i < BALANCE_MAX_NODES; i++) {
+		nodes[i].name = "balance";
+		nodes[i].v = i * 10;
+	}
+
+	for (i = 1; i <= 70; i++) {
+		__test_balance(nodes, i, 1);
+		__test_balance(nodes, i, i - 1);
+	}
+
+	__test_balance(nodes, BALANCE_MAX_NODES, 1);
+	__test_balance(nodes, BALANCE_MAX_NODES, BALANCE_MAX_NODES - 1);
+	__test_balance(nodes, BALANCE_MAX_NODES, 7);
+	__test_balance(nodes, BALANCE_MAX_NODES, 389);
+}
@@ -0,0 +1,397 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <jeffpc/btree.h>
+
+#include "test.c"
+
+#define NKEYS		3000
+#define NOPS		60000
+#define VERIFY_EVERY	500
+
+struct node {
+	uint32_t v;
+};
+
+static struct node nodes[NKEYS];
+static bool present[NKEYS];
+
+static int cmp(const void *va, const void *vb)
+{
+	const struct node *a = va;
+	const struct node *b = vb;
+
+	if (a->v < b->v)
+		return -1;
+	if (a->v > b->v)
+		return 1;
+	return 0;
+}
+
+static uint64_t prefix_exact(const void *item)
+{
+	const struct node *node = item;
+
+	return node->v;
+}
+
+/* lots of ties, exercising the fallback to the comparison function */
+static uint64_t prefix_coarse(const void *item)
+{
+	const struct node *node = item;
+
+	return node->v >> 4;
+}
+
+/* a deterministic sequence so that failures are reproducible */
+static uint32_t rand_state;
+
+static uint32_t myrand(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+
+	return rand_state;
+}
+
+static void check_nearest(struct btree *tree, uint32_t v)
+{
+	struct btree_cookie cookie;
+	struct node key = { .v = v };
+	struct node *exp_lt = NULL;
+	struct node *exp_gt = NULL;
+	struct node *lt, *gt;
+	size_t i;
+
+	if (btree_find(tree, &key, &cookie))
+		fail("found %u which should not be in the tree", v);
+
+	for (i = v; i > 0; i--) {
+		if (present[i - 1]) {
+			exp_lt = &nodes[i - 1];
+			break;
+		}
+	}
+
+	for (i = v + 1; i < NKEYS; i++) {
+		if (present[i]) {
+			exp_gt = &nodes[i];
+			break;
+		}
+	}
+
+	lt = btree_nearest_lt(tree, &cookie);
+	gt = btree_nearest_gt(tree, &cookie);
+
+	if (lt != exp_lt)
+		fail("nearest lt of %u is %p, expected %p", v, lt, exp_lt);
+	if (gt != exp_gt)
+		fail("nearest gt of %u is %p, expected %p", v, gt, exp_gt);
+}
+
+static void verify(struct btree *tree)
+{
+	struct btree_cookie cookie;
+	struct node *prev;
+	struct node *cur;
+	size_t count;
+	size_t i;
+
+	/* forward */
+	count = 0;
+	prev = NULL;
+	btree_for_each(tree, &cookie, cur) {
+		size_t idx = cur - nodes;
+
+		if (!present[idx])
+			fail("iteration returned %u which is not in the tree",
+			     cur->v);
+		if (prev && (prev->v >= cur->v))
+			fail("iteration out of order: %u followed by %u",
+			     prev->v, cur->v);
+
+		prev = cur;
+		count++;
+	}
+
+	if (prev != btree_last(tree))
+		fail("last item mismatch");
+	if (count != btree_numnodes(tree))
+		fail("iterated over %zu items, expected %zu", count,
+		     btree_numnodes(tree));
+	if ((count == 0) != btree_is_empty(tree))
+		fail("is_empty mismatch");
+
+	/* backward */
+	count = 0;
+	prev = NULL;
+	for (cur = btree_iter_last(tree, &cookie);
+	     cur;
+	     cur = btree_iter_prev(tree, &cookie)) {
+		if (prev && (prev->v <= cur->v))
+			fail("reverse iteration out of order: %u followed by %u",
+			     prev->v, cur->v);
+
+		prev = cur;
+		count++;
+	}
+
+	if (prev != btree_first(tree))
+		fail("first item mismatch");
+	if (count != btree_numnodes(tree))
+		fail("reverse iterated over %zu items, expected %zu", count,
+		     btree_numnodes(tree));
+
+	/* item based stepping */
+	count = 0;
+	for (cur = btree_last(tree); cur; cur = btree_prev(tree, cur))
+		count++;
+	for (cur = btree_first(tree); cur; cur = btree_next(tree, cur))
+		count--;
+
+	if (count != 0)
+		fail("item based iteration mismatch");
+
+	/* lookups */
+	count = 0;
+	for (i = 0; i < NKEYS; i++) {
+		if (present[i]) {
+			if (btree_find(tree, &nodes[i], NULL) != &nodes[i])
+				fail("failed to find %u", nodes[i].v);
+			count++;
+		} else {
+			check_nearest(tree, i);
+		}
+	}
+
+	if (count != btree_numnodes(tree))
+		fail("expected %zu items, tree has %zu", count,
+		     btree_numnodes(tree));
+}
+
+static void add(struct btree *tree, size_t i)
+{
+	int ret;
+
+	ret = btree_add(tree, &nodes[i]);
+	if (ret)
+		fail("failed to add %zu: %s", i, xstrerror(ret));
+
+	present[i] = true;
+}
+
+static void del(struct btree *tree, size_t i)
+{
+	btree_remove(tree, &nodes[i]);
+
+	present[i] = false;
+}
+
+static void destroy(struct btree *tree)
+{
+	struct btree_cookie cookie;
+	struct node *cur;
+	size_t count;
+
+	memset(&cookie, 0, sizeof(cookie));
+
+	count = 0;
+	while ((cur = btree_destroy_nodes(tree, &cookie))) {
+		size_t idx = cur - nodes;
+
+		if (!present[idx])
+			fail("destroy returned %u which is not in the tree",
+			     cur->v);
+
+		present[idx] = false;
+		count++;
+	}
+
+	if (btree_numnodes(tree))
+		fail("tree not empty after destroying nodes");
+
+	for (count = 0; count < NKEYS; count++)
+		if (present[count])
+			fail("destroy did not return %zu", count);
+
+	btree_destroy(tree);
+}
+
+static void test_seq(uint64_t (*prefix)(const void *))
+{
+	struct btree tree;
+	ssize_t i;
+
+	fprintf(stderr, "sequential...");
+
+	btree_create(&tree, cmp, prefix);
+	verify(&tree);
+
+	/* ascending inserts & removals */
+	for (i = 0; i < NKEYS; i++)
+		add(&tree, i);
+	verify(&tree);
+
+	for (i = 0; i < NKEYS; i++)
+		del(&tree, i);
+	verify(&tree);
+
+	/* descending inserts & removals */
+	for (i = NKEYS - 1; i >= 0; i--)
+		add(&tree, i);
+	verify(&tree);
+
+	for (i = NKEYS - 1; i >= 0; i--)
+		del(&tree, i);
+	verify(&tree);
+
+	/* removing from the middle */
+	for (i = 0; i < NKEYS; i++)
+		add(&tree, i);
+	for (i = NKEYS / 4; i < (3 * NKEYS / 4); i++)
+		del(&tree, i);
+	verify(&tree);
+
+	/* destroy with items still in the tree */
+	destroy(&tree);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_rand(uint64_t (*prefix)(const void *))
+{
+	struct btree tree;
+	size_t i;
+
+	fprintf(stderr, "random...");
+
+	rand_state = 0x12345678;
+
+	btree_create(&tree, cmp, prefix);
+
+	for (i = 0; i < NOPS; i++) {
+		size_t key = myrand() % NKEYS;
+		struct node *old;
+
+		/* bias towards inserts for the first half */
+		if ((i < (NOPS / 2)) ? (myrand() % 3) : (myrand() % 2)) {
+			old = btree_insert(&tree, &nodes[key]);
+			if (IS_ERR(old))
+				fail("failed to insert %zu: %s", key,
+				     xstrerror(PTR_ERR(old)));
+			if (old != (present[key] ? &nodes[key] : NULL))
+				fail("insert of %zu returned %p", key, old);
+
+			present[key] = true;
+		} else if (present[key]) {
+			del(&tree, key);
+		}
+
+		if ((i % VERIFY_EVERY) == 0)
+			verify(&tree);
+	}
+
+	verify(&tree);
+
+	/* empty the tree the hard way */
+	for (i = 0; i < NKEYS; i++)
+		if (present[i])
+			del(&tree, i);
+	verify(&tree);
+
+	btree_destroy(&tree);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_insert_here(void)
+{
+	struct btree_cookie cookie;
+	struct btree tree;
+	size_t i;
+
+	fprintf(stderr, "insert here...");
+
+	btree_create(&tree, cmp, prefix_exact);
+
+	/* insert the odd keys first, then the even ones with a cookie */
+	for (i = 1; i < NKEYS; i += 2)
+		add(&tree, i);
+
+	for (i = 0; i < NKEYS; i += 2) {
+		if (btree_find(&tree, &nodes[i], &cookie))
+			fail("found %zu which should not be in the tree", i);
+
+		if (btree_insert_here(&tree, &nodes[i], &cookie))
+			fail("failed to insert %zu", i);
+
+		present[i] = true;
+	}
+
+	verify(&tree);
+	destroy(&tree);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_swap(void)
+{
+	struct btree tree1;
+	struct btree tree2;
+
+	fprintf(stderr, "swap...");
+
+	btree_create(&tree1, cmp, NULL);
+	btree_create(&tree2, cmp, NULL);
+
+	add(&tree1, 1);
+	add(&tree1, 2);
+
+	btree_swap(&tree1, &tree2);
+
+	if (!btree_is_empty(&tree1) || (btree_numnodes(&tree2) != 2))
+		fail("swap failed");
+
+	verify(&tree2);
+	destroy(&tree2);
+	btree_destroy(&tree1);
+
+	fprintf(stderr, "ok.\n");
+}
+
+void test(void)
+{
+	size_t i;
+
+	for (i = 0; i < NKEYS; i++)
+		nodes[i].v = i;
+
+	test_seq(NULL);
+	test_seq(prefix_exact);
+	test_seq(prefix_coarse);
+	test_rand(NULL);
+	test_rand(prefix_exact);
+	test_rand(prefix_coarse);
+	test_insert_here();
+	test_swap();
+}
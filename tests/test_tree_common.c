@@ -21,12 +21,27 @@
  */
 
 #include <jeffpc/types.h>
+#include <jeffpc/avl.h>
 #include <jeffpc/bst.h>
 #include <jeffpc/rbtree.h>
 
 #include "test.c"
 
-#if defined(TEST_TREE_BST)
+#if defined(TEST_TREE_AVL)
+#define TREE_TREE		avl_tree
+#define TREE_NODE		avl_node
+#define TREE_COOKIE		avl_cookie
+#define TREE_CREATE		avl_create
+#define TREE_DESTROY		avl_destroy
+#define TREE_ADD		avl_add
+#define TREE_REMOVE		avl_remove
+#define TREE_FOR_EACH		avl_for_each
+#define TREE_FIND		avl_find
+#define TREE_NEAREST_LT		avl_nearest_lt
+#define TREE_NEAREST_GT		avl_nearest_gt
+#define TREE_NUMNODES		avl_numnodes
+#define TREE_DESTROY_NODES	avl_destroy_nodes
+#elif defined(TEST_TREE_BST)
 #define TREE_TREE		bst_tree
 #define TREE_NODE		bst_node
 #define TREE_COOKIE		bst_cookie
@@ -121,6 +136,12 @@ static struct test2 checks2[2];
 static struct test3 checks3[6];
 static struct test4 checks4[24];
 
+#if defined(TEST_TREE_RB)
+static void test_build(void);
+#elif defined(TEST_TREE_AVL)
+static void test_balance(void);
+#endif
+
 struct testnearest {
 	int v;
 	struct node *lt;
@@ -484,4 +505,9 @@ void test(void)
 		&a, a.v, &b, b.v, &c, c.v, &d, d.v);
 
 	test_insert();
+#if defined(TEST_TREE_RB)
+	test_build();
+#elif defined(TEST_TREE_AVL)
+	test_balance();
+#endif
 }
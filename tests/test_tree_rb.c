@@ -178,3 +178,112 @@ static struct test4 checks4[24] = {
 		.pre = TEST4_CBDA,
 	},
 };
+
+/*
+ * rb_build
+ */
+
+#define BUILD_MAX_NODES	1000
+
+static struct tree_node *node_parent(struct tree_node *node)
+{
+#ifdef JEFFPC_TREE_COMPACT
+	return (struct tree_node *) (node->_parent_and_extra & ~0x3ul);
+#else
+	return node->_parent;
+#endif
+}
+
+static bool node_is_red(struct tree_node *node)
+{
+	if (!node)
+		return false;
+
+#ifdef JEFFPC_TREE_COMPACT
+	return node->_parent_and_extra & 0x3;
+#else
+	return node->_extra;
+#endif
+}
+
+/* returns the black height */
+static size_t check_invariants(struct tree_node *node,
+			       struct tree_node *parent)
+{
+	size_t left, right;
+
+	if (!node)
+		return 1;
+
+	if (node_parent(node) != parent)
+		fail("node %p has parent %p, expected %p", node,
+		     node_parent(node), parent);
+
+	if (node_is_red(node) &&
+	    (node_is_red(node->children[TREE_LEFT]) ||
+	     node_is_red(node->children[TREE_RIGHT])))
+		fail("red node %p has a red child", node);
+
+	left = check_invariants(node->children[TREE_LEFT], node);
+	right = check_invariants(node->children[TREE_RIGHT], node);
+
+	if (left != right)
+		fail("node %p has black heights %zu and %zu", node, left,
+		     right);
+
+	return left + !node_is_red(node);
+}
+
+static void check_tree(struct rb_tree *tree, size_t numnodes)
+{
+	if (node_is_red(tree->tree.root))
+		fail("root is red");
+
+	check_invariants(tree->tree.root, NULL);
+	verify_iter(tree, numnodes);
+}
+
+static void __test_build(struct node *nodes, void **items, size_t numnodes)
+{
+	struct rb_tree tree;
+	size_t i;
+
+	fprintf(stderr, "%zu nodes: build...", numnodes);
+
+	rb_create(&tree, cmp, sizeof(struct node),
+		  offsetof(struct node, node));
+
+	rb_build(&tree, items, numnodes);
+	check_tree(&tree, numnodes);
+
+	/* the result must be a proper red-black tree */
+	for (i = 0; i < numnodes; i += 2)
+		rb_remove(&tree, &nodes[i]);
+	check_tree(&tree, numnodes / 2);
+
+	for (i = 0; i < numnodes; i += 2)
+		rb_add(&tree, &nodes[i]);
+	check_tree(&tree, numnodes);
+
+	destroy(&tree, numnodes, true);
+}
+
+static void test_build(void)
+{
+	static struct node nodes[BUILD_MAX_NODES];
+	static void *items[BUILD_MAX_NODES];
+	size_t i;
+
+	for (i = 0; i < BUILD_MAX_NODES; i++) {
+		nodes[i].name = "build";
+		nodes[i].v = i * 10;
+		items[i] = &nodes[i];
+	}
+
+	for (i = 0; i <= 70; i++)
+		__test_build(nodes, items, i);
+
+	__test_build(nodes, items, 255);
+	__test_build(nodes, items, 256);
+	__test_build(nodes, items, BUILD_MAX_NODES);
+}
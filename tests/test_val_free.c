@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <jeffpc/val.h>
+#include <jeffpc/nvl.h>
+#include <jeffpc/error.h>
+
+#include "test.c"
+
+/*
+ * Freeing these would recurse once per element if val_free weren't
+ * iterative.
+ */
+#define NELEM		1000000
+#define NVL_DEPTH	100000
+
+static void check(struct val *val, const char *what)
+{
+	if (IS_ERR(val))
+		fail("failed to allocate %s: %s", what,
+		     xstrerror(PTR_ERR(val)));
+}
+
+static void test_long_list(void)
+{
+	struct val *list;
+	size_t i;
+
+	fprintf(stderr, "long list...");
+
+	list = NULL;
+
+	for (i = 0; i < NELEM; i++) {
+		list = VAL_ALLOC_CONS(VAL_ALLOC_INT(i), list);
+		check(list, "list");
+	}
+
+	val_putref(list);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_deep_list(void)
+{
+	struct val *list;
+	size_t i;
+
+	fprintf(stderr, "deeply nested list...");
+
+	list = NULL;
+
+	for (i = 0; i < NELEM; i++) {
+		list = VAL_ALLOC_CONS(list,
+				      VAL_DUP_STR("a string that isn't inline"));
+		check(list, "list");
+	}
+
+	val_putref(list);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_deep_array(void)
+{
+	struct val *array;
+	size_t i;
+
+	fprintf(stderr, "deeply nested array...");
+
+	array = VAL_ALLOC_NULL();
+
+	for (i = 0; i < NELEM; i++) {
+		struct val **vals;
+
+		vals = malloc(sizeof(struct val *) * 2);
+		if (!vals)
+			fail("failed to allocate array");
+
+		vals[0] = VAL_ALLOC_INT(i);
+		vals[1] = array;
+
+		array = VAL_ALLOC_ARRAY(vals, 2);
+		check(array, "array");
+	}
+
+	val_putref(array);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_deep_nvl(void)
+{
+	struct nvlist *nvl;
+	size_t i;
+
+	fprintf(stderr, "deeply nested nvlist...");
+
+	nvl = nvl_alloc();
+	check(nvl_cast_to_val(nvl), "nvlist");
+
+	for (i = 0; i < NVL_DEPTH; i++) {
+		struct nvlist *parent;
+
+		parent = nvl_alloc();
+		check(nvl_cast_to_val(parent), "nvlist");
+
+		if (nvl_set_int(parent, "index", i))
+			fail("failed to set int");
+		if (nvl_set_str(parent, "string",
+				STR_DUP("some string that isn't inline")))
+			fail("failed to set str");
+		if (nvl_set_nvl(parent, "child", nvl))
+			fail("failed to set nvl");
+
+		nvl = parent;
+	}
+
+	nvl_putref(nvl);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void test_shared(void)
+{
+	struct val *shared;
+	struct val *list;
+	size_t i;
+
+	fprintf(stderr, "list sharing a tail...");
+
+	shared = NULL;
+
+	for (i = 0; i < NELEM; i++) {
+		shared = VAL_ALLOC_CONS(VAL_ALLOC_INT(i), shared);
+		check(shared, "list");
+	}
+
+	/* free a list whose tail is still referenced elsewhere */
+	list = VAL_ALLOC_CONS(VAL_ALLOC_INT(0), val_getref(shared));
+	check(list, "list");
+	val_putref(list);
+
+	if (shared->cons.head->i != NELEM - 1)
+		fail("shared tail got damaged");
+
+	val_putref(shared);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void check_stat(struct nvlist *stats, const char *name, uint64_t exp)
+{
+	uint64_t v;
+	int ret;
+
+	ret = nvl_lookup_int(stats, name, &v);
+	if (ret)
+		fail("failed to look up %s: %s", name, xstrerror(ret));
+
+	if (v != exp)
+		fail("%s is %"PRIu64", expected %"PRIu64, name, v, exp);
+}
+
+static void check_stats(uint64_t queued, uint64_t completed)
+{
+	struct nvlist *stats;
+
+	stats = val_deferred_free_stats();
+	if (IS_ERR(stats))
+		fail("failed to get stats: %s", xstrerror(PTR_ERR(stats)));
+
+	check_stat(stats, "queued", queued);
+	check_stat(stats, "completed", completed);
+	check_stat(stats, "backlog", queued - completed);
+
+	nvl_putref(stats);
+}
+
+static void test_deferred(void)
+{
+	struct val *small;
+	struct val *list;
+	struct val **vals;
+	struct nvlist *nvl;
+	size_t i;
+	int ret;
+
+	fprintf(stderr, "deferred freeing...");
+
+	ret = val_deferred_free_enable(1000, 1);
+	if (ret)
+		fail("failed to enable deferred freeing: %s", xstrerror(ret));
+
+	if (val_deferred_free_enable(1000, 1) != -EBUSY)
+		fail("enabled deferred freeing twice");
+
+	list = NULL;
+	small = NULL;
+	for (i = 0; i < NELEM; i++) {
+		list = VAL_ALLOC_CONS(VAL_ALLOC_INT(i), list);
+
+		if (i < 999)
+			small = VAL_ALLOC_CONS(VAL_ALLOC_INT(i), small);
+	}
+
+	vals = malloc(sizeof(struct val *) * 1000);
+	if (!vals)
+		fail("failed to allocate array");
+	for (i = 0; i < 1000; i++)
+		vals[i] = VAL_DUP_STR("a string that isn't inline");
+
+	nvl = nvl_alloc();
+	check(nvl_cast_to_val(nvl), "nvlist");
+	for (i = 0; i < 1000; i++) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "%zu", i);
+
+		if (nvl_set_int(nvl, name, i))
+			fail("failed to set int");
+	}
+
+	/* too short, freed right away */
+	val_putref(small);
+	check_stats(0, 0);
+
+	val_putref(list);
+	val_putref(VAL_ALLOC_ARRAY(vals, 1000));
+	nvl_putref(nvl);
+
+	val_deferred_free_disable();
+
+	check_stats(3, 3);
+
+	fprintf(stderr, "ok.\n");
+}
+
+void test(void)
+{
+	test_long_list();
+	test_deep_list();
+	test_deep_array();
+	test_deep_nvl();
+	test_shared();
+	test_deferred();
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <jeffpc/val.h>
+#include <jeffpc/nvl.h>
+#include <jeffpc/sexpr.h>
+#include <jeffpc/error.h>
+
+#include "test.c"
+
+static struct val *parse(const char *str)
+{
+	struct val *val;
+
+	val = sexpr_parse(str, strlen(str));
+	if (IS_ERR(val))
+		fail("failed to parse '%s': %s", str, xstrerror(PTR_ERR(val)));
+
+	return val;
+}
+
+static void check(struct val *a, struct val *b, bool exp, const char *desc)
+{
+	fprintf(stderr, "%s (should be %s)...", desc,
+		exp ? "equal" : "unequal");
+
+	if (val_equal(a, b) != exp)
+		fail("val_equal returned %s", exp ? "false" : "true");
+
+	if (val_equal(b, a) != exp)
+		fail("val_equal isn't symmetric");
+
+	if (exp && (val_hash(a) != val_hash(b)))
+		fail("equal values hash differently (%#x vs. %#x)",
+		     val_hash(a), val_hash(b));
+
+	val_putref(a);
+	val_putref(b);
+
+	fprintf(stderr, "ok.\n");
+}
+
+static void check_sexpr(const char *a, const char *b, bool exp)
+{
+	char desc[256];
+
+	snprintf(desc, sizeof(desc), "'%s' vs. '%s'", a, b);
+
+	check(parse(a), parse(b), exp, desc);
+}
+
+static struct val *make_nvl(const char *a, uint64_t b)
+{
+	struct nvlist *nvl;
+
+	nvl = nvl_alloc();
+	if (IS_ERR(nvl))
+		fail("failed to allocate nvlist");
+
+	if (nvl_set_str(nvl, "a", STR_DUP(a)) ||
+	    nvl_set_int(nvl, "b", b) ||
+	    nvl_set_nvl(nvl, "c", nvl_alloc()))
+		fail("failed to fill in nvlist");
+
+	return nvl_cast_to_val(nvl);
+}
+
+void test(void)
+{
+	check(NULL, NULL, true, "NULL vs. NULL");
+	check(NULL, VAL_ALLOC_INT(0), false, "NULL vs. 0");
+	check(VAL_ALLOC_NULL(), VAL_ALLOC_NULL(), true, "null vs. null");
+	check(VAL_ALLOC_INT(12345), VAL_ALLOC_INT(12345), true,
+	      "int vs. int");
+	check(VAL_ALLOC_INT(12345), VAL_ALLOC_CHAR(12345), false,
+	      "int vs. char");
+	check(VAL_DUP_STR("abc"), VAL_DUP_SYM("abc"), false, "str vs. sym");
+	check(VAL_DUP_STR("a string that is not inline"),
+	      str_cast_to_val(STATIC_STR("a string that is not inline")), true,
+	      "allocated vs. static str");
+	check(VAL_DUP_SYM("symbol"), sym_cast_to_val(STATIC_SYM("symbol")),
+	      true, "interned vs. static sym");
+	check(VAL_DUP_STR("abc"), VAL_DUP_STR("abd"), false, "str vs. str");
+	check(VAL_DUP_STR("abc"), VAL_DUP_STR("abcd"), false,
+	      "str vs. longer str");
+	check(val_alloc_blob_static("abc", 3), val_alloc_blob_static("abc", 3),
+	      true, "blob vs. blob");
+	check(val_alloc_blob_static("abc", 3), val_alloc_blob_static("abd", 3),
+	      false, "blob vs. different blob");
+	check(make_nvl("x", 1), make_nvl("x", 1), true, "nvl vs. nvl");
+	check(make_nvl("x", 1), make_nvl("x", 2), false,
+	      "nvl vs. different nvl");
+	check(make_nvl("x", 1), VAL_ALLOC_NVL(), false, "nvl vs. empty nvl");
+
+	check_sexpr("(a b c)", "(a b c)", true);
+	check_sexpr("(a \"b\" (c . 5))", "(a \"b\" (c . 5))", true);
+	check_sexpr("(a b c)", "(a b)", false);
+	check_sexpr("(a b c)", "(a (b c))", false);
+	check_sexpr("(a b #t)", "(a b #f)", false);
+}
@@ -133,6 +133,35 @@ void *tree_insert_here(struct tree_tree *tree, void *newitem,
 	return NULL;
 }
 
+/*
+ * Rotate @node down in the @left direction, moving its child in the other
+ * direction up into its place.
+ */
+void tree_rotate(struct tree_tree *tree, struct tree_node *node,
+		 enum tree_dir left)
+{
+	const enum tree_dir right = 1 - left;
+	struct tree_node *tmp;
+
+	ASSERT3P(node->children[right], !=, NULL);
+
+	tmp = node->children[right];
+	node->children[right] = tmp->children[left];
+
+	if (tmp->children[left])
+		set_parent(tmp->children[left], node);
+
+	set_parent(tmp, get_parent(node));
+	if (!get_parent(node)) {
+		tree->root = tmp;
+	} else {
+		get_parent(node)->children[which_dir(get_parent(node), node)] = tmp;
+	}
+
+	tmp->children[left] = node;
+	set_parent(node, tmp);
+}
+
 static inline void __swap_nodes(struct tree_tree *tree,
 				struct tree_node *x,
 				struct tree_node *y,
@@ -30,6 +30,8 @@ extern void *tree_insert_here(struct tree_tree *tree, void *newitem,
 extern void tree_remove(struct tree_tree *tree, void *item,
 			struct tree_node **parent_r,
 			struct tree_node **child_r);
+extern void tree_rotate(struct tree_tree *tree, struct tree_node *node,
+			enum tree_dir left);
 
 static inline void *node2obj(struct tree_tree *tree, struct tree_node *node)
 {
@@ -175,17 +175,21 @@ ssize_t urldecode(const char *in, size_t len, char *out)
 
 struct str *urldecode_str(const char *in, size_t len)
 {
-	struct str *str;
 	ssize_t outlen;
-	char out[len];
+	char *out;
+
+	/* decode directly into the buffer the string will own */
+	out = malloc(len + 1);
+	if (!out)
+		return ERR_PTR(-ENOMEM);
 
 	outlen = urldecode(in, len, out);
-	if (outlen < 0)
+	if (outlen < 0) {
+		free(out);
 		return ERR_PTR(outlen);
+	}
 
-	str = str_dup_len(out, outlen);
-	if (!str)
-		return ERR_PTR(-ENOMEM);
+	out[outlen] = '\0';
 
-	return str;
+	return str_alloc(out);
 }
@@ -32,6 +32,8 @@
 #include <jeffpc/error.h>
 #include <jeffpc/types.h>
 #include <jeffpc/mem.h>
+#include <jeffpc/nvl.h>
+#include <jeffpc/taskq.h>
 
 #include "val_impl.h"
 
@@ -59,12 +61,54 @@ static const struct val val_ints[10] = {
 	[9] = INIT_STATIC_VAL(VT_INT, i, 9),
 };
 
+/*
+ * Every value pays for the largest member of the union, so keep it small.
+ * (Anything that doesn't fit into two pointers/words belongs out of line.)
+ */
+STATIC_ASSERT(sizeof(struct val) <= 32);
+
+/*
+ * The owner of an arena allocated value tree.  The root of the tree is
+ * copied into here.  See __val_arena_root.
+ */
+struct val_arena_root {
+	struct mem_arena *arena;
+	struct val val;
+};
+
+/*
+ * A string pointing into another value's buffer.  See str_slice.
+ */
+struct val_slice {
+	struct val *parent;
+	struct val val;
+};
+
+/*
+ * A blob with externally managed data.  See val_alloc_blob_ext.
+ */
+struct val_blob_ext {
+	void (*release)(void *ptr, size_t size, void *cookie);
+	void *cookie;
+	struct val val;
+};
+
 static struct mem_cache *val_cache;
+static struct mem_cache *val_slice_cache;
+static struct mem_cache *val_blob_ext_cache;
 
 static void __attribute__((constructor)) init_val_subsys(void)
 {
 	val_cache = mem_cache_create("val-cache", sizeof(struct val), 0);
 	ASSERT(!IS_ERR(val_cache));
+
+	val_slice_cache = mem_cache_create("val-slice-cache",
+					   sizeof(struct val_slice), 0);
+	ASSERT(!IS_ERR(val_slice_cache));
+
+	val_blob_ext_cache = mem_cache_create("val-blob-ext-cache",
+					      sizeof(struct val_blob_ext), 0);
+	ASSERT(!IS_ERR(val_blob_ext_cache));
 }
 
 struct val *__val_alloc(enum val_type type)
@@ -75,18 +119,127 @@ struct val *__val_alloc(enum val_type type)
 	if (!val)
 		return ERR_PTR(-ENOMEM);
 
-	val->type = type;
-	val->static_struct = false;
+	__val_init(val, type, false);
+
+	return val;
+}
+
+struct val *__val_alloc_arena(struct mem_arena *arena, enum val_type type)
+{
+	struct val *val;
+
+	if (!arena)
+		return __val_alloc(type);
+
+	val = mem_arena_alloc(arena, sizeof(struct val));
+	if (!val)
+		return ERR_PTR(-ENOMEM);
 
-	refcnt_init(&val->refcnt, 1);
+	__val_init(val, type, true);
 
 	return val;
 }
 
-void val_free(struct val *val)
+/*
+ * Allocate a string struct which keeps the parent alive.  The caller fills
+ * in the pointer and length.
+ */
+struct val *__val_alloc_slice(struct val *parent)
 {
-	ASSERT(val);
-	ASSERT3U(refcnt_read(&val->refcnt), ==, 0);
+	struct val_slice *slice;
+	struct val *val;
+
+	slice = mem_cache_alloc(val_slice_cache);
+	if (!slice) {
+		val_putref(parent);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	slice->parent = parent;
+
+	val = &slice->val;
+
+	__val_init(val, VT_STR, false);
+	val->static_alloc = true;
+	val->inline_alloc = false;
+	val->slice = true;
+
+	return val;
+}
+
+struct val *__val_arena_root(struct mem_arena *arena, struct val *val)
+{
+	struct val_arena_root *root;
+
+	if (IS_ERR(val))
+		goto err;
+
+	/*
+	 * Nothing in the tree points to the root value, so we can move it
+	 * into a root structure which knows which arena to free.  (The
+	 * root value might also be one of the global static values; making
+	 * a reference counted copy of one of those is harmless.)
+	 */
+	root = mem_arena_alloc(arena, sizeof(struct val_arena_root));
+	if (!root) {
+		val = ERR_PTR(-ENOMEM);
+		goto err;
+	}
+
+	memcpy(&root->val, val, sizeof(struct val));
+
+	root->arena = arena;
+	root->val.static_struct = false;
+	root->val.arena_root = true;
+	root->val.interned = false; /* the copy isn't the interned symbol */
+
+	refcnt_init(&root->val.refcnt, 1);
+
+	return &root->val;
+
+err:
+	mem_arena_destroy(arena);
+
+	return val;
+}
+
+/*
+ * Free a single value.  Any values that lose their last reference in the
+ * process are added to the todo list instead of being freed recursively.
+ */
+static void __val_free(struct val *val, struct val **todo)
+{
+	/* the whole tree lives in the arena */
+	if (val->arena_root) {
+		struct val_arena_root *root;
+
+		root = container_of(val, struct val_arena_root, val);
+
+		mem_arena_destroy(root->arena);
+		return;
+	}
+
+	/* the string lives in the parent */
+	if (val->slice) {
+		struct val_slice *slice;
+
+		slice = container_of(val, struct val_slice, val);
+
+		__val_putref_todo(slice->parent, todo);
+		mem_cache_free(val_slice_cache, slice);
+		return;
+	}
+
+	/* the blob's owner knows how to get rid of it */
+	if (val->ext_release) {
+		struct val_blob_ext *ext;
+
+		ext = container_of(val, struct val_blob_ext, val);
+
+		ext->release(val->_set_blob.ptr, val->blob.size, ext->cookie);
+		mem_cache_free(val_blob_ext_cache, ext);
+		return;
+	}
 
 	switch (val->type) {
 		case VT_NULL:
@@ -104,27 +257,207 @@ void val_free(struct val *val)
 				free((char *) val->_set_str_ptr);
 			break;
 		case VT_CONS:
-			val_putref(val->cons.head);
-			val_putref(val->cons.tail);
+			__val_putref_todo(val->cons.head, todo);
+			__val_putref_todo(val->cons.tail, todo);
 			break;
 		case VT_ARRAY: {
 			size_t i;
 
 			for (i = 0; i < val->array.nelem; i++)
-				val_putref(val->_set_array.vals[i]);
+				__val_putref_todo(val->_set_array.vals[i],
+						  todo);
 
 			if (!val->static_alloc)
 				free(val->_set_array.vals);
 			break;
 		}
 		case VT_NVL:
-			__val_free_nvl(val);
+			__val_free_nvl(val, todo);
 			break;
 	}
 
 	mem_cache_free(val_cache, val);
 }
 
+/*
+ * Freeing a value can drop the last reference on any number of other
+ * values - e.g., a long list or a deeply nested nvlist.  Instead of
+ * recursing (and possibly running out of stack), we keep a list of values
+ * waiting to be freed.  The list is threaded through the values themselves
+ * using the space taken up by the (no longer needed) reference count.
+ */
+void __val_free_todo(struct val *todo)
+{
+	while (todo) {
+		struct val *val = todo;
+
+		todo = val->_free_next;
+
+		__val_free(val, &todo);
+	}
+}
+
+static void free_tree(struct val *val)
+{
+	val->_free_next = NULL;
+
+	__val_free_todo(val);
+}
+
+/*
+ * Deferred freeing
+ *
+ * Large containers are handed off to the reclaimer taskq instead of being
+ * freed by the thread that dropped the last reference.  Only the top-level
+ * value is checked - the reclaimer frees everything it references itself.
+ */
+static struct taskq *reclaimer;
+static size_t reclaim_threshold;
+static atomic64_t reclaim_queued;
+static atomic64_t reclaim_completed;
+static atomic64_t reclaim_backlog_peak;
+
+static bool is_large(struct val *val, size_t threshold)
+{
+	size_t len;
+
+	if (val->arena_root)
+		return false; /* freeing an arena is cheap */
+
+	switch (val->type) {
+		case VT_ARRAY:
+			return val->array.nelem >= threshold;
+		case VT_NVL:
+			return __nvl_numpairs(val) >= threshold;
+		case VT_CONS:
+			for (len = 1; len < threshold; len++) {
+				val = val->cons.tail;
+				if (!val || (val->type != VT_CONS))
+					return false;
+			}
+
+			return true;
+		default:
+			return false;
+	}
+}
+
+static void reclaim(void *arg)
+{
+	free_tree(arg);
+
+	atomic_inc(&reclaim_completed);
+}
+
+static bool defer_free(struct val *val)
+{
+	struct taskq *tq;
+	uint64_t backlog;
+	uint64_t peak;
+
+	tq = __atomic_load_n(&reclaimer, __ATOMIC_ACQUIRE);
+	if (!tq || !is_large(val, reclaim_threshold))
+		return false;
+
+	backlog = atomic_inc(&reclaim_queued) -
+		  atomic_read(&reclaim_completed);
+
+	if (taskq_dispatch(tq, reclaim, val)) {
+		/* no memory to queue it, just free it */
+		atomic_dec(&reclaim_queued);
+		return false;
+	}
+
+	peak = atomic_read(&reclaim_backlog_peak);
+	while (backlog > peak) {
+		uint64_t old;
+
+		old = atomic_cas(&reclaim_backlog_peak, peak, backlog);
+		if (old == peak)
+			break;
+
+		peak = old;
+	}
+
+	return true;
+}
+
+int val_deferred_free_enable(size_t threshold, long nthreads)
+{
+	struct taskq *tq;
+
+	if (!threshold)
+		return -EINVAL;
+
+	if (__atomic_load_n(&reclaimer, __ATOMIC_ACQUIRE))
+		return -EBUSY;
+
+	tq = taskq_create_fixed("val-reclaim", nthreads);
+	if (IS_ERR(tq))
+		return PTR_ERR(tq);
+
+	reclaim_threshold = threshold;
+
+	if (atomic_cas_ptr(&reclaimer, NULL, tq)) {
+		taskq_destroy(tq);
+		return -EBUSY;
+	}
+
+	return 0;
+}
+
+void val_deferred_free_disable(void)
+{
+	struct taskq *tq;
+
+	tq = __atomic_exchange_n(&reclaimer, NULL, __ATOMIC_ACQ_REL);
+	if (!tq)
+		return;
+
+	taskq_wait(tq);
+	taskq_destroy(tq);
+}
+
+struct nvlist *val_deferred_free_stats(void)
+{
+	uint64_t queued, completed;
+	struct nvlist *out;
+	int ret;
+
+	out = nvl_alloc();
+	if (IS_ERR(out))
+		return out;
+
+	/* read completed first so that the backlog is never negative */
+	completed = atomic_read(&reclaim_completed);
+	queued = atomic_read(&reclaim_queued);
+
+	if ((ret = nvl_set_bool(out, "enabled",
+				__atomic_load_n(&reclaimer, __ATOMIC_ACQUIRE))) ||
+	    (ret = nvl_set_int(out, "threshold", reclaim_threshold)) ||
+	    (ret = nvl_set_int(out, "queued", queued)) ||
+	    (ret = nvl_set_int(out, "completed", completed)) ||
+	    (ret = nvl_set_int(out, "backlog", queued - completed)) ||
+	    (ret = nvl_set_int(out, "backlog_peak",
+			       atomic_read(&reclaim_backlog_peak)))) {
+		nvl_putref(out);
+		return ERR_PTR(ret);
+	}
+
+	return out;
+}
+
+void val_free(struct val *val)
+{
+	ASSERT(val);
+	ASSERT3U(refcnt_read(&val->refcnt), ==, 0);
+
+	if (defer_free(val))
+		return;
+
+	free_tree(val);
+}
+
 #define DEF_VAL_SET(fxn, vttype, valelem, ctype, putref)	\
 struct val *val_alloc_##fxn(ctype v)				\
 {								\
@@ -160,6 +493,22 @@ struct val *val_alloc_int(uint64_t i)
 	return val_alloc_int_heap(i);
 }
 
+struct val *__val_alloc_int_arena(struct mem_arena *arena, uint64_t i)
+{
+	struct val *val;
+
+	if (!arena || (i < ARRAY_LEN(val_ints)))
+		return val_alloc_int(i);
+
+	val = __val_alloc_arena(arena, VT_INT);
+	if (IS_ERR(val))
+		return val;
+
+	val->_set_i = i;
+
+	return val;
+}
+
 struct val *val_alloc_bool(bool b)
 {
 	const struct val *ret;
@@ -230,6 +579,37 @@ struct val *val_alloc_blob_static(const void *ptr, size_t size)
 	return __val_alloc_blob((void *) ptr, size, false);
 }
 
+struct val *val_alloc_blob_ext(void *ptr, size_t size,
+			       void (*release)(void *ptr, size_t size,
+					       void *cookie),
+			       void *cookie)
+{
+	struct val_blob_ext *ext;
+	struct val *val;
+
+	ASSERT(release);
+
+	ext = mem_cache_alloc(val_blob_ext_cache);
+	if (!ext) {
+		release(ptr, size, cookie);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	ext->release = release;
+	ext->cookie = cookie;
+
+	val = &ext->val;
+
+	__val_init(val, VT_BLOB, false);
+	val->static_alloc = true;
+	val->inline_alloc = false;
+	val->ext_release = true;
+	val->_set_blob.ptr = ptr;
+	val->_set_blob.size = size;
+
+	return val;
+}
+
 struct val *val_empty_cons(void)
 {
 	/*
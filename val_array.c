@@ -24,7 +24,8 @@
 
 #include "val_impl.h"
 
-static struct val *__val_alloc_array(struct val **vals, size_t nelem,
+static struct val *__val_alloc_array(struct mem_arena *arena,
+				     struct val **vals, size_t nelem,
 				     bool dup, bool heap)
 {
 	struct val *val;
@@ -53,7 +54,7 @@ static struct val *__val_alloc_array(struct val **vals, size_t nelem,
 		heap = true;
 	}
 
-	val = __val_alloc(VT_ARRAY);
+	val = __val_alloc_arena(arena, VT_ARRAY);
 	if (IS_ERR(val))
 		goto err;
 
@@ -75,15 +76,22 @@ err:
 
 struct val *val_alloc_array(struct val **vals, size_t nelem)
 {
-	return __val_alloc_array(vals, nelem, false, true);
+	return __val_alloc_array(NULL, vals, nelem, false, true);
 }
 
 struct val *val_alloc_array_dup(struct val **vals, size_t nelem)
 {
-	return __val_alloc_array(vals, nelem, true, false);
+	return __val_alloc_array(NULL, vals, nelem, true, false);
 }
 
 struct val *val_alloc_array_static(struct val **vals, size_t nelem)
 {
-	return __val_alloc_array(vals, nelem, false, false);
+	return __val_alloc_array(NULL, vals, nelem, false, false);
+}
+
+/* the vals array must be allocated from the arena as well */
+struct val *__val_alloc_array_arena(struct mem_arena *arena, struct val **vals,
+				    size_t nelem)
+{
+	return __val_alloc_array(arena, vals, nelem, false, !arena);
 }
@@ -25,6 +25,8 @@
 #include <jeffpc/val.h>
 #include <jeffpc/nvl.h>
 
+#include "val_impl.h"
+
 #define INDENT_STEP	5
 
 const char *__val_typename(int type, bool human)
@@ -126,12 +128,11 @@ static void do_val_dump_file(FILE *out, struct val *val, int indent)
 			break;
 		}
 		case VT_NVL: {
-			struct rb_tree *tree = &val->_set_nvl.values;
-			struct nvpair *cur;
+			const struct nvpair *cur;
 
-			fprintf(out, " items=%zu\n", rb_numnodes(tree));
+			fprintf(out, " items=%zu\n", __nvl_numpairs(val));
 
-			rb_for_each(tree, cur) {
+			nvl_for_each(cur, val_cast_to_nvl(val)) {
 				doindent(out, indent);
 				fprintf(out, "name='%s' ", str_cstr(cur->name));
 				do_val_dump_file(out, cur->value, indent + 1);
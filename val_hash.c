@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2026 Josef 'Jeff' Sipek <jeffpc@josefsipek.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <jeffpc/val.h>
+#include <jeffpc/nvl.h>
+#include <jeffpc/hash.h>
+
+#include "val_impl.h"
+
+/* per-type seeds so that e.g. 5 and #\5 don't hash the same */
+static inline uint32_t type_seed(enum val_type type)
+{
+	return hash_u64(type);
+}
+
+uint32_t val_hash(const struct val *val)
+{
+	uint32_t hash;
+
+	if (!val)
+		return 0;
+
+	hash = type_seed(val->type);
+
+	switch (val->type) {
+		case VT_NULL:
+			return hash;
+		case VT_INT:
+		case VT_CHAR:
+			return hash_combine(hash, hash_u64(val->i));
+		case VT_BOOL:
+			return hash_combine(hash, val->b);
+		case VT_STR:
+		case VT_SYM:
+			return hash_combine(hash, __strsym_hash(val));
+		case VT_BLOB:
+			return hash_combine(hash, hash_bytes(val->blob.ptr,
+							     val->blob.size));
+		case VT_CONS:
+			/* iterate over the tail to avoid deep recursion */
+			for (;;) {
+				hash = hash_combine(hash,
+						    val_hash(val->cons.head));
+
+				val = val->cons.tail;
+				if (!val || (val->type != VT_CONS))
+					return hash_combine(hash,
+							    val_hash(val));
+
+				hash = hash_combine(hash, VT_CONS);
+			}
+		case VT_ARRAY: {
+			size_t i;
+
+			for (i = 0; i < val->array.nelem; i++)
+				hash = hash_combine(hash,
+						    val_hash(val->array.vals[i]));
+
+			return hash;
+		}
+		case VT_NVL: {
+			const struct nvpair *pair;
+
+			/* iteration is ordered, so the hash is stable */
+			nvl_for_each(pair, (struct nvlist *) val) {
+				hash = hash_combine(hash,
+						    __strsym_hash(&pair->name->val));
+				hash = hash_combine(hash,
+						    val_hash(pair->value));
+			}
+
+			return hash;
+		}
+	}
+
+	panic("%s called with unknown type %d", __func__, val->type);
+}
+
+static bool strsym_equal(const struct val *a, const struct val *b)
+{
+	size_t len;
+
+	/* interned symbols are equal only if they are the same symbol */
+	if (a->interned && b->interned)
+		return false;
+
+	if (a->hash_valid && b->hash_valid && (a->hash != b->hash))
+		return false;
+
+	len = _strsym_len(a);
+	if (len != _strsym_len(b))
+		return false;
+
+	return !memcmp(val_cstr(a), val_cstr(b), len);
+}
+
+static bool nvl_equal(struct nvlist *a, struct nvlist *b)
+{
+	const struct nvpair *apair, *bpair;
+
+	for (apair = nvl_iter_start(a), bpair = nvl_iter_start(b);
+	     apair && bpair;
+	     apair = nvl_iter_next(a, apair), bpair = nvl_iter_next(b, bpair)) {
+		if (!strsym_equal(&apair->name->val, &bpair->name->val) ||
+		    !val_equal(apair->value, bpair->value))
+			return false;
+	}
+
+	/* both must run out at the same time */
+	return !apair && !bpair;
+}
+
+bool val_equal(const struct val *a, const struct val *b)
+{
+again:
+	if (a == b)
+		return true;
+
+	if (!a || !b)
+		return false;
+
+	if (a->type != b->type)
+		return false;
+
+	switch (a->type) {
+		case VT_NULL:
+			return true;
+		case VT_INT:
+		case VT_CHAR:
+			return a->i == b->i;
+		case VT_BOOL:
+			return a->b == b->b;
+		case VT_STR:
+		case VT_SYM:
+			return strsym_equal(a, b);
+		case VT_BLOB:
+			if (a->blob.size != b->blob.size)
+				return false;
+
+			return !a->blob.size ||
+				!memcmp(a->blob.ptr, b->blob.ptr, a->blob.size);
+		case VT_CONS:
+			if (!val_equal(a->cons.head, b->cons.head))
+				return false;
+
+			/* iterate over the tail to avoid deep recursion */
+			a = a->cons.tail;
+			b = b->cons.tail;
+			goto again;
+		case VT_ARRAY: {
+			size_t i;
+
+			if (a->array.nelem != b->array.nelem)
+				return false;
+
+			for (i = 0; i < a->array.nelem; i++)
+				if (!val_equal(a->array.vals[i],
+					       b->array.vals[i]))
+					return false;
+
+			return true;
+		}
+		case VT_NVL:
+			return nvl_equal((struct nvlist *) a,
+					 (struct nvlist *) b);
+	}
+
+	panic("%s called with unknown type %d", __func__, a->type);
+}
@@ -23,14 +23,177 @@
 #ifndef __VAL_IMPL_H
 #define __VAL_IMPL_H
 
+#include <string.h>
+
 #include <jeffpc/val.h>
 #include <jeffpc/nvl.h>
+#include <jeffpc/mem.h>
+#include <jeffpc/hash.h>
 
 extern struct val *__val_alloc(enum val_type type);
-extern void __val_free_nvl(struct val *val);
+extern struct val *__val_alloc_slice(struct val *parent);
+extern void __val_free_nvl(struct val *val, struct val **todo);
+extern void __val_free_todo(struct val *todo);
+
+/*
+ * Initialize a freshly allocated value with a single reference and all
+ * the flags cleared.  The caller sets whatever flags apply afterwards.
+ *
+ * Static values (arena allocated and interned) are immortal as far as
+ * reference counting is concerned, so their reference count is left
+ * zeroed just like that of statically initialized values.
+ */
+static inline void __val_init(struct val *val, enum val_type type,
+			      bool static_struct)
+{
+	val->type = type;
+	val->static_struct = static_struct;
+	val->arena_root = false;
+	val->len_valid = false;
+	val->hash_valid = false;
+	val->interned = false;
+	val->slice = false;
+	val->ext_release = false;
+	val->persistent = false;
+	val->hashed = false;
+	val->small = false;
 
-extern struct nvpair *__nvpair_alloc(struct str *name);
+	if (static_struct)
+		memset(&val->refcnt, 0, sizeof(val->refcnt));
+	else
+		refcnt_init(&val->refcnt, 1);
+}
+
+extern struct nvpair *__nvpair_alloc(struct mem_arena *arena,
+				     struct str *name);
 extern void __nvpair_free(struct nvpair *pair);
+extern void __nvpair_free_todo(struct nvpair *pair, struct val **todo);
+extern struct rb_tree *__nvl_alloc_tree(struct mem_arena *arena);
+extern void __nvl_free_tree(struct rb_tree *tree);
+
+/*
+ * Arena allocated values
+ *
+ * A value tree can be allocated from a single arena, in which case all the
+ * values, strings, arrays, and nvpairs live in the arena and the values
+ * are marked as static (making reference counting on them a no-op).
+ * Once the whole tree is built, __val_arena_root turns its root into the
+ * owner of the arena - a reference counted struct val which frees the
+ * entire arena when its last reference is dropped.
+ *
+ * The following functions behave like their non-arena counterparts when
+ * given a NULL arena.
+ */
+struct mem_arena;
+
+extern struct val *__val_alloc_arena(struct mem_arena *arena,
+				     enum val_type type);
+extern struct val *__val_arena_root(struct mem_arena *arena, struct val *val);
+extern struct val *__val_alloc_int_arena(struct mem_arena *arena, uint64_t i);
+extern struct val *__val_alloc_array_arena(struct mem_arena *arena,
+					   struct val **vals, size_t nelem);
+extern struct val *__val_alloc_nvl_arena(struct mem_arena *arena);
+extern struct val *__strsym_dup_len_arena(struct mem_arena *arena,
+					  const char *s, size_t len,
+					  enum val_type type);
+extern struct val *__sym_intern(const char *s, size_t len);
+
+/* is the nvlist's storage owned by an arena? */
+static inline bool __nvl_in_arena(struct val *val)
+{
+	return val->static_struct || val->arena_root;
+}
+
+/*
+ * Small nvlists
+ *
+ * Most nvlists only ever hold a handful of pairs.  Those live in a single
+ * array, avoiding a separate allocation and tree node bookkeeping for
+ * each pair.  The array is allocated when the first pair is added (empty
+ * nvlists don't have one), and once it fills up, the nvlist switches to a
+ * tree.
+ */
+#define NVL_SMALL_PAIRS		8
+
+struct nvl_small {
+	struct nvpair pairs[NVL_SMALL_PAIRS];	/* unused if name is NULL */
+	uint8_t order[NVL_SMALL_PAIRS];		/* used slots in name order */
+};
+
+extern struct nvl_small *__nvl_salloc(struct mem_arena *arena);
+extern struct nvpair *__nvl_sfind(struct val *val,
+				   const struct nvl_key *key);
+extern const struct nvpair *__nvl_sfirst(struct val *val);
+extern const struct nvpair *__nvl_snext(struct val *val,
+					const struct nvpair *prev);
+extern struct nvpair *__nvl_sadd(struct mem_arena *arena, struct val *val,
+				  struct str *name);
+extern void __nvl_sremove(struct val *val, struct nvpair *pair);
+extern int __nvl_sconvert(struct mem_arena *arena, struct val *val);
+extern void __nvl_sfree(struct val *val, struct val **todo);
+extern void __nvl_sfree_empty(struct nvl_small *small);
+
+/* persistent nvlists */
+extern struct nvpair *__nvl_pfind(struct val *val, const struct str *name);
+extern struct nvpair *__nvl_pfirst(struct val *val);
+extern struct nvpair *__nvl_pnext(struct val *val, const struct nvpair *prev);
+extern void __nvl_pfree(struct val *val, struct val **todo);
+
+/* hashed nvlists */
+extern struct nvpair *__nvl_hfind(struct val *val,
+				   const struct nvl_key *key);
+extern const struct nvpair *__nvl_hfirst(struct val *val);
+extern const struct nvpair *__nvl_hnext(struct val *val,
+					const struct nvpair *prev);
+extern int __nvl_hinsert(struct val *val, struct nvpair *pair);
+extern void __nvl_hremove(struct val *val, struct nvpair *pair);
+extern int __nvl_hconvert(struct val *val);
+extern int __nvl_hbuild(struct val *val, struct nvpair **pairs, size_t npairs);
+extern void __nvl_hfree(struct val *val, struct val **todo);
+
+static inline size_t __nvl_numpairs(struct val *val)
+{
+	if (val->small || val->persistent || val->hashed)
+		return val->nvl.npairs;
+
+	return rb_numnodes(val->nvl.values);
+}
+
+extern int __nvl_set_arena(struct mem_arena *arena, struct nvlist *nvl,
+			   struct str *name, struct val *val);
+extern int __nvl_set_bulk_arena(struct mem_arena *arena, struct nvlist *nvl,
+				struct str **names, struct val **vals,
+				size_t npairs);
+
+/*
+ * Like val_putref, but instead of freeing the value when its last
+ * reference goes away, add it to the todo list.  See val_free.
+ */
+static inline void __val_putref_todo(struct val *val, struct val **todo)
+{
+	if (!val || val_isstatic(val))
+		return;
+
+	if (__refcnt_dead(&val->refcnt))
+		panic("%s(%p) called with zero refcount", __func__, val);
+
+	if (!__refcnt_dec(&val->refcnt, val, val__refcnt_free))
+		return;
+
+	ASSERT3U(refcnt_read(&val->refcnt), ==, 0);
+
+	val->_free_next = *todo;
+	*todo = val;
+}
+
+static inline uint32_t __strsym_hash(const struct val *val)
+{
+	if (val->hash_valid)
+		return val->hash;
+
+	/* statically initialized or a slice, nothing is cached */
+	return hash_str(val_cstr(val), _strsym_len(val));
+}
 
 static inline bool val_is_null_cons(struct val *v)
 {
@@ -24,25 +24,46 @@
 
 #include "val_impl.h"
 
+/*
+ * Pairs stored in trees (and hash tables, which are converted from trees)
+ * carry the tree linkage.  Pairs in small nvlists and in persistent nvlists
+ * don't need it.
+ */
+struct nvpair_node {
+	struct nvpair pair;
+	struct rb_node node;
+};
+
 static struct mem_cache *nvpair_cache;
+static struct mem_cache *nvl_tree_cache;
 
 static void __attribute__((constructor)) init_val_subsys(void)
 {
-	nvpair_cache = mem_cache_create("nvpair-cache", sizeof(struct nvpair),
-					0);
+	nvpair_cache = mem_cache_create("nvpair-cache",
+					sizeof(struct nvpair_node), 0);
 	ASSERT(!IS_ERR(nvpair_cache));
+
+	nvl_tree_cache = mem_cache_create("nvl-tree-cache",
+					  sizeof(struct rb_tree), 0);
+	ASSERT(!IS_ERR(nvl_tree_cache));
 }
 
-struct nvpair *__nvpair_alloc(struct str *name)
+struct nvpair *__nvpair_alloc(struct mem_arena *arena, struct str *name)
 {
+	struct nvpair_node *pnode;
 	struct nvpair *pair;
 
-	pair = mem_cache_alloc(nvpair_cache);
-	if (!pair) {
+	if (arena)
+		pnode = mem_arena_alloc(arena, sizeof(struct nvpair_node));
+	else
+		pnode = mem_cache_alloc(nvpair_cache);
+	if (!pnode) {
 		str_putref(name);
 		return NULL;
 	}
 
+	pair = &pnode->pair;
+
 	/*
 	 * Avoid returning with a NULL pointer.  Of all the types, VT_NULL
 	 * is the least out of place.
@@ -62,7 +83,25 @@ void __nvpair_free(struct nvpair *pair)
 	str_putref(pair->name);
 	val_putref(pair->value);
 
-	mem_cache_free(nvpair_cache, pair);
+	mem_cache_free(nvpair_cache,
+		       container_of(pair, struct nvpair_node, pair));
+}
+
+void __nvpair_free_todo(struct nvpair *pair, struct val **todo)
+{
+	__val_putref_todo(str_cast_to_val(pair->name), todo);
+	__val_putref_todo(pair->value, todo);
+
+	mem_cache_free(nvpair_cache,
+		       container_of(pair, struct nvpair_node, pair));
+}
+
+/* the tree must be empty */
+void __nvl_free_tree(struct rb_tree *tree)
+{
+	rb_destroy(tree);
+
+	mem_cache_free(nvl_tree_cache, tree);
 }
 
 static int val_nvl_cmp(const void *va, const void *vb)
@@ -73,32 +112,77 @@ static int val_nvl_cmp(const void *va, const void *vb)
 	return str_cmp(a->name, b->name);
 }
 
-struct val *val_alloc_nvl(void)
+struct rb_tree *__nvl_alloc_tree(struct mem_arena *arena)
+{
+	struct rb_tree *tree;
+
+	if (arena)
+		tree = mem_arena_alloc(arena, sizeof(struct rb_tree));
+	else
+		tree = mem_cache_alloc(nvl_tree_cache);
+	if (!tree)
+		return NULL;
+
+	/* the pair is at the start of struct nvpair_node */
+	rb_create(tree, val_nvl_cmp, sizeof(struct nvpair_node),
+		  offsetof(struct nvpair_node, node));
+
+	return tree;
+}
+
+struct val *__val_alloc_nvl_arena(struct mem_arena *arena)
 {
 	struct val *val;
 
-	val = __val_alloc(VT_NVL);
+	/*
+	 * The pairs are kept out of line to keep struct val small - every
+	 * value would otherwise pay for them.  All nvlists start out small
+	 * (without an array until the first pair is added) and switch to a
+	 * tree once they outgrow the array.
+	 */
+	val = __val_alloc_arena(arena, VT_NVL);
 	if (IS_ERR(val))
 		return val;
 
-	rb_create(&val->_set_nvl.values, val_nvl_cmp, sizeof(struct nvpair),
-		   offsetof(struct nvpair, node));
+	val->small = true;
+	val->_set_nvl.small = NULL;
+	val->_set_nvl.npairs = 0;
 
 	return val;
 }
 
-void __val_free_nvl(struct val *val)
+struct val *val_alloc_nvl(void)
+{
+	return __val_alloc_nvl_arena(NULL);
+}
+
+/* the reference count is already reused by val_free */
+void __val_free_nvl(struct val *val, struct val **todo)
 {
 	struct rb_cookie cookie;
 	struct nvpair *cur;
 
 	ASSERT(val);
-	ASSERT3U(refcnt_read(&val->refcnt), ==, 0);
 	ASSERT3U(val->type, ==, VT_NVL);
 
+	if (val->persistent) {
+		__nvl_pfree(val, todo);
+		return;
+	}
+
+	if (val->hashed) {
+		__nvl_hfree(val, todo);
+		return;
+	}
+
+	if (val->small) {
+		__nvl_sfree(val, todo);
+		return;
+	}
+
 	memset(&cookie, 0, sizeof(struct rb_cookie));
-	while ((cur = rb_destroy_nodes(&val->_set_nvl.values, &cookie)))
-		__nvpair_free(cur);
+	while ((cur = rb_destroy_nodes(val->_set_nvl.values, &cookie)))
+		__nvpair_free_todo(cur, todo);
 
-	rb_destroy(&val->_set_nvl.values);
+	__nvl_free_tree(val->_set_nvl.values);
 }